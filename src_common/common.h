@@ -1109,6 +1109,12 @@ inline T* alloc(Region* memory, umm count = 1)
 void* allocate_virtual_memory(umm size, bool high_address_range);  // May return NULL on failure!
 void release_virtual_memory(void* base, umm size);
 
+// Reserved memory is only address space, parts of it have to be committed before they are used.
+// With huge_pages, the OS is asked to back the committed range with huge pages if it can, so the
+// range should be aligned to the huge page size, and so should the reservation (see alignment).
+void* reserve_virtual_memory(umm size, umm alignment = 0);  // May return NULL on failure! Release with release_virtual_memory.
+bool commit_virtual_memory(void* base, umm size, bool huge_pages);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Atomic tree
@@ -3754,15 +3760,15 @@ int close_file_descriptor(int fd);
 #endif
 
 
-#if defined(OS_WINDOWS)
 struct Memory_Mapped_String: String
 {
     void* os_handle;
 };
 
+// Returns an empty string if the file can't be mapped. On Linux, this includes files
+// that aren't regular files (such as pipes) and empty files, which callers should read instead.
 Memory_Mapped_String open_memory_mapped_file_readonly(String path);
 void close_memory_mapped_file(Memory_Mapped_String* file);
-#endif
 
 
 
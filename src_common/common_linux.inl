@@ -109,6 +109,46 @@ void release_virtual_memory(void* base, umm size)
     }
 }
 
+void* reserve_virtual_memory(umm size, umm alignment)
+{
+    // Over-reserve by the alignment, then unmap what sticks out on either side.
+    umm padding = (alignment > 4096) ? alignment : 0;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    void* result = mmap(/*base*/ NULL, size + padding, PROT_NONE, flags, /*fd*/ -1, /*offset*/ 0);
+    if (result == 0 || result == MAP_FAILED)
+    {
+        report_last_errno("memory"_s, "While callling mmap()"_s);
+        return NULL;
+    }
+
+    if (padding)
+    {
+        u8* base    = (u8*) result;
+        u8* aligned = (u8*)(((umm) base + alignment - 1) & ~(alignment - 1));
+        if (aligned > base)
+            munmap(base, aligned - base);
+        if (aligned + size < base + size + padding)
+            munmap(aligned + size, base + size + padding - (aligned + size));
+        result = aligned;
+    }
+
+    return result;
+}
+
+bool commit_virtual_memory(void* base, umm size, bool huge_pages)
+{
+    if (mprotect(base, size, PROT_READ | PROT_WRITE))
+    {
+        report_last_errno("memory"_s, "While callling mprotect()"_s);
+        return false;
+    }
+
+    // Only a hint, it's fine if transparent huge pages are disabled.
+    if (huge_pages)
+        madvise(base, size, MADV_HUGEPAGE);
+    return true;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // File path utilities.
@@ -559,6 +599,54 @@ bool copy_file(String from, String to, bool error_on_overwrite, bool write_throu
 }
 
 
+Memory_Mapped_String open_memory_mapped_file_readonly(String path)
+{
+try_open_again:
+    int fd = open(make_c_style_string(path), O_CLOEXEC | O_RDONLY);
+    if (fd == -1)
+    {
+        if (errno == EINTR) goto try_open_again;
+        ReportLastErrno(subsystem_files, "While opening file % for mapping", path);
+        return {};
+    }
+    Defer(close_file_descriptor(fd));
+
+    struct stat s = {};
+    if (fstat(fd, &s))
+    {
+        ReportLastErrno(subsystem_files, "While getting the size of file % for mapping", path);
+        return {};
+    }
+    if (!S_ISREG(s.st_mode) || s.st_size == 0)
+        return {};
+    if (s.st_size != (umm) s.st_size)
+    {
+        LogError(subsystem_files, "Failed to map file % - file is too big!", path);
+        return {};
+    }
+
+    void* data = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        ReportLastErrno(subsystem_files, "Failed to map file %", path);
+        return {};
+    }
+    madvise(data, s.st_size, MADV_SEQUENTIAL);
+
+    Memory_Mapped_String result = {};
+    result.length = (umm) s.st_size;
+    result.data   = (u8*) data;
+    return result;
+}
+
+void close_memory_mapped_file(Memory_Mapped_String* file)
+{
+    if (file->data)
+        munmap(file->data, file->length);
+    ZeroStruct(file);
+}
+
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
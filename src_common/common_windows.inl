@@ -49,6 +49,33 @@ void release_virtual_memory(void* base, umm size)
     VirtualFree(base, 0, MEM_RELEASE);
 }
 
+void* reserve_virtual_memory(umm size, umm alignment)
+{
+    // Reservations are only 64KB aligned, and can't be partially released. Find an aligned
+    // address in a bigger reservation, then reserve exactly that. Another thread might take
+    // the address in between, so this is retried a few times.
+    if (alignment > Kilobyte(64))
+    {
+        for (umm attempt = 0; attempt < 16; attempt++)
+        {
+            void* probe = VirtualAlloc(NULL, size + alignment, MEM_RESERVE, PAGE_NOACCESS);
+            if (!probe) return NULL;
+            VirtualFree(probe, 0, MEM_RELEASE);
+
+            void* aligned = (void*)(((umm) probe + alignment - 1) & ~(alignment - 1));
+            if (void* result = VirtualAlloc(aligned, size, MEM_RESERVE, PAGE_NOACCESS))
+                return result;
+        }
+    }
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool commit_virtual_memory(void* base, umm size, bool huge_pages)
+{
+    (void) huge_pages;  // large pages have to be reserved as such, and need a privilege
+    return VirtualAlloc(base, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // File path utilities.
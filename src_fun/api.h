@@ -13,13 +13,19 @@ String int_base10(Integer const* integer, Region* memory = temp, umm min_digits
 String int_base16(Integer const* integer, Region* memory = temp, umm min_digits = 0);
 
 // Always reduced, denominator always positive.
+// If small_den is not zero, the value is small_num / small_den and the
+// Integers are unused. Values are promoted to Integers only when they don't
+// fit, so most compile-time arithmetic never allocates.
 struct Fraction
 {
+    s64     small_num;
+    s64     small_den;
     Integer num;
     Integer den;
 };
 
 Fraction fract_make_u64   (u64 integer);
+Fraction fract_make_scaled(u64 mantissa, u32 base, s64 exponent);  // mantissa * base^exponent
 Fraction fract_make       (Integer const* num, Integer const* den);
 void     fract_free       (Fraction* f);
 Fraction fract_clone      (Fraction const* from);
@@ -28,6 +34,9 @@ bool     fract_is_zero    (Fraction const* f);
 bool     fract_is_negative(Fraction const* f);
 bool     fract_is_integer (Fraction const* f);
 bool     fract_equals     (Fraction const* a, Fraction const* b);
+u64      fract_hash       (Fraction const* f);
+Integer  fract_get_numerator  (Fraction const* f);  // caller frees
+Integer  fract_get_denominator(Fraction const* f);  // caller frees
 Fraction fract_neg        (Fraction const* a);
 Fraction fract_add        (Fraction const* a, Fraction const* b);
 Fraction fract_sub        (Fraction const* a, Fraction const* b);
@@ -177,12 +186,19 @@ struct Token_Info
 
 CompileTimeAssert(sizeof(Token_Info) == 8);
 
+// Most literals are a u64 mantissa times a small power of 10 or 2, and are stored like that.
+// Their Fraction is only built when it's first asked for, see get_number_value().
+// Literals which don't fit are built by the lexer, and exponent_base is zero for those.
 struct Token_Info_Number: Token_Info
 {
-    Fraction value;
+    u64 mantissa;
+    s16 exponent;
+    u8  exponent_base;
+    u8  unused;
+    u32 value_index;  // into Compiler::number_values plus one, zero if not built yet
 };
 
-CompileTimeAssert(sizeof(Token_Info_Number) == 72);
+CompileTimeAssert(sizeof(Token_Info_Number) == 24);
 
 struct Token_Info_String: Token_Info
 {
@@ -199,6 +215,75 @@ struct Token
 
 CompileTimeAssert(sizeof(Token) == 8);
 
+// :TokenStore
+// Token infos are appended to a reserved range of address space, which is committed a chunk at
+// a time as it fills up. They never move, and a compiler which lexes a few lines only commits a
+// small chunk, instead of allocating for the worst case up front. Later chunks are as big as a
+// huge page, aligned to one, and asked to be backed by one - but not the first huge page worth,
+// because faulting in a huge page costs more than a small compile does.
+static constexpr umm TOKEN_STORE_RESERVE     = Gigabyte(1);
+static constexpr umm TOKEN_STORE_FIRST_CHUNK = Kilobyte(64);
+static constexpr umm TOKEN_STORE_CHUNK       = Megabyte(2);  // the usual huge page size
+
+template <typename T>
+struct Token_Store
+{
+    T*  address;
+    umm count;
+    umm capacity;   // items which fit in the committed memory
+    umm committed;  // bytes
+
+    T& operator[](umm index) { return address[index]; }
+};
+
+void grow_token_store(void** address, umm* committed);
+void free_token_store(void** address);
+
+template <typename T>
+inline T* reserve_item(Token_Store<T>* store)
+{
+    if (store->count == store->capacity)
+    {
+        grow_token_store((void**) &store->address, &store->committed);
+        store->capacity = store->committed / sizeof(T);
+    }
+    return &store->address[store->count++];
+}
+
+template <typename T>
+inline void free_token_store(Token_Store<T>* store)
+{
+    free_token_store((void**) &store->address);
+    ZeroStruct(store);
+}
+
+// Interns identifiers, safe to use from any number of threads at once, see :AtomTable.
+static constexpr umm ATOM_TABLE_SHARD_BITS = 6;
+static constexpr umm ATOM_TABLE_SHARDS     = 1 << ATOM_TABLE_SHARD_BITS;
+static constexpr umm ATOM_TABLE_PAGE_SIZE  = 16384;  // identifiers per page
+static constexpr umm ATOM_TABLE_MAX_PAGES  = 1024;
+
+struct Atom_Table_Slot
+{
+    u32  hash;
+    Atom atom;  // ATOM_INVALID if the slot is empty
+};
+
+struct alignas(64) Atom_Table_Shard
+{
+    Lock             lock;
+    u32              count;
+    u32              capacity;  // zero or a power of two
+    Atom_Table_Slot* slots;
+};
+
+struct Atom_Table
+{
+    Atom_Table_Shard       shards[ATOM_TABLE_SHARDS];
+    Atomic32               count_identifiers;  // includes unique atoms, which aren't in any shard
+    Atomic_Pointer<String> pages[ATOM_TABLE_MAX_PAGES];
+};
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -306,7 +391,6 @@ CompileTimeAssert(sizeof(Expression_List) == 4);
     X(NUMERIC_LITERAL)              \
     X(STRING_LITERAL)               \
     X(TYPE_LITERAL)                 \
-    X(COMMENT)                      \
     X(BLOCK)                        \
     X(UNIT)                         \
                                     \
@@ -401,6 +485,16 @@ enum Comment_Relation
     COMMENT_IS_BEFORE,  // default case
 };
 
+// :BlockComments
+// Comments aren't expressions, they are kept next to the block they're found in, and only if
+// Compiler::keep_comments is set. Nothing in inference or bytecode generation looks at them.
+struct Block_Comment
+{
+    Token            token;
+    Comment_Relation relation;
+    Expression       relative_to;  // may be NO_EXPRESSION if relation == 'COMMENT_IS_ALONE'
+};
+
 struct Parsed_Expression
 {
     Expression_Kind kind;
@@ -421,13 +515,6 @@ struct Parsed_Expression
 
         Expression_List const* yield_assignments;
 
-        struct
-        {
-            Token            token;
-            Comment_Relation relation;
-            Expression       relative_to;  // may be NO_EXPRESSION if relation == 'COMMENT_IS_ALONE'
-        } comment;
-
         struct
         {
             Token token;
@@ -482,6 +569,8 @@ enum: flags32
     INFERRED_EXPRESSION_CONDITION_DISABLED          = 0x0008,
     INFERRED_EXPRESSION_CONDITION_ENABLED           = 0x0010,
     INFERRED_EXPRESSION_IS_HARDENED_CONSTANT        = 0x0020,
+    INFERRED_EXPRESSION_IS_LAZY                     = 0x0040,  // part of an imported alias, inferred only when a name lookup reaches it
+    INFERRED_EXPRESSION_IS_NOT_DEMANDED             = 0x0080,  // lazy, and no name lookup reached it yet
 };
 
 struct Inferred_Expression
@@ -490,7 +579,7 @@ struct Inferred_Expression
     Type          type;
     Type          hardened_type;
     struct Block* called_block;
-    u64           constant;
+    u64           constant;  // index into Compiler::constant_pool
 };
 
 CompileTimeAssert(sizeof(Inferred_Expression) == 32);
@@ -520,48 +609,49 @@ union Constant
 };
 
 
-struct Argument_Key
+// Soft constants are hash-consed into a per-compiler pool, see intern_constant().
+// Pooled constants are immutable and live as long as the compiler, so two
+// constants of the same soft type are equal iff their pool indices are equal.
+// Unlike Argument_Key, the pool distinguishes soft blocks by their alias,
+// since the alias is observable (it's the name used when reporting).
+struct Constant_Key
 {
-    Type     type;
-    Constant constant;  // zero where N/A, so this case can be ignored
+    Type            type;
+    Constant const* constant;
 
-    inline bool operator==(Argument_Key const& other) const
+    inline bool operator==(Constant_Key const& other) const
     {
         if (type != other.type) return false;
-        if (!is_soft_type(type)) return true;
 
+        Constant const* a = constant;
+        Constant const* b = other.constant;
         switch (type)
         {
-        case TYPE_SOFT_NUMBER: return fract_equals(&constant.number, &other.constant.number);
-        case TYPE_SOFT_BOOL:   return constant.boolean == other.constant.boolean;
-        case TYPE_SOFT_TYPE:   return constant.type    == other.constant.type;
-        case TYPE_SOFT_BLOCK:  return constant.block   == other.constant.block;
+        case TYPE_SOFT_NUMBER: return fract_equals(&a->number, &b->number);
+        case TYPE_SOFT_BOOL:   return a->boolean == b->boolean;
+        case TYPE_SOFT_TYPE:   return a->type    == b->type;
+        case TYPE_SOFT_BLOCK:  return a->block   == b->block
+                                   && a->block.has_alias == b->block.has_alias
+                                   && (!a->block.has_alias || (a->block.alias.atom       == b->block.alias.atom &&
+                                                               a->block.alias.info_index == b->block.alias.info_index));
         IllegalDefaultCase;
         }
     }
 
-    static inline u64 hash(Argument_Key const& k)
+    static inline u64 hash(Constant_Key const& k)
     {
-        // @Optimization - better hash function
         u64 hash = hash_u64((u64) k.type);
-        if (!is_soft_type(k.type))
-            return hash;
 
-        Constant const& c = k.constant;
+        Constant const* c = k.constant;
         switch (k.type)
         {
-        case TYPE_SOFT_NUMBER:
-
-
-            hash ^= hash_u64(c.number.num.negative);
-            hash ^= hash_u64(c.number.den.negative);
-            hash ^= hash64(c.number.num.digit, c.number.num.size * sizeof(*c.number.num.digit));
-            hash ^= hash64(c.number.den.digit, c.number.den.size * sizeof(*c.number.den.digit));
-            break;
-        case TYPE_SOFT_BOOL:   hash ^= hash_u64(c.boolean);    break;
-        case TYPE_SOFT_TYPE:   hash ^= hash_u64((u64) c.type); break;
-        case TYPE_SOFT_BLOCK:  hash ^= hash_pointer(c.block.materialized_parent);
-                               hash ^= hash_pointer(c.block.parsed_child);
+        case TYPE_SOFT_NUMBER: hash ^= fract_hash(&c->number); break;
+        case TYPE_SOFT_BOOL:   hash ^= hash_u64(c->boolean);    break;
+        case TYPE_SOFT_TYPE:   hash ^= hash_u64((u64) c->type); break;
+        case TYPE_SOFT_BLOCK:  hash ^= hash_pointer(c->block.materialized_parent);
+                               hash ^= hash_pointer(c->block.parsed_child);
+                               if (c->block.has_alias)
+                                   hash ^= hash_u64(c->block.alias.info_index);
                                break;
         IllegalDefaultCase;
         }
@@ -570,6 +660,44 @@ struct Argument_Key
     }
 };
 
+
+struct Argument_Key
+{
+    Type            type;
+    Constant const* constant;  // points into the constant pool, NULL where N/A
+
+    inline bool operator==(Argument_Key const& other) const
+    {
+        if (type != other.type) return false;
+        if (!is_soft_type(type)) return true;
+
+        // Pooled constants are hash-consed, so identity is equality,
+        // except for soft blocks where we don't care about the alias.
+        if (type == TYPE_SOFT_BLOCK)
+            return constant->block == other.constant->block;
+        return constant == other.constant;
+    }
+
+    static inline u64 hash(Argument_Key const& k)
+    {
+        u64 hash = hash_u64((u64) k.type);
+        if (!is_soft_type(k.type))
+            return hash;
+
+        if (k.type == TYPE_SOFT_BLOCK)
+        {
+            hash ^= hash_pointer(k.constant->block.materialized_parent);
+            hash ^= hash_pointer(k.constant->block.parsed_child);
+        }
+        else
+        {
+            hash ^= hash_pointer(k.constant);
+        }
+
+        return hash;
+    }
+};
+
 // What has to be equal for the calls to be equivalent:
 //  - the unit it occurs inside
 //  - the parsed block which is being called
@@ -671,6 +799,8 @@ enum: flags32
     BLOCK_IS_TOP_LEVEL            = 0x0020,
     BLOCK_HAS_BEEN_PLACED         = 0x0040,
     BLOCK_HAS_BEEN_GENERATED      = 0x0080,
+    BLOCK_HAS_COMPLETED_INFERENCE = 0x0100,
+    BLOCK_IS_INFERRING_ON_DEMAND  = 0x0200,  // inference was restarted because a lazy declaration was demanded
 };
 
 struct Block
@@ -683,6 +813,13 @@ struct Block
     Array<struct Parsed_Expression const> parsed_expressions;
     Array<Expression const> imperative_order;
 
+    // Columns parallel to parsed_expressions, for scans which don't need the full expressions.
+    Array<Expression_Kind const> parsed_kinds;
+    Array<flags16 const>         parsed_flags;
+    Array<Atom const>            parsed_names;  // declared or deleted name, ATOM_INVALID for other expressions
+
+    Array<Block_Comment const> comments;  // empty unless Compiler::keep_comments is set, see :BlockComments
+
     // Filled out in inference, but stored on parsed block:
     Table(Call_Key, Call_Value, Call_Key::hash) calls;
 
@@ -690,7 +827,6 @@ struct Block
     struct Unit* materialized_by_unit;
     Block*       materialized_from;
     Array<struct Inferred_Expression> inferred_expressions;  // parallel to parsed_expressions
-    Dynamic_Array<Constant> constants;
 
     Table(Expression, Resolved_Name, hash_u32) resolved_names;
     Table(Expression, Wait_Info,     hash_u32) waiting_expressions;
@@ -747,6 +883,15 @@ struct Unit
     bool   compiled_bytecode;
     Array<struct Bytecode       const> bytecode;
     Array<struct Bytecode_Patch const> bytecode_patches;
+    Array<struct Storage_Range  const> temporary_storage;  // sorted by offset, see :BytecodeIr
+    umm    entry_into_zeroed_storage;  // first instruction after the zeroing prologue, see :ZeroedUnitStorage
+
+    // Counted while the unit is generated, maybe on a worker thread, and added to the compiler's
+    // counts afterwards, see :ParallelCodegen
+    umm    count_calls;
+    umm    count_inlined_calls;  // see :InlineSmallBlocks
+    umm    count_hoisted_expressions;
+    umm    count_ir_removed_instructions;
 };
 
 
@@ -756,6 +901,17 @@ enum: flags32
     OP_COMPARE_EQUAL   = 0x00000001,
     OP_COMPARE_GREATER = 0x00000002,
     OP_COMPARE_LESS    = 0x00000004,
+
+    // a of this OP_LITERAL is an instruction index (a return address), see :BytecodeIr
+    OP_A_IS_INSTRUCTION = 0x00001000,
+
+    // a of this OP_LITERAL is the address of a unit, or of b bytes of data which the compiler
+    // owns, so it's relocated when the bytecode is saved, see :BytecodeImage
+    OP_A_IS_UNIT        = 0x00002000,
+    OP_A_IS_DATA        = 0x00004000,
+
+    // a of this OP_INTRINSIC is an Intrinsic_Binding, instead of the parameter block
+    OP_A_IS_BINDING     = 0x00008000,
 };
 
 enum Bytecode_Operation: u32
@@ -780,9 +936,16 @@ enum Bytecode_Operation: u32
     OP_DIVIDE_FRACTIONAL,       // r = result  a = lhs  b = rhs  s = type  (type options: f)
     OP_COMPARE,                 // r = result  a = lhs  b = rhs  s = type  (type options: u,s,b,f)
 
+    // Same as above, but b is the rhs value itself, not its offset.
+    OP_ADD_IMMEDIATE,           // r = result  a = lhs  b = rhs  s = type  (type options: u,f)
+    OP_SUBTRACT_IMMEDIATE,      // r = result  a = lhs  b = rhs  s = type  (type options: u,f)
+    OP_MULTIPLY_IMMEDIATE,      // r = result  a = lhs  b = rhs  s = type  (type options: u,f)
+    OP_COMPARE_IMMEDIATE,       // r = result  a = lhs  b = rhs  s = type  (type options: u,s,b,f)
+
     OP_MOVE_POINTER_CONSTANT,   // r = result  a = pointer               s = amount
     OP_MOVE_POINTER_FORWARD,    // r = result  a = pointer  b = integer  s = multiplier
     OP_MOVE_POINTER_BACKWARD,   // r = result  a = pointer  b = integer  s = multiplier
+    OP_MOVE_POINTER_IMMEDIATE,  // r = result  a = pointer  b = integer  s = multiplier  (b is the value)
     OP_POINTER_DISTANCE,        // r = result  a = pointer  b = pointer  s = divisor
 
     OP_CAST,                    // r = result  a = value  b = value type  s = result type  (type options: u,s,f,b)
@@ -794,7 +957,7 @@ enum Bytecode_Operation: u32
     OP_SWITCH_UNIT,             // r = &code         a = &storage
     OP_FINISH_UNIT,             //
 
-    OP_INTRINSIC,               // a = &block  b = name.data  s = name.length
+    OP_INTRINSIC,               // a = &block  b = name.data  s = name.length  (or a = &binding, see OP_A_IS_BINDING)
 
     OP_DEBUG_PRINT,             // r = operand                        s = type  (type options: any)
     OP_DEBUG_ALLOC,             // r = destination  a = size operand
@@ -822,6 +985,27 @@ struct Bytecode_Patch
     umm        label;
 };
 
+struct Storage_Range
+{
+    u64 offset;
+    u64 size;
+};
+
+// The parameters and returns of an intrinsic, found ahead of time, because units which are loaded
+// from an image don't have blocks to look them up in, see :BytecodeImage
+struct Intrinsic_Field
+{
+    String name;
+    Type   type;
+    bool   is_return;
+    u64    offset;  // into the storage of the unit
+};
+
+struct Intrinsic_Binding
+{
+    Array<Intrinsic_Field> fields;
+};
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -899,36 +1083,87 @@ struct Compiler
 
     Array<String> import_path_patterns;
 
+    bool map_source_files;  // if set, read_source_file maps files instead of reading them, see :MappedSources
+    umm  count_mapped_sources;
+
     Dynamic_Array<Source_Info,       false> sources;
-    Dynamic_Array<Token_Info,        false> token_info_other;
-    Dynamic_Array<Token_Info_Number, false> token_info_number;
-    Dynamic_Array<Token_Info_String, false> token_info_string;
-    Dynamic_Array<String,            false> identifiers;
+    Token_Store<Token_Info>        token_info_other;
+    Token_Store<Token_Info_Number> token_info_number;
+    Dynamic_Array<Fraction>        number_values;
+    Token_Store<Token_Info_String> token_info_string;
 
-    Atom next_identifier_atom;
-    Table(String, Atom, hash_string) atom_table;
+    Atom_Table atoms;
 
     // Parser
     Region parser_memory;
     Table(String, Block*, hash_string) top_level_blocks;
+    Block* preload;  // parsed once, and materialized into every environment
+    bool   keep_comments;  // if set, blocks keep the comments found in them, see :BlockComments
+
+    // Import resolution caches, see :ImportCache
+    Table(String, String, hash_string) resolved_modules;      // module name -> path, empty if it didn't resolve
+    Table(String, bool,   hash_string) checked_import_paths;  // explicit import path -> whether the file exists
+    Table(String, bool,   hash_string) listed_directories;    // directory -> whether it could be listed
+    Table(String, bool,   hash_string) listed_files;          // every file in the listed directories
+    umm count_import_probes;
+
+    String module_cache_directory;  // if set, parsed modules are cached on disk, see cache.cpp
+    umm    count_cached_modules;
+
+    umm              frontend_threads;  // if more than 1, imports are lexed and parsed ahead on worker threads, see preparse.cpp
+    struct Preparse* preparse;
+    bool             is_preparse_worker;
+    umm              count_preparsed_modules;
 
     umm count_parsed_blocks;
     umm count_parsed_expressions;
+    umm count_parsed_comments;
     umm count_parsed_expressions_by_kind[COUNT_EXPRESSIONS];
 
     // Inference
+    bool lazy_imports;  // if set, aliases in imported units are only inferred when referenced
     umm count_inferred_units;
     umm count_inferred_blocks;
     umm count_inferred_constants;
+    umm count_lazy_declarations;
+    umm count_demanded_declarations;
+
+    Region constant_memory;
+    Dynamic_Array<Constant const*> constant_pool;
+    Table(Constant_Key, u64, Constant_Key::hash) constant_pool_index;
     umm count_inferred_expressions;
     umm count_inferred_expressions_by_kind[COUNT_EXPRESSIONS];
 
+    // Bytecode
+    bool report_inlining;  // if set, the number of inlined calls is printed for each unit, see :InlineSmallBlocks
+    umm  count_inlined_calls;
+    umm  count_hoisted_expressions;  // see :LoopInvariantCodeMotion
+    bool skip_ir_passes;  // if set, bytecode runs the way it was generated, see :BytecodeIr
+    bool dump_ir;         // if set, the IR of each unit is printed before and after the passes
+    umm  count_ir_removed_instructions;
+    bool dump_bytecode;  // if set, each unit is disassembled once it's compiled, see :DumpBytecode
+    Dynamic_Array<Unit*> dumped_units;
+
+    umm                  backend_threads;  // if more than 1, units are generated on worker threads, see codegen.cpp
+    struct Codegen_Pool* codegen;
+    umm                  count_parallel_codegen_batches;
+
     // Pipeline
     Region pipeline_memory;
     Dynamic_Array<Environment*> environments;
+
+    bool compile_only;  // if set, units are recorded in run_units instead of running, see :BytecodeImage
+    Dynamic_Array<Unit*> run_units;
+
+    // Reporting
+    umm  count_reports;
+    bool silence_reports;  // reports are still counted, but not printed
 };
 
 void add_default_import_path_patterns(Compiler* ctx);
+// Returns the path of the imported file, or an empty string if it can't be resolved, see :ImportCache.
+String resolve_import(Compiler* ctx, String imports_relative_to_path, String path,
+                      Dynamic_Array<String>* out_looked_in_before_resolving = NULL, bool* out_is_path = NULL);
 
 Environment* make_environment(Compiler* ctx, Environment* puppeteer);
 
@@ -943,7 +1178,34 @@ bool pump_pipeline(Compiler* ctx);
 // tokens array, however we do keep track of their locations and return a
 // separate comments array.
 bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_tokens, Array<Token>* out_comments, Source_Info** out_source_info = NULL);
+bool read_source_file(Compiler* ctx, String path, String* out_code);  // into lexer_memory, call lex_init first
 bool lex_file(Compiler* ctx, String path, Array<Token>* out_tokens, Array<Token>* out_comments);
+void lex_init(Compiler* ctx);
+
+void make_atom_table(Atom_Table* table);
+void free_atom_table(Atom_Table* table);
+umm  count_atoms(Atom_Table* table);  // keywords and interned identifiers, but not unique atoms
+Atom intern_identifier(Atom_Table* table, String identifier);
+// Interns a batch of identifiers, with less locking than interning them one by one.
+void intern_identifiers(Atom_Table* table, Array<String> identifiers, Atom* out_atoms);
+// A new atom which no identifier will be interned to, even if it's spelled the same.
+Atom make_unique_atom(Atom_Table* table, String identifier);
+
+inline Atom intern_identifier(Compiler* ctx, String identifier)
+{
+    return intern_identifier(&ctx->atoms, identifier);
+}
+
+inline String get_identifier(Atom_Table* table, Atom atom)
+{
+    umm index = atom - ATOM_FIRST_IDENTIFIER;
+    if (index >= load(&table->count_identifiers))
+        return "<invalid identifier atom>"_s;
+    String* page = load(&table->pages[index / ATOM_TABLE_PAGE_SIZE]);
+    if (!page)
+        return "<invalid identifier atom>"_s;
+    return page[index % ATOM_TABLE_PAGE_SIZE];
+}
 
 inline Token_Info* get_token_info(Compiler* ctx, Token const* token)
 {
@@ -954,6 +1216,8 @@ inline Token_Info* get_token_info(Compiler* ctx, Token const* token)
     return &ctx->token_info_other[token->info_index];
 }
 
+Fraction const* get_number_value(Compiler* ctx, Token const* token);
+
 inline String get_source_token(Compiler* ctx, Token const* token)
 {
     Token_Info* info = get_token_info(ctx, token);
@@ -963,10 +1227,7 @@ inline String get_source_token(Compiler* ctx, Token const* token)
 
 inline String get_identifier(Compiler* ctx, Token const* token)
 {
-    umm atom = token->atom - ATOM_FIRST_IDENTIFIER;
-    if (atom >= ctx->identifiers.count)
-        return "<invalid identifier atom>"_s;
-    return ctx->identifiers[atom];
+    return get_identifier(&ctx->atoms, token->atom);
 }
 
 
@@ -974,12 +1235,50 @@ inline String get_identifier(Compiler* ctx, Token const* token)
 ////////////////////////////////////////////////////////////////////////////////
 // Parser
 
-Block* parse_top_level(Compiler* ctx, String canonical_name, String imports_relative_to_path, Array<Token> tokens);
+Block* parse_top_level(Compiler* ctx, String canonical_name, String imports_relative_to_path, Array<Token> tokens, Array<Token> comments);
 // `path` must be an absolute path.
 Block* parse_top_level_from_file(Compiler* ctx, String path);
 // Your responsibility that code (and all other strings that are passed as arguments) remains allocated as long as necessary!
 Block* parse_top_level_from_memory(Compiler* ctx, String imports_relative_to_directory, String name, String code);
 
+// Fills the parsed_kinds, parsed_flags and parsed_names columns from parsed_expressions.
+void build_parsed_columns(Region* memory, Block* block);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Module cache
+
+// Token infos which were produced by lexing a single module.
+struct Module_Cache_Token_Range
+{
+    u16 source_index;
+    u32 first_other,  end_other;
+    u32 first_number, end_number;
+    u32 first_string, end_string;
+};
+
+// Returns NULL if there is no valid cache entry for this exact path and code.
+Block* load_cached_module(Compiler* ctx, String path, String code);
+void   save_cached_module(Compiler* ctx, String path, String code, Block* top_level, Module_Cache_Token_Range const* range);
+
+// The position independent form of a module, which the cache files contain.
+// Returns an empty string if the module can't be serialized.
+String write_module_image(Compiler* ctx, Block* top_level, Module_Cache_Token_Range const* range, Region* memory);
+// Relocates the image in place, so it must stay allocated and writable for the rest of the process.
+Block* read_module_image(Compiler* ctx, String path, String code, String image);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Parallel front end
+
+// Lexes and parses 'path' and everything it imports on worker threads, then reads the result
+// for 'path'. Returns NULL if the file has to be lexed and parsed on the calling thread instead.
+Block* take_preparsed_module(Compiler* ctx, String path);
+// Waits for the preparse workers to exit and frees everything they left behind.
+void finish_preparse(Compiler* ctx);
+// Called by the parser on a worker thread instead of parsing the import.
+Block* defer_preparsed_import(Compiler* worker, String path);
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Inference
@@ -1033,18 +1332,19 @@ struct Numeric_Description
 
 bool get_numeric_description(Unit* unit, Numeric_Description* desc, Type type);
 
-Constant* get_constant(Block* block, Expression expr, Type type_assertion);
+Constant const* get_constant(Block* block, Expression expr, Type type_assertion);
 void set_constant(Compiler* ctx, Block* block, Expression expr, Type type_assertion, Constant* value);
+u64  intern_constant(Compiler* ctx, Type type, Constant* value);
 
 inline void set_constant_number(Compiler* ctx, Block* block, Expression expr, Fraction   value) { Constant c = {}; c.number  = value; set_constant(ctx, block, expr, TYPE_SOFT_NUMBER, &c); }
 inline void set_constant_bool  (Compiler* ctx, Block* block, Expression expr, bool       value) { Constant c = {}; c.boolean = value; set_constant(ctx, block, expr, TYPE_SOFT_BOOL,   &c); }
 inline void set_constant_type  (Compiler* ctx, Block* block, Expression expr, Type       value) { Constant c = {}; c.type    = value; set_constant(ctx, block, expr, TYPE_SOFT_TYPE,   &c); }
 inline void set_constant_block (Compiler* ctx, Block* block, Expression expr, Soft_Block value) { Constant c = {}; c.block   = value; set_constant(ctx, block, expr, TYPE_SOFT_BLOCK,  &c); }
 
-inline Fraction   const* get_constant_number(Block* block, Expression expr) { Constant* c = get_constant(block, expr, TYPE_SOFT_NUMBER); return c ? &c->number  : NULL; }
-inline bool       const* get_constant_bool  (Block* block, Expression expr) { Constant* c = get_constant(block, expr, TYPE_SOFT_BOOL);   return c ? &c->boolean : NULL; }
-inline Type       const* get_constant_type  (Block* block, Expression expr) { Constant* c = get_constant(block, expr, TYPE_SOFT_TYPE);   return c ? &c->type    : NULL; }
-inline Soft_Block const* get_constant_block (Block* block, Expression expr) { Constant* c = get_constant(block, expr, TYPE_SOFT_BLOCK);  return c ? &c->block   : NULL; }
+inline Fraction   const* get_constant_number(Block* block, Expression expr) { Constant const* c = get_constant(block, expr, TYPE_SOFT_NUMBER); return c ? &c->number  : NULL; }
+inline bool       const* get_constant_bool  (Block* block, Expression expr) { Constant const* c = get_constant(block, expr, TYPE_SOFT_BOOL);   return c ? &c->boolean : NULL; }
+inline Type       const* get_constant_type  (Block* block, Expression expr) { Constant const* c = get_constant(block, expr, TYPE_SOFT_TYPE);   return c ? &c->type    : NULL; }
+inline Soft_Block const* get_constant_block (Block* block, Expression expr) { Constant const* c = get_constant(block, expr, TYPE_SOFT_BLOCK);  return c ? &c->block   : NULL; }
 
 User_Type* get_user_type_data(Environment* env, Type type);
 
@@ -1055,8 +1355,80 @@ void confirm_unit_patched(Unit* unit);
 ////////////////////////////////////////////////////////////////////////////////
 // Bytecode
 
+// The generate functions only touch the unit, the finish functions are called on the pumping thread.
 void generate_bytecode_for_unit_placement(Unit* unit);
 void generate_bytecode_for_unit_completion(Unit* unit);
+void finish_bytecode_for_unit_placement(Unit* unit);
+void finish_bytecode_for_unit_completion(Unit* unit);
+
+u64 fold_constant_operation(Unit* unit, Expression_Kind kind, Type type, u64 lhs_bits, u64 rhs_bits);
+
+// ir.cpp
+struct Ir_Range
+{
+    u64 offset;
+    u64 size;
+};
+
+struct Ir_Operand
+{
+    char     field;  // 'r', 'a' or 'b' if the offset is that operand, 0 if it's implied by the operation
+    Ir_Range range;
+};
+
+enum: flags32
+{
+    IR_FALLS_THROUGH   = 0x0001,
+    IR_JUMPS           = 0x0002,  // to the instruction in r
+    IR_LEAVES          = 0x0004,  // returns, or finishes the unit
+    IR_READS_MEMORY    = 0x0008,  // through a pointer
+    IR_WRITES_MEMORY   = 0x0010,  // through a pointer
+    IR_CLOBBERS_ALL    = 0x0020,  // runs code the IR doesn't see, which might read and write anything
+    IR_HAS_SIDE_EFFECT = 0x0040,  // can't be removed, even if nothing reads what it writes
+};
+
+struct Ir_Effects
+{
+    flags32    flags;
+    umm        read_count;
+    Ir_Operand reads[3];
+    bool       writes;
+    Ir_Operand write;
+};
+
+void       optimize_bytecode(Unit* unit);  // see :BytecodeIr
+Ir_Effects get_bytecode_effects(Unit* unit, Bytecode const* bc);
+umm        find_storage_range(Array<Storage_Range const> ranges, u64 offset);  // index of the first range which ends after the offset, the ranges are sorted
+
+// disasm.cpp
+String get_operation_name(Bytecode_Operation op);
+void   dump_bytecode(Unit* unit);  // see :DumpBytecode
+void   print_bytecode_summary(Compiler* ctx);
+
+// codegen.cpp
+void generate_bytecode_for_units(Compiler* ctx, Array<Unit*> units, void(*generate)(Unit*));  // see :ParallelCodegen
+void finish_codegen(Compiler* ctx);  // joins the codegen workers and frees the pool
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Bytecode images
+
+// Looks up the parameters and returns of an intrinsic ahead of time, the same way run_intrinsic does.
+void bind_intrinsic(Unit* unit, Block* block, Dynamic_Array<Intrinsic_Field>* out_fields);
+// Saves the units recorded in run_units, and every unit they refer to, see :BytecodeImage.
+bool save_bytecode_image(Compiler* ctx, String path);
+// Runs the units saved in the image, in the order they were recorded.
+bool run_bytecode_image(String path);
+// Copies of a saved image, each with one thing broken which run_bytecode_image has to reject.
+// Used by the test runner, see :CompareCompiledTests.
+Dynamic_Array<String> make_broken_bytecode_images(String image);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Native backend
+
+// Translates the same units as save_bytecode_image to x86-64, and writes a static Linux executable, see :NativeBackend.
+bool save_elf_executable(Compiler* ctx, String path);
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1068,6 +1440,9 @@ void         delete_user(struct User* user);
 byte* user_alloc(struct User* user, umm size, umm alignment);
 void  user_free (struct User* user, void* base);
 
+// Zero filled, and never freed. Large allocations are fresh pages, which aren't touched until used.
+byte* user_alloc_zeroed(struct User* user, umm size, umm alignment);
+
 // In lockdown, the calling thread + user threads are the only running threads in the process,
 // and all memory not allocated by the provided user is read-only.
 void enter_lockdown(struct User* user);
@@ -1082,6 +1457,24 @@ void set_most_recent_execution_location(struct User* user, Unit* unit, Bytecode
 void run_bytecode(User* user, Bytecode_Continuation continue_from);
 
 
+////////////////////////////////////////////////////////////////////////////////
+// Watch mode
+
+// Runs the file, and runs it again whenever it or its imports change, see :WatchMode.
+// Doesn't return, the process has to be killed.
+void watch_file(Compiler* ctx, String path);
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Compile server
+
+// An empty socket_path means the default socket of the current user, see :CompileServer.
+// Serves until the process is killed, returns only if it couldn't start.
+int serve_compile_requests(Compiler* ctx, String socket_path);
+// Runs the file on the server with this process' stdin, stdout and stderr, returns its exit status.
+int run_on_compile_server(String socket_path, String path);
+
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // Reporting
@@ -0,0 +1,290 @@
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+
+EnterApplicationNamespace
+
+
+// :AtomTable
+// Identifiers are interned by a table which any number of threads can use at once. It is split
+// into shards by hash, and each shard is a small open-addressed table behind its own lock, so
+// threads only wait for each other when their identifiers happen to land in the same shard.
+// Atoms are handed out by an atomic counter, and an atom never changes once it's handed out.
+//
+// Identifier strings live in pages which are allocated on first use and never move, so atoms
+// can be turned back into identifiers without taking any lock.
+//
+// Keywords aren't in the shards at all. They are looked up in a table built at compile time,
+// before an identifier is even hashed.
+
+
+struct Keyword
+{
+    char const* name;
+    umm         length;
+    Atom        atom;
+};
+
+#define K(atom, name) { name, sizeof(name) - 1, atom }
+static constexpr Keyword keywords[] =
+{
+    K(ATOM_ZERO,         "zero"),
+    K(ATOM_TRUE,         "true"),
+    K(ATOM_FALSE,        "false"),
+    K(ATOM_VOID,         "void"),
+    K(ATOM_U8,           "u8"),
+    K(ATOM_U16,          "u16"),
+    K(ATOM_U32,          "u32"),
+    K(ATOM_U64,          "u64"),
+    K(ATOM_UMM,          "umm"),
+    K(ATOM_S8,           "s8"),
+    K(ATOM_S16,          "s16"),
+    K(ATOM_S32,          "s32"),
+    K(ATOM_S64,          "s64"),
+    K(ATOM_SMM,          "smm"),
+    K(ATOM_F16,          "f16"),
+    K(ATOM_F32,          "f32"),
+    K(ATOM_F64,          "f64"),
+    K(ATOM_BOOL,         "bool"),
+    K(ATOM_STRUCT,       "struct"),
+    K(ATOM_STRING,       "string"),
+    K(ATOM_IMPORT,       "import"),
+    K(ATOM_USING,        "using"),
+    K(ATOM_TYPE,         "type"),
+    K(ATOM_BLOCK,        "block"),
+    K(ATOM_CODE_BLOCK,   "code_block"),
+    K(ATOM_GLOBAL,       "global"),
+    K(ATOM_THREAD_LOCAL, "thread_local"),
+    K(ATOM_UNIT,         "unit"),
+    K(ATOM_UNIT_LOCAL,   "unit_local"),
+    K(ATOM_UNIT_DATA,    "unit_data"),
+    K(ATOM_UNIT_CODE,    "unit_code"),
+    K(ATOM_LABEL,        "label"),
+    K(ATOM_GOTO,         "goto"),
+    K(ATOM_DEBUG,        "debug"),
+    K(ATOM_DEBUG_ALLOC,  "debug_alloc"),
+    K(ATOM_DEBUG_FREE,   "debug_free"),
+    K(ATOM_DELETE,       "delete"),
+    K(ATOM_IF,           "if"),
+    K(ATOM_ELSE,         "else"),
+    K(ATOM_ELIF,         "elif"),
+    K(ATOM_WHILE,        "while"),
+    K(ATOM_DO,           "do"),
+    K(ATOM_RUN,          "run"),
+    K(ATOM_RETURN,       "return"),
+    K(ATOM_YIELD,        "yield"),
+    K(ATOM_DEFER,        "defer"),
+    K(ATOM_CAST,         "cast"),
+    K(ATOM_SIZEOF,       "sizeof"),
+    K(ATOM_ALIGNOF,      "alignof"),
+    K(ATOM_CODEOF,       "codeof"),
+    K(ATOM_INTRINSIC,    "intrinsic"),
+};
+#undef K
+
+// Keywords are told apart well enough by their length and first and last characters.
+static constexpr umm KEYWORD_SLOTS = 256;
+CompileTimeAssert(ArrayCount(keywords) * 4 <= KEYWORD_SLOTS);
+
+static constexpr umm keyword_slot(umm length, u8 first, u8 last)
+{
+    return (length * 37 + first * 5 + last) & (KEYWORD_SLOTS - 1);
+}
+
+struct Keyword_Table
+{
+    u8 slots[KEYWORD_SLOTS];  // index into keywords plus one, zero if the slot is empty
+};
+
+static constexpr Keyword_Table make_keyword_table()
+{
+    Keyword_Table table = {};
+    for (umm i = 0; i < ArrayCount(keywords); i++)
+    {
+        Keyword const& keyword = keywords[i];
+        umm slot = keyword_slot(keyword.length, keyword.name[0], keyword.name[keyword.length - 1]);
+        while (table.slots[slot])
+            slot = (slot + 1) & (KEYWORD_SLOTS - 1);
+        table.slots[slot] = (u8)(i + 1);
+    }
+    return table;
+}
+
+static constexpr Keyword_Table keyword_table = make_keyword_table();
+
+static Atom find_keyword(String identifier)
+{
+    if (!identifier.length) return ATOM_INVALID;
+    umm slot = keyword_slot(identifier.length, identifier.data[0], identifier.data[identifier.length - 1]);
+    while (u8 index = keyword_table.slots[slot])
+    {
+        Keyword const* keyword = &keywords[index - 1];
+        if (keyword->length == identifier.length && memcmp(keyword->name, identifier.data, keyword->length) == 0)
+            return keyword->atom;
+        slot = (slot + 1) & (KEYWORD_SLOTS - 1);
+    }
+    return ATOM_INVALID;
+}
+
+
+static u32 hash_identifier(String identifier)
+{
+    return (u32) hash_u64(hash_string(identifier));
+}
+
+static Atom_Table_Shard* get_shard(Atom_Table* table, u32 hash)
+{
+    return &table->shards[hash >> (32 - ATOM_TABLE_SHARD_BITS)];
+}
+
+static Atom new_atom(Atom_Table* table, String identifier)
+{
+    umm index = increment_and_return_previous(&table->count_identifiers);
+    assert(index < ATOM_TABLE_MAX_PAGES * ATOM_TABLE_PAGE_SIZE);
+
+    Atomic_Pointer<String>* page_pointer = &table->pages[index / ATOM_TABLE_PAGE_SIZE];
+    String* page = load(page_pointer);
+    if (!page)
+    {
+        String* new_page = alloc<String>(NULL, ATOM_TABLE_PAGE_SIZE);
+        page = compare_exchange_and_return_previous(page_pointer, (String*) NULL, new_page);
+        if (page) free(new_page);
+        else      page = new_page;
+    }
+
+    page[index % ATOM_TABLE_PAGE_SIZE] = identifier;
+    return (Atom)(ATOM_FIRST_IDENTIFIER + index);
+}
+
+// Must be called with the shard lock held.
+static void grow_shard(Atom_Table_Shard* shard)
+{
+    u32 old_capacity = shard->capacity;
+    Atom_Table_Slot* old_slots = shard->slots;
+
+    shard->capacity = old_capacity ? old_capacity * 2 : 64;
+    shard->slots    = alloc<Atom_Table_Slot>(NULL, shard->capacity);
+
+    u32 mask = shard->capacity - 1;
+    for (u32 i = 0; i < old_capacity; i++)
+    {
+        Atom_Table_Slot* old_slot = &old_slots[i];
+        if (!old_slot->atom) continue;
+        u32 slot = old_slot->hash & mask;
+        while (shard->slots[slot].atom)
+            slot = (slot + 1) & mask;
+        shard->slots[slot] = *old_slot;
+    }
+    free(old_slots);
+}
+
+// Must be called with the shard lock held.
+static Atom intern_in_shard(Atom_Table* table, Atom_Table_Shard* shard, String identifier, u32 hash)
+{
+    if (shard->count * 2 >= shard->capacity)
+        grow_shard(shard);
+
+    u32 mask = shard->capacity - 1;
+    for (u32 i = hash & mask;; i = (i + 1) & mask)
+    {
+        Atom_Table_Slot* slot = &shard->slots[i];
+        if (!slot->atom)
+        {
+            slot->hash = hash;
+            slot->atom = new_atom(table, identifier);
+            shard->count++;
+            return slot->atom;
+        }
+        if (slot->hash == hash && get_identifier(table, slot->atom) == identifier)
+            return slot->atom;
+    }
+}
+
+
+void make_atom_table(Atom_Table* table)
+{
+    for (umm i = 0; i < ATOM_TABLE_SHARDS; i++)
+        make_lock(&table->shards[i].lock);
+}
+
+void free_atom_table(Atom_Table* table)
+{
+    for (umm i = 0; i < ATOM_TABLE_SHARDS; i++)
+    {
+        free_lock(&table->shards[i].lock);
+        free(table->shards[i].slots);
+    }
+    for (umm i = 0; i < ATOM_TABLE_MAX_PAGES; i++)
+        free(table->pages[i].v);
+    ZeroStruct(table);
+}
+
+umm count_atoms(Atom_Table* table)
+{
+    umm count = ArrayCount(keywords);
+    for (umm i = 0; i < ATOM_TABLE_SHARDS; i++)
+    {
+        LockedScope(&table->shards[i].lock);
+        count += table->shards[i].count;
+    }
+    return count;
+}
+
+Atom intern_identifier(Atom_Table* table, String identifier)
+{
+    if (Atom keyword = find_keyword(identifier))
+        return keyword;
+
+    u32 hash = hash_identifier(identifier);
+    Atom_Table_Shard* shard = get_shard(table, hash);
+    LockedScope(&shard->lock);
+    return intern_in_shard(table, shard, identifier, hash);
+}
+
+void intern_identifiers(Atom_Table* table, Array<String> identifiers, Atom* out_atoms)
+{
+    // Identifiers are bucketed by shard first, so each shard is only locked once.
+    u32* hashes = alloc<u32, false>(temp, identifiers.count);
+    u32* order  = alloc<u32, false>(temp, identifiers.count);
+    u32 shard_end[ATOM_TABLE_SHARDS] = {};
+    for (umm i = 0; i < identifiers.count; i++)
+    {
+        out_atoms[i] = find_keyword(identifiers[i]);
+        if (out_atoms[i]) continue;
+        hashes[i] = hash_identifier(identifiers[i]);
+        shard_end[hashes[i] >> (32 - ATOM_TABLE_SHARD_BITS)]++;
+    }
+
+    u32 total = 0;
+    for (umm i = 0; i < ATOM_TABLE_SHARDS; i++)
+    {
+        total += shard_end[i];
+        shard_end[i] = total;
+    }
+
+    // Filled back to front, so the identifiers keep their order within a shard.
+    for (umm i = identifiers.count; i--;)
+        if (!out_atoms[i])
+            order[--shard_end[hashes[i] >> (32 - ATOM_TABLE_SHARD_BITS)]] = i;
+
+    for (u32 i = 0; i < total;)
+    {
+        Atom_Table_Shard* shard = get_shard(table, hashes[order[i]]);
+        LockedScope(&shard->lock);
+        do
+        {
+            u32 index = order[i++];
+            out_atoms[index] = intern_in_shard(table, shard, identifiers[index], hashes[index]);
+        }
+        while (i < total && get_shard(table, hashes[order[i]]) == shard);
+    }
+}
+
+Atom make_unique_atom(Atom_Table* table, String identifier)
+{
+    return new_atom(table, identifier);
+}
+
+
+ExitApplicationNamespace
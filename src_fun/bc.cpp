@@ -33,9 +33,9 @@ static void place_variables(Unit* unit, Block* block)
 
     for (umm i = 0; i < block->inferred_expressions.count; i++)
     {
-        auto* expr  = &block->parsed_expressions  [i];
         auto* infer = &block->inferred_expressions[i];
-        if (expr->kind != EXPRESSION_DECLARATION) continue;
+        if (block->parsed_kinds[i] != EXPRESSION_DECLARATION) continue;
+        if (infer->flags & INFERRED_EXPRESSION_IS_LAZY) continue;  // aliases, maybe not inferred yet :LazyImports
         assert(infer->type != INVALID_TYPE);
         if (is_soft_type(infer->type)) continue;
 
@@ -59,6 +59,19 @@ struct Bytecode_Builder
     Expression                   expression;
     Concatenator<Bytecode>       bytecode;
     Concatenator<Bytecode_Patch> patches;
+
+    // :RetargetTemporaryResult
+    Bytecode* temporary_result_op;
+    umm       temporary_result_end;
+
+    // :InlineSmallBlocks
+    struct Inlined_Block* inlined_block;  // innermost block being inlined, NULL if none
+
+    // :LoopInvariantCodeMotion
+    struct Loop_Invariants* loop;  // innermost loop being generated, NULL if none
+
+    // :BytecodeIr
+    Dynamic_Array<Storage_Range> temporary_storage;
 };
 
 #define Label() (builder->bytecode.count)
@@ -85,12 +98,35 @@ static Location void_location(Type type_assertion)
     return Location(0, TYPE_VOID, false);
 }
 
+// Storage for intermediate values. Unless an OP_ADDRESS takes its address, only instructions
+// which name it directly read and write it, so the IR may remove writes to it, see :BytecodeIr
+static u64 allocate_temporary_storage(Bytecode_Builder* builder, u64 size, u64 alignment)
+{
+    Storage_Range range = { allocate_storage(builder->unit, size, alignment), size };
+    add_item(&builder->temporary_storage, &range);
+    return range.offset;
+}
+
+static u64 allocate_temporary_storage(Bytecode_Builder* builder, Type type)
+{
+    Unit* unit = builder->unit;
+    return allocate_temporary_storage(builder, get_type_size(unit, type), get_type_alignment(unit, type));
+}
+
 static Location allocate_location(Bytecode_Builder* builder, Type type)
 {
-    u64 offset = allocate_storage(builder->unit, type);
+    u64 offset = allocate_temporary_storage(builder, type);
     return Location(offset, type, false);
 }
 
+// For the address of a value of the given type.
+static Location allocate_indirect_location(Bytecode_Builder* builder, Type type)
+{
+    Environment* env = builder->unit->env;
+    u64 offset = allocate_temporary_storage(builder, env->pointer_size, env->pointer_alignment);
+    return Location(offset, type, true);
+}
+
 static void zero(Bytecode_Builder* builder, Location what)
 {
     Op(what.indirect ? OP_ZERO_INDIRECT : OP_ZERO, r = what.offset, s = get_type_size(builder->unit, what.type));
@@ -118,6 +154,52 @@ static Location direct(Bytecode_Builder* builder, Location location)
     return result;
 }
 
+// :RetargetTemporaryResult
+// An instruction which computes a value into a new temporary location is remembered, and if the
+// value is then just stored somewhere, the instruction writes there instead, and there is no copy.
+// So i = i + 1 is a single instruction. All instructions read their operands before they write r.
+static Location temporary_result(Bytecode_Builder* builder, Bytecode* op, Location result)
+{
+    assert(op->r == result.offset && !result.indirect);
+    builder->temporary_result_op  = op;
+    builder->temporary_result_end = Label();
+    return result;
+}
+
+static void store(Bytecode_Builder* builder, Location to, Location from)
+{
+    Bytecode* op = builder->temporary_result_op;
+    builder->temporary_result_op = NULL;  // the same temporary can't be stored twice
+
+    if (op && builder->temporary_result_end == Label() && !to.indirect && !from.indirect && op->r == from.offset)
+    {
+        assert(to.type == from.type);
+        op->r = to.offset;
+    }
+    else copy(builder, to, from);
+}
+
+// :ImmediateOperands
+// Hardened constants and casts of soft values don't need storage when they are operands of
+// arithmetic, comparisons and pointer moves. Their value is patched into b of the instruction,
+// just like it would be patched into the literal at :PatchHardenedConstantPlaceholder.
+// If both operands are constant, the whole operation is folded at patch time instead.
+static bool is_constant_operand(Block* block, Expression id)
+{
+    if (block->inferred_expressions[id].flags & INFERRED_EXPRESSION_IS_HARDENED_CONSTANT)
+        return true;
+    auto* expr = &block->parsed_expressions[id];
+    return expr->kind == EXPRESSION_CAST && is_soft_type(block->inferred_expressions[expr->binary.rhs].type);
+}
+
+static Type get_constant_operand_type(Block* block, Expression id)
+{
+    auto* infer = &block->inferred_expressions[id];
+    if (infer->flags & INFERRED_EXPRESSION_IS_HARDENED_CONSTANT)
+        return infer->hardened_type;
+    return infer->type;
+}
+
 static Type simplify_type(Unit* unit, Type type)
 {
     if (type == TYPE_TYPE)
@@ -179,6 +261,352 @@ static Type simplify_type_uf(Unit* unit, Type type)
     return type;
 }
 
+static u64 get_return_address_offset(Bytecode_Builder* builder, Block* block)
+{
+    // Allocated on first use, an inlined block might need it before it's generated.
+    if (!block->return_address_offset)
+        block->return_address_offset = allocate_storage(builder->unit, BLOCK_RETURN_ADDRESS_SIZE, sizeof(void*));
+    return block->return_address_offset;
+}
+
+static Block* get_yield_target(Block* block)
+{
+    Block* yield_from = block;
+    while (!(yield_from->flags & (BLOCK_IS_PARAMETER_BLOCK | BLOCK_IS_UNIT)) &&
+           yield_from->parent_scope &&
+           yield_from->parent_scope_visibility_limit != NO_VISIBILITY)
+        yield_from = yield_from->parent_scope;
+    return yield_from;
+}
+
+// :InlineSmallBlocks
+// Calls of small blocks are replaced by the callee's statements, generated right in the caller.
+// Arguments are still copied into the callee's parameters, since every materialized block has
+// its own storage anyway, and the callee's storage is renamed away from the caller's already.
+// A yield in the inlined statements becomes a goto to the end of them. Child blocks of the
+// inlined block might not be inlined themselves, and those still yield through the return
+// address, so it's set to the end of the inlined statements if any of them yields.
+//
+// Branch and loop bodies are called child blocks too, so most of them are inlined this way.
+// The callee is still generated on its own as well, even if all calls to it were inlined, but
+// the IR removes that code if it's never run, see :BytecodeIr
+static constexpr umm INLINE_MAX_EXPRESSIONS = 32;
+static constexpr umm INLINE_MAX_DEPTH       = 4;
+
+struct Inlined_Block
+{
+    Inlined_Block*           outer;
+    Block*                   caller;
+    Block*                   block;
+    Dynamic_Array<Bytecode*> yields;  // gotos to the end of the inlined statements
+};
+
+// Whether a yield in a child block of 'block' (or deeper) yields from 'target'.
+static bool is_yielded_from_child_block(Block* target, Block* block)
+{
+    for (umm i = 0; i < block->inferred_expressions.count; i++)
+    {
+        if (block != target && block->parsed_kinds[i] == EXPRESSION_YIELD && get_yield_target(block) == target)
+            return true;
+
+        Block* child = block->inferred_expressions[i].called_block;
+        if (child && child->parent_scope == block && get_yield_target(child) != child &&
+            is_yielded_from_child_block(target, child))
+            return true;
+    }
+    return false;
+}
+
+static bool should_inline(Bytecode_Builder* builder, Block* callee)
+{
+    if (callee->parsed_expressions.count > INLINE_MAX_EXPRESSIONS) return false;
+    if (callee == builder->block) return false;
+
+    umm depth = 0;
+    for (Inlined_Block* inlined = builder->inlined_block; inlined; inlined = inlined->outer, depth++)
+        if (inlined->block == callee || inlined->caller == callee)
+            return false;  // recursive
+    if (depth >= INLINE_MAX_DEPTH) return false;
+    return true;
+}
+
+// :LoopInvariantCodeMotion
+// Before a loop is generated, everything that might run in it (its condition and body, and all
+// blocks called from them) is scanned for what it writes. Names of declarations which aren't
+// written there don't change while the loop runs, and neither do arithmetic, comparisons and
+// casts of them and of constants. Such expressions are computed once into unit storage, in a
+// preheader which runs before the first iteration, and the loop just reads the result.
+//
+// Writes through pointers (including members of pointers and used names), intrinsics and unit
+// switches might change any declaration, so then names are never invariant, only constants.
+// Dereferences are never invariant, and neither is division, because the preheader runs even
+// if the expression never would, and it might trap.
+//
+// What's hoisted is only known once the loop is generated, so the preheader is generated after
+// the loop, with a goto to it before the loop and a goto back at its end.
+struct Hoisted_Expression
+{
+    Block*     block;
+    Expression id;
+    u64        offset;
+};
+
+struct Loop_Invariants
+{
+    Loop_Invariants* outer;
+    bool             has_unknown_writes;
+
+    // Keys combine the block pointer with the declaration. A collision only means a declaration
+    // is treated as written, which is safe.
+    Table(u64, bool, hash_u64) written_declarations;
+    Table(u64, bool, hash_u64) scanned_blocks;
+
+    Dynamic_Array<Hoisted_Expression> hoisted;
+};
+
+static u64 get_declaration_key(Block* scope, Expression declaration)
+{
+    return (u64)(umm) scope ^ ((u64) declaration << 48);
+}
+
+static void note_assignment(Loop_Invariants* loop, Block* block, Expression lhs)
+{
+    while (true)
+    {
+        auto* expr = &block->parsed_expressions[lhs];
+        if (expr->kind != EXPRESSION_NAME && expr->kind != EXPRESSION_MEMBER) break;
+
+        Resolved_Name resolved = get(&block->resolved_names, &lhs);
+        if (!resolved.scope || resolved.use_chain.count) break;
+        if (expr->kind == EXPRESSION_NAME)
+        {
+            u64 key = get_declaration_key(resolved.scope, resolved.declaration);
+            bool yes = true;
+            set(&loop->written_declarations, &key, &yes);
+            return;
+        }
+
+        lhs = expr->unary_operand;
+        if (is_pointer_type(block->inferred_expressions[lhs].type)) break;
+    }
+    loop->has_unknown_writes = true;  // through a pointer, or something else that isn't a name
+}
+
+static void scan_loop_block(Loop_Invariants* loop, Block* block);
+
+// Notes what a single expression writes, not counting its operands.
+static void scan_loop_effects(Loop_Invariants* loop, Block* block, Expression id)
+{
+    auto* expr = &block->parsed_expressions[id];
+    switch (expr->kind)
+    {
+    case EXPRESSION_ASSIGNMENT:
+        note_assignment(loop, block, expr->binary.lhs);
+        break;
+    case EXPRESSION_DECLARATION:
+    {
+        u64 key = get_declaration_key(block, id);
+        bool yes = true;
+        set(&loop->written_declarations, &key, &yes);
+    } break;
+    case EXPRESSION_INTRINSIC:
+    case EXPRESSION_GOTO_UNIT:
+    case EXPRESSION_DEBUG_ALLOC:
+    case EXPRESSION_DEBUG_FREE:
+        loop->has_unknown_writes = true;
+        break;
+    default: break;
+    }
+
+    if (Block* callee = block->inferred_expressions[id].called_block)
+        scan_loop_block(loop, callee);
+}
+
+// Everything in a called block might run in the loop.
+static void scan_loop_block(Loop_Invariants* loop, Block* block)
+{
+    u64 key = (u64)(umm) block;
+    if (get(&loop->scanned_blocks, &key)) return;
+    bool yes = true;
+    set(&loop->scanned_blocks, &key, &yes);
+
+    for (umm i = 0; i < block->parsed_expressions.count; i++)
+        scan_loop_effects(loop, block, (Expression) i);
+}
+
+// Only the loop expression itself runs in the loop, not the rest of the block it's in.
+static void scan_loop_expression(Loop_Invariants* loop, Block* block, Expression id)
+{
+    if (id == NO_EXPRESSION) return;
+    scan_loop_effects(loop, block, id);
+
+    auto* expr = &block->parsed_expressions[id];
+    switch (expr->kind)
+    {
+    case EXPRESSION_MEMBER:
+    case EXPRESSION_NOT:
+    case EXPRESSION_NEGATE:
+    case EXPRESSION_ADDRESS:
+    case EXPRESSION_DEREFERENCE:
+    case EXPRESSION_DEBUG:
+        scan_loop_expression(loop, block, expr->unary_operand);
+        break;
+    case EXPRESSION_ASSIGNMENT:
+    case EXPRESSION_ADD:
+    case EXPRESSION_SUBTRACT:
+    case EXPRESSION_MULTIPLY:
+    case EXPRESSION_DIVIDE_WHOLE:
+    case EXPRESSION_DIVIDE_FRACTIONAL:
+    case EXPRESSION_POINTER_ADD:
+    case EXPRESSION_POINTER_SUBTRACT:
+    case EXPRESSION_EQUAL:
+    case EXPRESSION_NOT_EQUAL:
+    case EXPRESSION_GREATER_THAN:
+    case EXPRESSION_GREATER_OR_EQUAL:
+    case EXPRESSION_LESS_THAN:
+    case EXPRESSION_LESS_OR_EQUAL:
+    case EXPRESSION_AND:
+    case EXPRESSION_OR:
+    case EXPRESSION_CAST:
+    case EXPRESSION_GOTO_UNIT:
+        scan_loop_expression(loop, block, expr->binary.lhs);
+        scan_loop_expression(loop, block, expr->binary.rhs);
+        break;
+    case EXPRESSION_BRANCH:
+        scan_loop_expression(loop, block, expr->branch.condition);
+        scan_loop_expression(loop, block, expr->branch.on_success);
+        scan_loop_expression(loop, block, expr->branch.on_failure);
+        break;
+    case EXPRESSION_CALL:
+        for (umm i = 0; i < expr->call.arguments->count; i++)
+            scan_loop_expression(loop, block, expr->call.arguments->expressions[i]);
+        break;
+    case EXPRESSION_YIELD:
+        for (umm i = 0; i < expr->yield_assignments->count; i++)
+            scan_loop_expression(loop, block, expr->yield_assignments->expressions[i]);
+        break;
+    case EXPRESSION_DECLARATION:
+        scan_loop_expression(loop, block, expr->declaration.value);
+        break;
+    default: break;
+    }
+}
+
+static bool is_loop_invariant(Loop_Invariants* loop, Block* block, Expression id)
+{
+    auto* expr  = &block->parsed_expressions  [id];
+    auto* infer = &block->inferred_expressions[id];
+    if (is_constant_operand(block, id)) return true;
+    if (infer->flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME) return false;
+
+    switch (expr->kind)
+    {
+    case EXPRESSION_NAME:
+    case EXPRESSION_MEMBER:
+    {
+        if (loop->has_unknown_writes) return false;
+        Resolved_Name resolved = get(&block->resolved_names, &id);
+        if (!resolved.scope || resolved.use_chain.count) return false;
+        if (expr->kind == EXPRESSION_MEMBER)
+        {
+            if (is_pointer_type(block->inferred_expressions[expr->unary_operand].type)) return false;
+            return is_loop_invariant(loop, block, expr->unary_operand);
+        }
+
+        u64 offset;
+        if (!get(&resolved.scope->declaration_placement, &resolved.declaration, &offset)) return false;
+        u64 key = get_declaration_key(resolved.scope, resolved.declaration);
+        return !get(&loop->written_declarations, &key);
+    }
+    case EXPRESSION_NOT:
+    case EXPRESSION_NEGATE:
+        return is_loop_invariant(loop, block, expr->unary_operand);
+    case EXPRESSION_CAST:
+        return is_loop_invariant(loop, block, expr->binary.rhs);
+    case EXPRESSION_ADD:
+    case EXPRESSION_SUBTRACT:
+    case EXPRESSION_MULTIPLY:
+    case EXPRESSION_POINTER_ADD:
+    case EXPRESSION_EQUAL:
+    case EXPRESSION_NOT_EQUAL:
+    case EXPRESSION_GREATER_THAN:
+    case EXPRESSION_GREATER_OR_EQUAL:
+    case EXPRESSION_LESS_THAN:
+    case EXPRESSION_LESS_OR_EQUAL:
+        return is_loop_invariant(loop, block, expr->binary.lhs) &&
+               is_loop_invariant(loop, block, expr->binary.rhs);
+    default:
+        return false;
+    }
+}
+
+// Names and constants are just as cheap to read in the loop, only computations are hoisted.
+static bool should_hoist(Loop_Invariants* loop, Block* block, Expression id)
+{
+    Expression_Kind kind = block->parsed_kinds[id];
+    if (kind == EXPRESSION_NAME || kind == EXPRESSION_MEMBER || is_constant_operand(block, id)) return false;
+    return is_loop_invariant(loop, block, id);
+}
+
+static Location hoist(Bytecode_Builder* builder, Block* block, Expression id)
+{
+    Loop_Invariants* loop = builder->loop;
+    Type type = block->inferred_expressions[id].type;
+
+    For (loop->hoisted)
+        if (it->block == block && it->id == id)
+            return Location(it->offset, type, false);
+
+    Hoisted_Expression hoisted = { block, id, allocate_temporary_storage(builder, type) };
+    add_item(&loop->hoisted, &hoisted);
+    builder->unit->count_hoisted_expressions++;
+    return Location(hoisted.offset, type, false);
+}
+
+static Location generate_expression(Bytecode_Builder* builder, Expression id);
+
+// Generates a loop with generate_body, hoisting what's invariant in it into a preheader.
+template <typename Generate_Body>
+static void generate_loop(Bytecode_Builder* builder, Expression id, Generate_Body&& generate_body)
+{
+    Block* block = builder->block;
+
+    Loop_Invariants loop = {};
+    loop.outer = builder->loop;
+    scan_loop_expression(&loop, block, id);
+    Defer(free_table(&loop.written_declarations));
+    Defer(free_table(&loop.scanned_blocks));
+    Defer(free_heap_array(&loop.hoisted));
+
+    Bytecode* goto_preheader = Op(OP_GOTO);
+    u64 loop_label = Label();
+
+    builder->loop = &loop;
+    generate_body(loop_label);
+    builder->loop = loop.outer;
+
+    if (!loop.hoisted.count)
+    {
+        goto_preheader->r = loop_label;
+        return;
+    }
+
+    Bytecode* goto_end = Op(OP_GOTO);
+    goto_preheader->r = Label();
+
+    For (loop.hoisted)
+    {
+        // The preheader might be hoisted further, into the preheader of an outer loop.
+        builder->block = it->block;
+        Location value = generate_expression(builder, it->id);
+        store(builder, Location(it->offset, value.type, false), value);
+    }
+    builder->block = block;
+
+    Op(OP_GOTO, r = loop_label);
+    goto_end->r = Label();
+}
+
 static Location generate_expression(Bytecode_Builder* builder, Expression id)
 {
     Unit*     unit  = builder->unit;
@@ -202,12 +630,15 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         Location literal = allocate_location(builder, infer->hardened_type);
         // :PatchHardenedConstantPlaceholder
         *reserve_item(&builder->patches) = { block, id, Label() };
-        Op(OP_LITERAL, r = literal.offset, s = get_type_size(unit, literal.type));
-        return literal;
+        return temporary_result(builder, Op(OP_LITERAL, r = literal.offset, s = get_type_size(unit, literal.type)), literal);
     }
 
     assert(!(infer->flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME));
 
+    // :LoopInvariantCodeMotion
+    if (builder->loop && should_hoist(builder->loop, block, id))
+        return hoist(builder, block, id);
+
     auto apply_use = [&](Location lhs, Resolved_Name::Use use) -> Location
     {
         Type unit_type = lhs.type;
@@ -222,7 +653,7 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         auto* decl_infer = &use.scope->inferred_expressions[use.declaration];
         if (is_pointer_type(lhs.type) || lhs.indirect)
         {
-            Location result(allocate_storage(unit, env->pointer_size, env->pointer_alignment), decl_infer->type, true);
+            Location result = allocate_indirect_location(builder, decl_infer->type);
 
             // :PatchDeclarationPlaceholder
             *reserve_item(&builder->patches) = { use.scope, use.declaration, Label() };
@@ -235,7 +666,7 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
             if (get(&use.scope->declaration_placement, &use.declaration, &offset))
                 return Location(lhs.offset + offset, decl_infer->type, false);
 
-            Location result(allocate_storage(unit, env->pointer_size, env->pointer_alignment), decl_infer->type, true);
+            Location result = allocate_indirect_location(builder, decl_infer->type);
 
             // :PatchDeclarationPlaceholder
             *reserve_item(&builder->patches) = { use.scope, use.declaration, Label() };
@@ -265,7 +696,8 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         assert(get_type_size(unit, TYPE_STRING) == sizeof(String));
         Location result = allocate_location(builder, TYPE_STRING);
         Op(OP_LITERAL, r = result.offset + MemberOffset(String, length), a = (umm) token->value.length, s = MemberSize(String, length));
-        Op(OP_LITERAL, r = result.offset + MemberOffset(String, data  ), a = (umm) token->value.data,   s = MemberSize(String, data  ));
+        Op(OP_LITERAL, flags = OP_A_IS_DATA, r = result.offset + MemberOffset(String, data), a = (umm) token->value.data,
+                       b = token->value.length, s = MemberSize(String, data));
         return result;
     } break;
 
@@ -295,16 +727,14 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
     {
         Location operand = direct(builder, generate_expression(builder, expr->unary_operand));
         Location result = allocate_location(builder, infer->type);
-        Op(OP_NOT, r = result.offset, a = operand.offset);
-        return result;
+        return temporary_result(builder, Op(OP_NOT, r = result.offset, a = operand.offset), result);
     } break;
 
     case EXPRESSION_NEGATE:
     {
         Location operand = direct(builder, generate_expression(builder, expr->unary_operand));
         Location result = allocate_location(builder, infer->type);
-        Op(OP_NEGATE, r = result.offset, a = operand.offset, s = simplify_type_sf(unit, operand.type));
-        return result;
+        return temporary_result(builder, Op(OP_NEGATE, r = result.offset, a = operand.offset, s = simplify_type_sf(unit, operand.type)), result);
     } break;
 
     case EXPRESSION_ADDRESS:
@@ -328,7 +758,7 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         assert(get_type_size(unit, infer->type) == sizeof(Unit*));
         Location location = allocate_location(builder, infer->type);
         *reserve_item(&builder->patches) = { block, id, Label() };
-        Op(OP_LITERAL, r = location.offset, s = sizeof(Unit*));  // :PatchCodeofPlaceholder
+        Op(OP_LITERAL, flags = OP_A_IS_UNIT, r = location.offset, s = sizeof(Unit*));  // :PatchCodeofPlaceholder
         return location;
     } break;
 
@@ -342,7 +772,7 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
 
             *reserve_item(&builder->patches) = { block, id, Label() };
             Op(OP_LITERAL, r = value.offset + MemberOffset(String, length), s = MemberSize(String, length));  // :PatchDebugPlaceholder
-            Op(OP_LITERAL, r = value.offset + MemberOffset(String, data  ), s = MemberSize(String, data  ));  // :PatchDebugPlaceholder
+            Op(OP_LITERAL, flags = OP_A_IS_DATA, r = value.offset + MemberOffset(String, data), s = MemberSize(String, data));  // :PatchDebugPlaceholder
             Op(OP_DEBUG_PRINT, r = value.offset, s = TYPE_STRING);
         }
         else
@@ -366,23 +796,45 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         else
         {
             Location rhs = generate_expression(builder, expr->binary.rhs);
-            copy(builder, lhs, rhs);
+            store(builder, lhs, rhs);
         }
         return lhs;
     } break;
 
     Bytecode_Operation binary_uf_op;
-    case EXPRESSION_ADD:                binary_uf_op = OP_ADD;      goto emit_binary_uf;
-    case EXPRESSION_SUBTRACT:           binary_uf_op = OP_SUBTRACT; goto emit_binary_uf;
-    case EXPRESSION_MULTIPLY:           binary_uf_op = OP_MULTIPLY; goto emit_binary_uf;
+    Bytecode_Operation binary_uf_immediate_op;
+    case EXPRESSION_ADD:                binary_uf_op = OP_ADD;      binary_uf_immediate_op = OP_ADD_IMMEDIATE;      goto emit_binary_uf;
+    case EXPRESSION_SUBTRACT:           binary_uf_op = OP_SUBTRACT; binary_uf_immediate_op = OP_SUBTRACT_IMMEDIATE; goto emit_binary_uf;
+    case EXPRESSION_MULTIPLY:           binary_uf_op = OP_MULTIPLY; binary_uf_immediate_op = OP_MULTIPLY_IMMEDIATE; goto emit_binary_uf;
     emit_binary_uf:
     {
-        Location lhs = direct(builder, generate_expression(builder, expr->binary.lhs));
-        Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
+        Expression lhs_id = expr->binary.lhs;
+        Expression rhs_id = expr->binary.rhs;
+        if (is_constant_operand(block, lhs_id) && is_constant_operand(block, rhs_id))
+        {
+            // :PatchFoldedConstantPlaceholder
+            Location result = allocate_location(builder, infer->type);
+            *reserve_item(&builder->patches) = { block, id, Label() };
+            return temporary_result(builder, Op(OP_LITERAL, r = result.offset, s = get_type_size(unit, result.type)), result);
+        }
+
+        // :ImmediateOperands
+        if (is_constant_operand(block, lhs_id) && binary_uf_op != OP_SUBTRACT)
+            swap(&lhs_id, &rhs_id);
+        if (is_constant_operand(block, rhs_id))
+        {
+            Location lhs = direct(builder, generate_expression(builder, lhs_id));
+            assert(lhs.type == get_constant_operand_type(block, rhs_id));
+            Location result = allocate_location(builder, infer->type);
+            *reserve_item(&builder->patches) = { block, rhs_id, Label() };
+            return temporary_result(builder, Op(binary_uf_immediate_op, r = result.offset, a = lhs.offset, s = simplify_type_uf(unit, lhs.type)), result);
+        }
+
+        Location lhs = direct(builder, generate_expression(builder, lhs_id));
+        Location rhs = direct(builder, generate_expression(builder, rhs_id));
         assert(lhs.type == rhs.type);
         Location result = allocate_location(builder, infer->type);
-        Op(binary_uf_op, r = result.offset, a = lhs.offset, b = rhs.offset, s = simplify_type_uf(unit, lhs.type));
-        return result;
+        return temporary_result(builder, Op(binary_uf_op, r = result.offset, a = lhs.offset, b = rhs.offset, s = simplify_type_uf(unit, lhs.type)), result);
     } break;
 
     Bytecode_Operation binary_usf_op;
@@ -394,12 +846,28 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
         assert(lhs.type == rhs.type);
         Location result = allocate_location(builder, infer->type);
-        Op(binary_usf_op, r = result.offset, a = lhs.offset, b = rhs.offset, s = simplify_type(unit, lhs.type));
-        return result;
+        return temporary_result(builder, Op(binary_usf_op, r = result.offset, a = lhs.offset, b = rhs.offset, s = simplify_type(unit, lhs.type)), result);
     } break;
 
     case EXPRESSION_POINTER_ADD:
     {
+        // :ImmediateOperands
+        Expression pointer_id = expr->binary.lhs;
+        Expression integer_id = expr->binary.rhs;
+        if (is_pointer_type(block->inferred_expressions[integer_id].type))
+            swap(&pointer_id, &integer_id);
+        if (is_constant_operand(block, integer_id))
+        {
+            Location pointer = direct(builder, generate_expression(builder, pointer_id));
+            assert(is_pointer_type(pointer.type));
+            assert(is_integer_type(get_constant_operand_type(block, integer_id)));
+
+            u64 element_size = get_type_size(unit, get_element_type(pointer.type));
+            Location result = allocate_location(builder, infer->type);
+            *reserve_item(&builder->patches) = { block, integer_id, Label() };
+            return temporary_result(builder, Op(OP_MOVE_POINTER_IMMEDIATE, r = result.offset, a = pointer.offset, s = element_size), result);
+        }
+
         Location lhs = direct(builder, generate_expression(builder, expr->binary.lhs));
         Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
 
@@ -415,8 +883,7 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
 
         u64 element_size = get_type_size(unit, get_element_type(lhs.type));
         Location result = allocate_location(builder, infer->type);
-        Op(OP_MOVE_POINTER_FORWARD, r = result.offset, a = lhs.offset, b = rhs.offset, s = element_size);
-        return result;
+        return temporary_result(builder, Op(OP_MOVE_POINTER_FORWARD, r = result.offset, a = lhs.offset, b = rhs.offset, s = element_size), result);
     } break;
 
     case EXPRESSION_POINTER_SUBTRACT:
@@ -433,12 +900,39 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
     case EXPRESSION_LESS_OR_EQUAL:      compare_flags = OP_COMPARE_LESS | OP_COMPARE_EQUAL;    goto emit_compare;
     emit_compare:
     {
-        Location lhs = direct(builder, generate_expression(builder, expr->binary.lhs));
-        Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
+        Expression lhs_id = expr->binary.lhs;
+        Expression rhs_id = expr->binary.rhs;
+        if (is_constant_operand(block, lhs_id) && is_constant_operand(block, rhs_id))
+        {
+            // :PatchFoldedConstantPlaceholder
+            Location result = allocate_location(builder, infer->type);
+            *reserve_item(&builder->patches) = { block, id, Label() };
+            return temporary_result(builder, Op(OP_LITERAL, r = result.offset, s = get_type_size(unit, result.type)), result);
+        }
+
+        // :ImmediateOperands
+        if (is_constant_operand(block, lhs_id))
+        {
+            swap(&lhs_id, &rhs_id);
+            flags32 mirrored = compare_flags & OP_COMPARE_EQUAL;
+            if (compare_flags & OP_COMPARE_GREATER) mirrored |= OP_COMPARE_LESS;
+            if (compare_flags & OP_COMPARE_LESS)    mirrored |= OP_COMPARE_GREATER;
+            compare_flags = mirrored;
+        }
+        if (is_constant_operand(block, rhs_id))
+        {
+            Location lhs = direct(builder, generate_expression(builder, lhs_id));
+            assert(lhs.type == get_constant_operand_type(block, rhs_id));
+            Location result = allocate_location(builder, infer->type);
+            *reserve_item(&builder->patches) = { block, rhs_id, Label() };
+            return temporary_result(builder, Op(OP_COMPARE_IMMEDIATE, flags = compare_flags, r = result.offset, a = lhs.offset, s = simplify_type(unit, lhs.type)), result);
+        }
+
+        Location lhs = direct(builder, generate_expression(builder, lhs_id));
+        Location rhs = direct(builder, generate_expression(builder, rhs_id));
         assert(lhs.type == rhs.type);
         Location result = allocate_location(builder, infer->type);
-        Op(OP_COMPARE, flags = compare_flags, r = result.offset, a = lhs.offset, b = rhs.offset, s = simplify_type(unit, lhs.type));
-        return result;
+        return temporary_result(builder, Op(OP_COMPARE, flags = compare_flags, r = result.offset, a = lhs.offset, b = rhs.offset, s = simplify_type(unit, lhs.type)), result);
     } break;
 
     case EXPRESSION_AND:
@@ -449,7 +943,8 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         Bytecode* goto_if_false = Op(OP_GOTO_IF_FALSE, a = lhs.offset);
 
         // lhs is true, result = rhs
-        copy(builder, result, direct(builder, generate_expression(builder, expr->binary.rhs)));
+        Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
+        copy(builder, result, rhs);
         Bytecode* goto_end = Op(OP_GOTO);
         goto_if_false->r = Label();
 
@@ -472,7 +967,8 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         goto_if_false->r = Label();
 
         // lhs is false, result = rhs
-        copy(builder, result, direct(builder, generate_expression(builder, expr->binary.rhs)));
+        Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
+        copy(builder, result, rhs);
         goto_end->r = Label();
         return result;
     } break;
@@ -482,28 +978,29 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         Type cast_type  = infer->type;
         Type value_type = block->inferred_expressions[expr->binary.rhs].type;
 
-        Location value = allocate_location(builder, cast_type);
         if (is_soft_type(value_type))
         {
             // :PatchHardenedConstantPlaceholder
+            Location value = allocate_location(builder, cast_type);
             *reserve_item(&builder->patches) = { block, id, Label() };
-            Op(OP_LITERAL, r = value.offset, s = get_type_size(unit, value.type));
+            return temporary_result(builder, Op(OP_LITERAL, r = value.offset, s = get_type_size(unit, value.type)), value);
         }
         else
         {
+            Location operand = direct(builder, generate_expression(builder, expr->binary.rhs));
+            Location value = allocate_location(builder, cast_type);
+
             cast_type  = simplify_type(unit, cast_type);
             value_type = simplify_type(unit, value_type);
-
-            Location operand = direct(builder, generate_expression(builder, expr->binary.rhs));
-            Op(OP_CAST, r = value.offset, a = operand.offset, b = value_type, s = cast_type);
+            return temporary_result(builder, Op(OP_CAST, r = value.offset, a = operand.offset, b = value_type, s = cast_type), value);
         }
-        return value;
     } break;
 
     case EXPRESSION_GOTO_UNIT:
     {
         Location lhs = direct(builder, generate_expression(builder, expr->binary.lhs));
         Location rhs = direct(builder, generate_expression(builder, expr->binary.rhs));
+
         Op(OP_SWITCH_UNIT, r = lhs.offset, a = rhs.offset);
         return void_location(infer->type);
     } break;
@@ -520,35 +1017,43 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
             if (on_failure != NO_EXPRESSION && block->inferred_expressions[on_failure].flags & INFERRED_EXPRESSION_CONDITION_ENABLED)
                 generate_expression(builder, on_failure);
         }
-        else if (condition == NO_EXPRESSION)
-        {
-            assert(on_success != NO_EXPRESSION && on_failure == NO_EXPRESSION);
-            u64 loop_label = Label();
-            generate_expression(builder, on_success);
-            if (expr->flags & EXPRESSION_BRANCH_IS_LOOP)
-                Op(OP_GOTO, r = loop_label);
-        }
         else
         {
-            u64 loop_label = Label();
-            Location condition_location = direct(builder, generate_expression(builder, condition));
-            Bytecode* goto_if_false = Op(OP_GOTO_IF_FALSE, a = condition_location.offset);
-            generate_expression(builder, on_success);
-            if (expr->flags & EXPRESSION_BRANCH_IS_LOOP)
-                Op(OP_GOTO, r = loop_label);
-            goto_if_false->r = Label();
-            if (on_failure != NO_EXPRESSION)
+            auto generate_branch = [&](u64 loop_label)
             {
-                Bytecode* goto_end = NULL;
-                if (!(expr->flags & EXPRESSION_BRANCH_IS_LOOP))
-                    goto_end = Op(OP_GOTO);
-                goto_if_false->r = Label();
-                generate_expression(builder, on_failure);
+                if (condition == NO_EXPRESSION)
+                {
+                    assert(on_success != NO_EXPRESSION && on_failure == NO_EXPRESSION);
+                    generate_expression(builder, on_success);
+                    if (expr->flags & EXPRESSION_BRANCH_IS_LOOP)
+                        Op(OP_GOTO, r = loop_label);
+                    return;
+                }
+
+                Location condition_location = direct(builder, generate_expression(builder, condition));
+                Bytecode* goto_if_false = Op(OP_GOTO_IF_FALSE, a = condition_location.offset);
+                generate_expression(builder, on_success);
                 if (expr->flags & EXPRESSION_BRANCH_IS_LOOP)
                     Op(OP_GOTO, r = loop_label);
-                else
-                    goto_end->r = Label();
-            }
+                goto_if_false->r = Label();
+                if (on_failure != NO_EXPRESSION)
+                {
+                    Bytecode* goto_end = NULL;
+                    if (!(expr->flags & EXPRESSION_BRANCH_IS_LOOP))
+                        goto_end = Op(OP_GOTO);
+                    goto_if_false->r = Label();
+                    generate_expression(builder, on_failure);
+                    if (expr->flags & EXPRESSION_BRANCH_IS_LOOP)
+                        Op(OP_GOTO, r = loop_label);
+                    else
+                        goto_end->r = Label();
+                }
+            };
+
+            if (expr->flags & EXPRESSION_BRANCH_IS_LOOP)
+                generate_loop(builder, id, generate_branch);  // :LoopInvariantCodeMotion
+            else
+                generate_branch(Label());
         }
 
         return void_location(infer->type);
@@ -588,8 +1093,42 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
             }
         }
 
-        *reserve_item(&builder->patches) = { block, id, Label() };
-        Op(OP_CALL);  // :PatchCallPlaceholder
+        if (should_inline(builder, callee))
+        {
+            // :InlineSmallBlocks
+            Inlined_Block inlined = {};
+            inlined.outer  = builder->inlined_block;
+            inlined.caller = block;
+            inlined.block  = callee;
+            builder->inlined_block = &inlined;
+
+            Bytecode* return_address = NULL;
+            if (is_yielded_from_child_block(callee, callee))
+                return_address = Op(OP_LITERAL, flags = OP_A_IS_INSTRUCTION, r = get_return_address_offset(builder, callee), s = sizeof(umm));
+
+            builder->block = callee;
+            For (callee->imperative_order)
+            {
+                if (callee->inferred_expressions[*it].flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME) continue;
+                generate_expression(builder, *it);
+            }
+            builder->block = block;
+            builder->inlined_block = inlined.outer;
+            builder->temporary_result_op = NULL;
+
+            For (inlined.yields)
+                (*it)->r = Label();
+            if (return_address)
+                return_address->a = Label();
+            free_heap_array(&inlined.yields);
+            unit->count_inlined_calls++;
+        }
+        else
+        {
+            *reserve_item(&builder->patches) = { block, id, Label() };
+            Op(OP_CALL);  // :PatchCallPlaceholder
+        }
+        unit->count_calls++;
 
         if (return_expression == NO_EXPRESSION)
             return void_location(infer->type);
@@ -612,20 +1151,22 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         for (umm i = 0; i < expr->yield_assignments->count; i++)
             generate_expression(builder, expr->yield_assignments->expressions[i]);
 
-        Block* yield_from = block;
-        while (!(yield_from->flags & (BLOCK_IS_PARAMETER_BLOCK | BLOCK_IS_UNIT)) &&
-               yield_from->parent_scope &&
-               yield_from->parent_scope_visibility_limit != NO_VISIBILITY)
-            yield_from = yield_from->parent_scope;
+        Block* yield_from = get_yield_target(block);
         assert(yield_from->materialized_by_unit == block->materialized_by_unit);
 
-        if (yield_from->flags & BLOCK_IS_UNIT)
-            Op(OP_FINISH_UNIT);
-        else
+        Inlined_Block* inlined = builder->inlined_block;
+        while (inlined && inlined->block != yield_from)
+            inlined = inlined->outer;
+
+        if (inlined)
         {
-            assert(yield_from->return_address_offset != 0);  // should already have the address known
-            Op(OP_GOTO_INDIRECT, r = yield_from->return_address_offset);
+            Bytecode* goto_end = Op(OP_GOTO);  // :InlineSmallBlocks
+            add_item(&inlined->yields, &goto_end);
         }
+        else if (yield_from->flags & BLOCK_IS_UNIT)
+            Op(OP_FINISH_UNIT);
+        else
+            Op(OP_GOTO_INDIRECT, r = get_return_address_offset(builder, yield_from));
         return void_location(infer->type);
     } break;
 
@@ -643,7 +1184,7 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
         else
         {
             Location value = generate_expression(builder, expr->declaration.value);
-            copy(builder, location, value);
+            store(builder, location, value);
         }
         return location;
     } break;
@@ -653,6 +1194,25 @@ static Location generate_expression(Bytecode_Builder* builder, Expression id)
     Unreachable;
 }
 
+// :ZeroedUnitStorage
+// Declarations without a value in the entry block of a unit are all zeroed up front, instead of
+// where they are declared. Storage allocated by the pipeline is already zero, so the pipeline
+// starts a unit after that prologue (at entry_into_zeroed_storage), and units with large locals
+// don't touch all of their storage before doing any work. A unit switched to by another unit
+// starts at the top, because that storage might hold anything.
+// The entry block runs only once per start, and a declaration isn't visible before it's declared,
+// so zeroing it early is the same as zeroing it where it is.
+static bool is_zeroed_up_front(Unit* unit, Block* block, Expression id)
+{
+    if (block != unit->entry_block) return false;
+    if (block->parsed_kinds[id] != EXPRESSION_DECLARATION) return false;
+
+    Parsed_Expression const* expr = &block->parsed_expressions[id];
+    if (expr->declaration.value != NO_EXPRESSION) return false;
+    if (expr->flags & EXPRESSION_DECLARATION_IS_UNINITIALIZED) return false;
+    return get(&block->declaration_placement, &id);
+}
+
 static void generate_block(Bytecode_Builder* builder, Block* block)
 {
     if (block->flags & BLOCK_HAS_BEEN_GENERATED)
@@ -665,22 +1225,175 @@ static void generate_block(Bytecode_Builder* builder, Block* block)
 
     // all non-entry blocks can return, so they need a return address
     if (block != unit->entry_block)
-        block->return_address_offset = allocate_storage(unit, BLOCK_RETURN_ADDRESS_SIZE, sizeof(void*));
+        get_return_address_offset(builder, block);
+
+    if (block == unit->entry_block)
+    {
+        For (block->imperative_order)
+        {
+            if (block->inferred_expressions[*it].flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME) continue;
+            if (!is_zeroed_up_front(unit, block, *it)) continue;
+
+            u64 offset;
+            assert(get(&block->declaration_placement, it, &offset));
+            zero(builder, Location(offset, block->inferred_expressions[*it].type, false));
+        }
+        unit->entry_into_zeroed_storage = builder->bytecode.count;
+    }
 
     For (block->imperative_order)
-        if (!(block->inferred_expressions[*it].flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME))
-            generate_expression(builder, *it);
+    {
+        if (block->inferred_expressions[*it].flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME) continue;
+        if (is_zeroed_up_front(unit, block, *it)) continue;
+        generate_expression(builder, *it);
+    }
 
     if (block == unit->entry_block)
         Op(OP_FINISH_UNIT);
     else
-        Op(OP_GOTO_INDIRECT, r = block->return_address_offset);
+        Op(OP_GOTO_INDIRECT, r = get_return_address_offset(builder, block));
 
     For (block->inferred_expressions)
         if (it->called_block)
             generate_block(builder, it->called_block);
 }
 
+static u64 get_hardened_constant(Unit* unit, Block* block, Expression id, Type* out_type = NULL)
+{
+    auto* expr  = &block->parsed_expressions  [id];
+    auto* infer = &block->inferred_expressions[id];
+
+    Expression constant_expression = (expr->kind == EXPRESSION_CAST) ? expr->binary.rhs : id;
+    Type       constant_type       = (expr->kind == EXPRESSION_CAST) ? infer->type      : infer->hardened_type;
+    if (out_type) *out_type = constant_type;
+
+    assert(is_soft_type(block->inferred_expressions[constant_expression].type));
+
+    u64 constant;
+    if (is_integer_type(constant_type))
+    {
+        Fraction const* fract = get_constant_number(block, constant_expression);
+        assert(fract);
+        assert(fract_is_integer(fract));
+        Integer numerator = fract_get_numerator(fract);
+        Defer(int_free(&numerator));
+        assert(int_get_abs_u64(&constant, &numerator));
+        if (numerator.negative)
+            constant = -constant;
+    }
+    else if (is_floating_point_type(constant_type))
+    {
+        Fraction const* fract = get_constant_number(block, constant_expression);
+        assert(fract);
+
+        Numeric_Description numeric;
+        bool numeric_ok = get_numeric_description(unit, &numeric, constant_type);
+        assert(numeric_ok);
+
+        Integer mantissa = {};
+        smm exponent;
+        umm mantissa_size, msb;
+        umm count_decimals = -numeric.min_exponent_subnormal;
+        bool exact = fract_scientific_abs(fract, count_decimals, &mantissa, &exponent, &mantissa_size, &msb);
+        Defer(int_free(&mantissa));
+
+        assert(numeric.bits <= 64);
+        assert(numeric.bits == numeric.exponent_bits + numeric.significand_bits + 1);
+
+        u64 float_sign = fract_is_negative(fract) ? 1 : 0;
+        u64 float_exponent;
+        u64 float_significand;
+        if (exponent > numeric.max_exponent)  // infinity
+        {
+            float_exponent = (1ull << numeric.exponent_bits) - 1;
+            float_significand = 0;
+        }
+        else if (int_is_zero(&mantissa))  // zero
+        {
+            float_exponent = 0;
+            float_significand = 0;
+        }
+        else
+        {
+            if (exponent < numeric.min_exponent)
+                float_exponent = 0;  // subnormal
+            else
+                float_exponent = exponent + numeric.exponent_bias;
+
+            umm from = (msb > numeric.significand_bits) ? (msb - numeric.significand_bits) : 0;
+            float_significand = 0;
+            for (umm i = 0; i < numeric.significand_bits; i++)
+                float_significand |= (u64) int_test_bit(&mantissa, from + i) << i;
+        }
+
+        assert(float_exponent    < (1ull << numeric.exponent_bits));
+        assert(float_significand < (1ull << numeric.significand_bits));
+        constant = (float_sign << (numeric.bits - 1))
+                 | (float_exponent << (numeric.significand_bits))
+                 | (float_significand);
+    }
+    else if (is_bool_type(constant_type))
+        constant = (*get_constant_bool(block, constant_expression) ? 1 : 0);
+    else if (constant_type == TYPE_TYPE)
+        constant = *get_constant_type(block, constant_expression);
+    else Unreachable;
+
+    return constant;
+}
+
+// :PatchFoldedConstantPlaceholder
+// Operands have the constant bit patterns the instructions would see at run time, so the result
+// wraps around the same way it would have if the operation ran. Integer arithmetic is done in
+// u64 (Wide) and truncated, because overflowing a signed type, or u8 and u16 after promotion to
+// int, is undefined. Comparisons are done in the operand type T.
+u64 fold_constant_operation(Unit* unit, Expression_Kind kind, Type type, u64 lhs_bits, u64 rhs_bits)
+{
+    auto fold = [&]<typename T, typename Wide>(T, Wide) -> u64
+    {
+        T lhs, rhs;
+        memcpy(&lhs, &lhs_bits, sizeof(T));
+        memcpy(&rhs, &rhs_bits, sizeof(T));
+
+        auto bits = [](T value) -> u64
+        {
+            u64 bits = 0;
+            memcpy(&bits, &value, sizeof(T));
+            return bits;
+        };
+
+        switch (kind)
+        {
+        IllegalDefaultCase;
+        case EXPRESSION_ADD:              return bits((T)((Wide) lhs + (Wide) rhs));
+        case EXPRESSION_SUBTRACT:         return bits((T)((Wide) lhs - (Wide) rhs));
+        case EXPRESSION_MULTIPLY:         return bits((T)((Wide) lhs * (Wide) rhs));
+        case EXPRESSION_EQUAL:            return lhs == rhs;
+        case EXPRESSION_NOT_EQUAL:        return lhs != rhs;
+        case EXPRESSION_GREATER_THAN:     return lhs >  rhs;
+        case EXPRESSION_GREATER_OR_EQUAL: return lhs >= rhs;
+        case EXPRESSION_LESS_THAN:        return lhs <  rhs;
+        case EXPRESSION_LESS_OR_EQUAL:    return lhs <= rhs;
+        }
+    };
+
+    switch (simplify_type(unit, type))
+    {
+    IllegalDefaultCase;
+    case TYPE_F16:  NotImplemented;
+    case TYPE_U8:   return fold((u8)   0, (u64)  0);
+    case TYPE_U16:  return fold((u16)  0, (u64)  0);
+    case TYPE_U32:  return fold((u32)  0, (u64)  0);
+    case TYPE_U64:  return fold((u64)  0, (u64)  0);
+    case TYPE_S8:   return fold((s8)   0, (u64)  0);
+    case TYPE_S16:  return fold((s16)  0, (u64)  0);
+    case TYPE_S32:  return fold((s32)  0, (u64)  0);
+    case TYPE_S64:  return fold((s64)  0, (u64)  0);
+    case TYPE_F32:  return fold((f32)  0, (f32)  0);
+    case TYPE_F64:  return fold((f64)  0, (f64)  0);
+    case TYPE_BOOL: return fold((bool) 0, (bool) 0);
+    }
+}
+
 static void patch_bytecode(Unit* unit)
 {
     Environment* env = unit->env;
@@ -698,81 +1411,19 @@ static void patch_bytecode(Unit* unit)
 
         if (infer->flags & INFERRED_EXPRESSION_IS_HARDENED_CONSTANT || expr->kind == EXPRESSION_CAST)
         {
-            Expression constant_expression = (expr->kind == EXPRESSION_CAST) ? expr->binary.rhs : id;
-            Type       constant_type       = (expr->kind == EXPRESSION_CAST) ? infer->type      : infer->hardened_type;
-
-            assert(is_soft_type(block->inferred_expressions[constant_expression].type));
+            u64 constant = get_hardened_constant(unit, block, id);
 
-            u64 constant;
-            if (is_integer_type(constant_type))
-            {
-                Fraction const* fract = get_constant_number(block, constant_expression);
-                assert(fract);
-                assert(fract_is_integer(fract));
-                assert(int_get_abs_u64(&constant, &fract->num));
-                if (fract->num.negative)
-                    constant = -constant;
-            }
-            else if (is_floating_point_type(constant_type))
+            // :PatchHardenedConstantPlaceholder
+            if (bc[0].op == OP_LITERAL)
+                bc[0].a = constant;
+            else
             {
-                Fraction const* fract = get_constant_number(block, constant_expression);
-                assert(fract);
-
-                Numeric_Description numeric;
-                bool numeric_ok = get_numeric_description(unit, &numeric, constant_type);
-                assert(numeric_ok);
-
-                Integer mantissa = {};
-                smm exponent;
-                umm mantissa_size, msb;
-                umm count_decimals = -numeric.min_exponent_subnormal;
-                bool exact = fract_scientific_abs(fract, count_decimals, &mantissa, &exponent, &mantissa_size, &msb);
-                Defer(int_free(&mantissa));
-
-                assert(numeric.bits <= 64);
-                assert(numeric.bits == numeric.exponent_bits + numeric.significand_bits + 1);
-
-                u64 float_sign = fract_is_negative(fract) ? 1 : 0;
-                u64 float_exponent;
-                u64 float_significand;
-                if (exponent > numeric.max_exponent)  // infinity
-                {
-                    float_exponent = (1ull << numeric.exponent_bits) - 1;
-                    float_significand = 0;
-                }
-                else if (int_is_zero(&mantissa))  // zero
-                {
-                    float_exponent = 0;
-                    float_significand = 0;
-                }
-                else
-                {
-                    if (exponent < numeric.min_exponent)
-                        float_exponent = 0;  // subnormal
-                    else
-                        float_exponent = exponent + numeric.exponent_bias;
-
-                    umm from = (msb > numeric.significand_bits) ? (msb - numeric.significand_bits) : 0;
-                    float_significand = 0;
-                    for (umm i = 0; i < numeric.significand_bits; i++)
-                        float_significand |= (u64) int_test_bit(&mantissa, from + i) << i;
-                }
-
-                assert(float_exponent    < (1ull << numeric.exponent_bits));
-                assert(float_significand < (1ull << numeric.significand_bits));
-                constant = (float_sign << (numeric.bits - 1))
-                         | (float_exponent << (numeric.significand_bits))
-                         | (float_significand);
+                // :ImmediateOperands
+                assert(bc[0].op == OP_ADD_IMMEDIATE      || bc[0].op == OP_SUBTRACT_IMMEDIATE ||
+                       bc[0].op == OP_MULTIPLY_IMMEDIATE || bc[0].op == OP_COMPARE_IMMEDIATE  ||
+                       bc[0].op == OP_MOVE_POINTER_IMMEDIATE);
+                bc[0].b = constant;
             }
-            else if (is_bool_type(constant_type))
-                constant = (*get_constant_bool(block, constant_expression) ? 1 : 0);
-            else if (constant_type == TYPE_TYPE)
-                constant = *get_constant_type(block, constant_expression);
-            else Unreachable;
-
-            // :PatchHardenedConstantPlaceholder
-            assert(bc[0].op == OP_LITERAL);
-            bc[0].a = constant;
         }
         else switch (expr->kind)
         {
@@ -822,6 +1473,26 @@ static void patch_bytecode(Unit* unit)
             assert(bc[0].op == OP_LITERAL && bc[1].op == OP_LITERAL);
             bc[0].a = (umm) text.length;
             bc[1].a = (umm) text.data;
+            bc[1].b = (umm) text.length;  // see OP_A_IS_DATA
+        } break;
+
+        case EXPRESSION_ADD:
+        case EXPRESSION_SUBTRACT:
+        case EXPRESSION_MULTIPLY:
+        case EXPRESSION_EQUAL:
+        case EXPRESSION_NOT_EQUAL:
+        case EXPRESSION_GREATER_THAN:
+        case EXPRESSION_GREATER_OR_EQUAL:
+        case EXPRESSION_LESS_THAN:
+        case EXPRESSION_LESS_OR_EQUAL:
+        {
+            Type type;
+            u64 lhs = get_hardened_constant(unit, block, expr->binary.lhs, &type);
+            u64 rhs = get_hardened_constant(unit, block, expr->binary.rhs);
+
+            // :PatchFoldedConstantPlaceholder
+            assert(bc[0].op == OP_LITERAL);
+            bc[0].a = fold_constant_operation(unit, expr->kind, type, lhs, rhs);
         } break;
 
         case EXPRESSION_CALL:
@@ -866,8 +1537,25 @@ void generate_bytecode_for_unit_placement(Unit* unit)
         builder.block      = NULL;
         builder.expression = NO_EXPRESSION;
         generate_block(&builder, unit->entry_block);
-        unit->bytecode         = const_array(resolve_to_array_and_free(&builder.bytecode, &unit->memory));
-        unit->bytecode_patches = const_array(resolve_to_array_and_free(&builder.patches,  &unit->memory));
+        unit->bytecode          = const_array(resolve_to_array_and_free(&builder.bytecode, &unit->memory));
+        unit->bytecode_patches  = const_array(resolve_to_array_and_free(&builder.patches,  &unit->memory));
+        unit->temporary_storage = const_array(allocate_array(&unit->memory, &builder.temporary_storage));
+        free_heap_array(&builder.temporary_storage);
+    }
+}
+
+void finish_bytecode_for_unit_placement(Unit* unit)
+{
+    Compiler* ctx = unit->env->ctx;
+    ctx->count_inlined_calls       += unit->count_inlined_calls;
+    ctx->count_hoisted_expressions += unit->count_hoisted_expressions;
+    if (ctx->report_inlining && unit->count_calls)
+    {
+        String file;
+        u32 line, column;
+        get_line(ctx, get_token_info(ctx, &unit->initiator_from), &line, &column, &file);
+        fprintf(stderr, "[inline] %.*s:%u:%u inlined %llu of %llu calls\n", StringArgs(file), line, column,
+                (unsigned long long) unit->count_inlined_calls, (unsigned long long) unit->count_calls);
     }
 }
 
@@ -876,10 +1564,19 @@ void generate_bytecode_for_unit_completion(Unit* unit)
     if (!(unit->flags & UNIT_IS_STRUCT))
     {
         patch_bytecode(unit);
+        optimize_bytecode(unit);
         unit->compiled_bytecode = true;
     }
 }
 
+void finish_bytecode_for_unit_completion(Unit* unit)
+{
+    Compiler* ctx = unit->env->ctx;
+    ctx->count_ir_removed_instructions += unit->count_ir_removed_instructions;
+    if (ctx->dump_bytecode && unit->compiled_bytecode)
+        dump_bytecode(unit);
+}
+
 
 
 ExitApplicationNamespace
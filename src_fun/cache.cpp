@@ -0,0 +1,866 @@
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "../src_common/crypto.h"
+#include "api.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+EnterApplicationNamespace
+
+
+// The module cache stores the lexed and parsed form of a source file, so we can skip
+// lexing and parsing when a file is imported again by another process.
+//
+// A cache file is keyed by the SHA-256 of the compiler build, the file path, the import
+// path patterns and the source code. Everything in it is position independent:
+//  - identifier atoms are replaced with indices into the file's identifier list,
+//  - token info indices are relative to the first token info of the module,
+//  - block pointers are indices into the block list, or into the import list,
+//  - expression list pointers are offsets into the list section,
+//  - strings and big number digits are offsets into the blob.
+// The file is mapped copy-on-write, and the expression arrays are relocated in place,
+// so the parsed blocks point directly into the mapping.
+//
+// Every edit of a source file produces a new key, so the directory is bounded by size.
+// A hit touches the file's modification time, and after writing a new file, the least
+// recently used files are deleted until the directory fits in MODULE_CACHE_MAX_SIZE.
+
+static constexpr u64 MODULE_CACHE_MAGIC   = 0x31454843414D4E46ull;  // "FNMACHE1"
+static constexpr u32 MODULE_CACHE_VERSION = 3;
+static constexpr u64 MODULE_CACHE_MAX_SIZE = Megabyte(256);
+
+struct Module_Cache_Section
+{
+    u64 offset;
+    u64 count;
+};
+
+struct Module_Cache_String
+{
+    u64 offset;  // into the blob
+    u64 length;
+};
+
+struct Module_Cache_Block
+{
+    flags32 flags;
+    u32     unused;
+    Token   from;
+    Token   to;
+    u64     first_expression;
+    u64     expression_count;
+    u64     first_order;
+    u64     order_count;
+    u64     first_comment;
+    u64     comment_count;
+};
+
+struct Module_Cache_Header
+{
+    u64    magic;
+    u32    version;
+    u32    unused;
+    SHA256 key;
+
+    Module_Cache_Section identifiers;   // Module_Cache_String
+    Module_Cache_Section imports;       // Module_Cache_String, paths of imported modules
+    Module_Cache_Section line_offsets;  // u32
+    Module_Cache_Section info_other;    // Token_Info
+    Module_Cache_Section info_number;   // Token_Info_Number
+    Module_Cache_Section number_values; // Fraction, of literals which aren't compact, big digits are in the blob
+    Module_Cache_Section info_string;   // Token_Info_String, values are in the blob
+    Module_Cache_Section blocks;        // Module_Cache_Block, the first one is the top level block
+    Module_Cache_Section expressions;   // Parsed_Expression
+    Module_Cache_Section order;         // Expression
+    Module_Cache_Section comments;      // Block_Comment
+    Module_Cache_Section lists;         // u32, Expression_Lists back to back
+    Module_Cache_Section blob;          // u8
+};
+
+
+static SHA256 get_build_id()
+{
+    // The executable changes with every build, so its size and timestamp identify the build.
+    static SHA256 build_id = []()
+    {
+        String exe = get_executable_path();
+        File_Time write_time = 0;
+        u64 length = 0;
+        get_file_time(exe, NULL, &write_time);
+        get_file_length(exe, &length);
+
+        SHA256_Context sha;
+        sha256_init(&sha);
+        sha256_data(&sha, exe);
+        sha256_u64be(&sha, write_time);
+        sha256_u64be(&sha, length);
+        sha256_u32be(&sha, MODULE_CACHE_VERSION);
+        sha256_done(&sha);
+        return sha.result;
+    }();
+    return build_id;
+}
+
+static SHA256 get_module_key(Compiler* ctx, String path, String code)
+{
+    SHA256 build_id = get_build_id();
+
+    SHA256_Context sha;
+    sha256_init(&sha);
+    sha256_data(&sha, &build_id, sizeof(build_id));
+    sha256_u64be(&sha, path.length);
+    sha256_data(&sha, path);
+    For (ctx->import_path_patterns)
+    {
+        sha256_u64be(&sha, it->length);
+        sha256_data(&sha, *it);
+    }
+    sha256_u32be(&sha, ctx->keep_comments);
+    sha256_u64be(&sha, code.length);
+    sha256_data(&sha, code);
+    sha256_done(&sha);
+    return sha.result;
+}
+
+static String get_module_cache_path(Compiler* ctx, SHA256 key)
+{
+    String name = Format(temp, "%.funcache", hex_from_bytes(temp, { sizeof(key), (u8*) &key }));
+    return concatenate_path(temp, ctx->module_cache_directory, name);
+}
+
+
+template <typename Callback>
+static void for_each_token(Parsed_Expression* expr, Callback&& callback)
+{
+    callback(&expr->from);
+    callback(&expr->to);
+    switch (expr->kind)
+    {
+    case EXPRESSION_NUMERIC_LITERAL:
+    case EXPRESSION_STRING_LITERAL: callback(&expr->literal);          break;
+    case EXPRESSION_NAME:           callback(&expr->name.token);       break;
+    case EXPRESSION_MEMBER:         callback(&expr->member.name);      break;
+    case EXPRESSION_DECLARATION:    callback(&expr->declaration.name); break;
+    case EXPRESSION_DELETE:         callback(&expr->deleted_name);     break;
+    case EXPRESSION_INTRINSIC:      callback(&expr->intrinsic_name);   break;
+    default: break;
+    }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Saving
+////////////////////////////////////////////////////////////////////////////////
+
+
+struct Module_Cache_Writer
+{
+    String_Concatenator cat;
+    umm                 size;
+
+    String_Concatenator blob;
+    umm                 blob_size;
+
+    void add_section(Module_Cache_Section* section, void const* data, umm item_size, umm count)
+    {
+        while (size % 8) { *reserve_item(&cat) = 0; size++; }
+        section->offset = size;
+        section->count  = count;
+        add(&cat, data, item_size * count);
+        size += item_size * count;
+    }
+
+    u64 add_blob(void const* data, umm length)
+    {
+        u64 offset = blob_size;
+        add(&blob, data, length);
+        blob_size += length;
+        return offset;
+    }
+
+    Module_Cache_String add_string(String string)
+    {
+        return { add_blob(string.data, string.length), string.length };
+    }
+};
+
+String write_module_image(Compiler* ctx, Block* top_level, Module_Cache_Token_Range const* range, Region* memory)
+{
+    Module_Cache_Writer w = {};
+    Defer(free_concatenator(&w.cat));
+    Defer(free_concatenator(&w.blob));
+
+    Module_Cache_Header header = {};
+    header.magic   = MODULE_CACHE_MAGIC;
+    header.version = MODULE_CACHE_VERSION;
+    add(&w.cat, &header, sizeof(header));
+    w.size = sizeof(header);
+
+    Dynamic_Array<String> identifiers = {};
+    Dynamic_Array<String> imports     = {};
+    Dynamic_Array<Block*> blocks      = {};
+    Dynamic_Array<Module_Cache_Block> cached_blocks = {};
+    Dynamic_Array<Parsed_Expression>  expressions   = {};
+    Dynamic_Array<Expression>         order         = {};
+    Dynamic_Array<Block_Comment>      comments      = {};
+    Dynamic_Array<u32>                lists         = {};
+    Table(u32, u32, hash_u32) identifier_index = {};
+    Defer(free_heap_array(&identifiers));
+    Defer(free_heap_array(&imports));
+    Defer(free_heap_array(&blocks));
+    Defer(free_heap_array(&cached_blocks));
+    Defer(free_heap_array(&expressions));
+    Defer(free_heap_array(&order));
+    Defer(free_heap_array(&comments));
+    Defer(free_heap_array(&lists));
+    Defer(free_table(&identifier_index));
+
+    bool ok = true;
+    auto encode_token = [&](Token* token)
+    {
+        if (token->atom == ATOM_INVALID) return;  // e.g. return declarations don't have a name
+
+        u32 first, end;
+             if (token->atom == ATOM_NUMBER_LITERAL) first = range->first_number, end = range->end_number;
+        else if (token->atom == ATOM_STRING_LITERAL) first = range->first_string, end = range->end_string;
+        else                                         first = range->first_other,  end = range->end_other;
+        if (token->info_index < first || token->info_index >= end) { ok = false; return; }
+        token->info_index -= first;
+
+        if (is_identifier(token->atom))
+        {
+            u32 atom = token->atom;
+            u32 index;
+            if (!get(&identifier_index, &atom, &index))
+            {
+                index = identifiers.count;
+                set(&identifier_index, &atom, &index);
+                *reserve_item(&identifiers) = get_identifier(ctx, token);
+            }
+            token->atom = (Atom)(ATOM_FIRST_IDENTIFIER + index);
+        }
+    };
+
+    auto add_block = [&](Block* block) -> u32
+    {
+        u32 index = blocks.count;
+        add_item(&blocks, &block);
+        return index;
+    };
+
+    add_block(top_level);
+    for (umm block_i = 0; block_i < blocks.count && ok; block_i++)
+    {
+        Block* block = blocks[block_i];
+        Module_Cache_Block* cached = reserve_item(&cached_blocks);
+        cached->flags            = block->flags;
+        cached->from             = block->from;
+        cached->to               = block->to;
+        cached->first_expression = expressions.count;
+        cached->expression_count = block->parsed_expressions.count;
+        cached->first_order      = order.count;
+        cached->order_count      = block->imperative_order.count;
+        cached->first_comment    = comments.count;
+        cached->comment_count    = block->comments.count;
+        encode_token(&cached->from);
+        encode_token(&cached->to);
+
+        For (block->imperative_order)
+            *reserve_item(&order) = *it;
+
+        For (block->comments)
+        {
+            Block_Comment* comment = reserve_item(&comments);
+            *comment = *it;
+            encode_token(&comment->token);
+        }
+
+        For (block->parsed_expressions)
+        {
+            Parsed_Expression* expr = reserve_item(&expressions);
+            *expr = *it;
+            for_each_token(expr, encode_token);
+
+            auto encode_list = [&](Expression_List const** list_ptr)
+            {
+                Expression_List const* list = *list_ptr;
+                umm offset = lists.count;
+                *reserve_item(&lists) = list->count;
+                for (umm i = 0; i < list->count; i++)
+                    *reserve_item(&lists) = list->expressions[i];
+                *list_ptr = (Expression_List const*) offset;
+            };
+
+            if (expr->kind == EXPRESSION_CALL)  encode_list(&expr->call.arguments);
+            if (expr->kind == EXPRESSION_YIELD) encode_list(&expr->yield_assignments);
+            if (expr->kind == EXPRESSION_BLOCK || expr->kind == EXPRESSION_UNIT)
+            {
+                umm index;
+                if (expr->flags & EXPRESSION_UNIT_IS_IMPORT)
+                {
+                    String import_path = {};
+                    For (ctx->top_level_blocks)
+                        if (it->value == expr->parsed_block)
+                            import_path = it->key;
+                    if (!import_path) { ok = false; break; }
+                    index = imports.count;
+                    add_item(&imports, &import_path);
+                }
+                else
+                {
+                    index = add_block(expr->parsed_block);
+                }
+                expr->parsed_block = (Block*) index;
+            }
+        }
+    }
+
+    if (!ok) return {};
+
+    Dynamic_Array<Module_Cache_String> identifier_strings = {};
+    Dynamic_Array<Module_Cache_String> import_strings     = {};
+    Defer(free_heap_array(&identifier_strings));
+    Defer(free_heap_array(&import_strings));
+    For (identifiers) *reserve_item(&identifier_strings) = w.add_string(*it);
+    For (imports)     *reserve_item(&import_strings)     = w.add_string(*it);
+
+    Dynamic_Array<Fraction> number_values = {};
+    Defer(free_heap_array(&number_values));
+    Array<Token_Info_Number> numbers = allocate_array<Token_Info_Number>(temp, range->end_number - range->first_number);
+    for (umm i = 0; i < numbers.count; i++)
+    {
+        Token_Info_Number* info = &numbers[i];
+        *info = ctx->token_info_number[range->first_number + i];
+        info->source_index = 0;
+
+        // Compact literals are built again when they are needed.
+        if (info->exponent_base)
+        {
+            info->value_index = 0;
+            continue;
+        }
+
+        Fraction* value = reserve_item(&number_values);
+        *value = ctx->number_values[info->value_index - 1];
+        info->value_index = number_values.count;
+        if (!value->small_den)
+        {
+            Integer* parts[] = { &value->num, &value->den };
+            for (Integer* part : parts)
+            {
+                part->digit    = (u32*) w.add_blob(part->digit, part->size * sizeof(u32));
+                part->capacity = part->size;
+            }
+        }
+    }
+
+    Array<Token_Info_String> strings = allocate_array<Token_Info_String>(temp, range->end_string - range->first_string);
+    for (umm i = 0; i < strings.count; i++)
+    {
+        Token_Info_String* info = &strings[i];
+        *info = ctx->token_info_string[range->first_string + i];
+        info->source_index = 0;
+        info->value.data = (u8*) w.add_blob(info->value.data, info->value.length);
+    }
+
+    Array<u32> line_offsets = ctx->sources[range->source_index].line_offsets;
+
+    w.add_section(&header.identifiers,  identifier_strings.address, sizeof(Module_Cache_String), identifier_strings.count);
+    w.add_section(&header.imports,      import_strings.address,     sizeof(Module_Cache_String), import_strings.count);
+    w.add_section(&header.line_offsets, line_offsets.address,       sizeof(u32),                 line_offsets.count);
+    w.add_section(&header.info_other,   ctx->token_info_other.address + range->first_other, sizeof(Token_Info), range->end_other - range->first_other);
+    w.add_section(&header.info_number,  numbers.address,            sizeof(Token_Info_Number),   numbers.count);
+    w.add_section(&header.number_values, number_values.address,     sizeof(Fraction),            number_values.count);
+    w.add_section(&header.info_string,  strings.address,            sizeof(Token_Info_String),   strings.count);
+    w.add_section(&header.blocks,       cached_blocks.address,      sizeof(Module_Cache_Block),  cached_blocks.count);
+    w.add_section(&header.expressions,  expressions.address,        sizeof(Parsed_Expression),   expressions.count);
+    w.add_section(&header.order,        order.address,              sizeof(Expression),          order.count);
+    w.add_section(&header.comments,     comments.address,           sizeof(Block_Comment),       comments.count);
+    w.add_section(&header.lists,        lists.address,              sizeof(u32),                 lists.count);
+
+    String blob = resolve_to_string_and_free(&w.blob, temp);
+    w.add_section(&header.blob, blob.data, 1, blob.length);
+
+    String image = resolve_to_string_and_free(&w.cat, memory);
+    memcpy(image.data, &header, sizeof(header));
+    return image;
+}
+
+static void evict_cached_modules(Compiler* ctx)
+{
+    struct Cache_Entry
+    {
+        u64    last_used;
+        u64    size;
+        String path;
+    };
+
+    Dynamic_Array<Cache_Entry> entries = {};
+    Defer(free_heap_array(&entries));
+
+    u64 total_size = 0;
+    For (list_files(ctx->module_cache_directory, "funcache"_s))
+    {
+        String path = concatenate_path(temp, ctx->module_cache_directory, *it);
+        struct stat st;
+        if (stat(make_c_style_string(path), &st) != 0) continue;
+
+        Cache_Entry* entry = reserve_item(&entries);
+        entry->last_used = (u64) st.st_mtim.tv_sec * 1000000000ull + (u64) st.st_mtim.tv_nsec;
+        entry->size      = st.st_size;
+        entry->path      = path;
+        total_size += entry->size;
+    }
+    if (total_size <= MODULE_CACHE_MAX_SIZE) return;
+
+    // Another process might be evicting at the same time, so failing to delete is fine.
+    radix_sort<Cache_Entry, u64, &Cache_Entry::last_used>(entries.address, entries.count);
+    for (umm i = 0; i < entries.count && total_size > MODULE_CACHE_MAX_SIZE; i++)
+    {
+        delete_file(entries[i].path);
+        total_size -= entries[i].size;
+    }
+}
+
+void save_cached_module(Compiler* ctx, String path, String code, Block* top_level, Module_Cache_Token_Range const* range)
+{
+    String file = write_module_image(ctx, top_level, range, temp);
+    if (!file) return;
+
+    Module_Cache_Header* header = (Module_Cache_Header*) file.data;
+    header->key = get_module_key(ctx, path, code);
+
+    // Write to a temporary file first, so concurrent readers never see a partial file.
+    create_directory_recursive(ctx->module_cache_directory);
+    String cache_path = get_module_cache_path(ctx, header->key);
+    String temp_path  = Format(temp, "%.%.tmp", cache_path, (u64) getpid());
+    if (!write_entire_file(temp_path, file) || !move_file(cache_path, temp_path))
+        delete_file(temp_path);
+
+    evict_cached_modules(ctx);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Loading
+////////////////////////////////////////////////////////////////////////////////
+
+
+Block* load_cached_module(Compiler* ctx, String path, String code)
+{
+    SHA256 key = get_module_key(ctx, path, code);
+    String cache_path = get_module_cache_path(ctx, key);
+
+    int fd = open(make_c_style_string(cache_path), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    Defer(close_file_descriptor(fd));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Module_Cache_Header))
+        return NULL;
+    umm size = st.st_size;
+
+    // Mapped privately, the mapping stays alive for the rest of the process because the
+    // parsed blocks and token infos point into it.
+    byte* base = (byte*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) return NULL;
+
+    Module_Cache_Header* header = (Module_Cache_Header*) base;
+    umm sources_before = ctx->sources.count;
+    Block* block = NULL;
+    if (header->key == key)
+        block = read_module_image(ctx, path, code, { size, base });
+    if (!block)
+    {
+        // Once the source is registered, its token infos point into the mapping.
+        if (ctx->sources.count == sources_before)
+            munmap(base, size);
+        return NULL;
+    }
+
+    // Marks the file as recently used, see evict_cached_modules.
+    futimens(fd, NULL);
+
+    ctx->count_cached_modules++;
+    return block;
+}
+
+Block* read_module_image(Compiler* ctx, String path, String code, String image)
+{
+    byte* base = image.data;
+    umm   size = image.length;
+    if (size < sizeof(Module_Cache_Header)) return NULL;
+
+    Module_Cache_Header* header = (Module_Cache_Header*) base;
+    if (header->magic   != MODULE_CACHE_MAGIC)   return NULL;
+    if (header->version != MODULE_CACHE_VERSION) return NULL;
+
+    auto section = [&]<typename T>(Module_Cache_Section const* s, T** out) -> bool
+    {
+        if (s->offset % alignof(T)) return false;
+        if (s->offset > size || s->count > (size - s->offset) / sizeof(T)) return false;
+        *out = (T*)(base + s->offset);
+        return true;
+    };
+
+    Module_Cache_String* identifiers;
+    Module_Cache_String* imports;
+    u32*                 line_offsets;
+    Token_Info*          info_other;
+    Token_Info_Number*   info_number;
+    Fraction*            number_values;
+    Token_Info_String*   info_string;
+    Module_Cache_Block*  blocks;
+    Parsed_Expression*   expressions;
+    Expression*          order;
+    Block_Comment*       comments;
+    u32*                 lists;
+    u8*                  blob;
+    if (!section(&header->identifiers,   &identifiers))   return NULL;
+    if (!section(&header->imports,       &imports))       return NULL;
+    if (!section(&header->line_offsets,  &line_offsets))  return NULL;
+    if (!section(&header->info_other,    &info_other))    return NULL;
+    if (!section(&header->info_number,   &info_number))   return NULL;
+    if (!section(&header->number_values, &number_values)) return NULL;
+    if (!section(&header->info_string,   &info_string))   return NULL;
+    if (!section(&header->blocks,        &blocks))        return NULL;
+    if (!section(&header->expressions,   &expressions))   return NULL;
+    if (!section(&header->order,         &order))         return NULL;
+    if (!section(&header->comments,      &comments))      return NULL;
+    if (!section(&header->lists,         &lists))         return NULL;
+    if (!section(&header->blob,          &blob))          return NULL;
+    if (!header->blocks.count)                            return NULL;
+
+    // Everything is validated before anything is registered, so a corrupt file is only a cache miss.
+    auto in_blob = [&](u64 offset, u64 length) -> bool
+    {
+        return offset <= header->blob.count && length <= header->blob.count - offset;
+    };
+
+    auto in_code = [&](Token_Info const* info) -> bool
+    {
+        return info->offset <= code.length && info->length <= code.length - info->offset;
+    };
+
+    Array<String> identifier_strings = allocate_array<String>(temp, header->identifiers.count);
+    for (umm i = 0; i < identifier_strings.count; i++)
+    {
+        if (!in_blob(identifiers[i].offset, identifiers[i].length)) return NULL;
+        identifier_strings[i] = { identifiers[i].length, blob + identifiers[i].offset };
+    }
+
+    Array<String> import_strings = allocate_array<String>(temp, header->imports.count);
+    for (umm i = 0; i < import_strings.count; i++)
+    {
+        if (!in_blob(imports[i].offset, imports[i].length)) return NULL;
+        import_strings[i] = { imports[i].length, blob + imports[i].offset };
+    }
+
+    if (!header->line_offsets.count || line_offsets[0] != 0) return NULL;
+    for (umm i = 1; i < header->line_offsets.count; i++)
+        if (line_offsets[i] < line_offsets[i - 1] || line_offsets[i] > code.length)
+            return NULL;
+
+    for (umm i = 0; i < header->info_other.count; i++)
+        if (!in_code(&info_other[i]))
+            return NULL;
+
+    for (umm i = 0; i < header->info_number.count; i++)
+        if (!in_code(&info_number[i]) || info_number[i].value_index > header->number_values.count)
+            return NULL;
+
+    for (umm i = 0; i < header->number_values.count; i++)
+    {
+        Fraction* value = &number_values[i];
+        if (value->small_den) continue;
+        Integer* parts[] = { &value->num, &value->den };
+        for (Integer* part : parts)
+            if (part->size > header->blob.count / sizeof(u32) || !in_blob((umm) part->digit, part->size * sizeof(u32)))
+                return NULL;
+    }
+
+    for (umm i = 0; i < header->info_string.count; i++)
+        if (!in_code(&info_string[i]) || !in_blob((umm) info_string[i].value.data, info_string[i].value.length))
+            return NULL;
+
+    auto valid_token = [&](Token const* token) -> bool
+    {
+        if (token->atom == ATOM_INVALID) return true;
+        if (token->atom == ATOM_NUMBER_LITERAL) return token->info_index < header->info_number.count;
+        if (token->atom == ATOM_STRING_LITERAL) return token->info_index < header->info_string.count;
+        if (token->info_index >= header->info_other.count) return false;
+        return !is_identifier(token->atom) || token->atom - ATOM_FIRST_IDENTIFIER < header->identifiers.count;
+    };
+
+    // Blocks are written back to back, so their ranges follow each other and cover the sections.
+    u64 end_expression = 0, end_order = 0, end_comment = 0;
+    auto valid_range = [&](u64 first, u64 count, Module_Cache_Section const* s, u64* end) -> bool
+    {
+        if (first != *end || count > s->count - first) return false;
+        *end += count;
+        return true;
+    };
+
+    auto valid_list = [&](Expression_List const* list, u64 expression_count) -> bool
+    {
+        umm offset = (umm) list;
+        if (offset >= header->lists.count || lists[offset] > header->lists.count - offset - 1) return false;
+        for (umm i = 0; i < lists[offset]; i++)
+            if (lists[offset + 1 + i] >= expression_count)
+                return false;
+        return true;
+    };
+
+    String imports_relative_to = get_parent_directory_path(path);
+    if (!imports_relative_to) imports_relative_to = "."_s;
+
+    for (umm i = 0; i < header->blocks.count; i++)
+    {
+        Module_Cache_Block* cached = &blocks[i];
+        if (!valid_token(&cached->from) || !valid_token(&cached->to)) return NULL;
+        if (!valid_range(cached->first_expression, cached->expression_count, &header->expressions, &end_expression)) return NULL;
+        if (!valid_range(cached->first_order,      cached->order_count,      &header->order,       &end_order))      return NULL;
+        if (!valid_range(cached->first_comment,    cached->comment_count,    &header->comments,    &end_comment))    return NULL;
+
+        u64 count = cached->expression_count;
+        auto child = [&](Expression id, bool optional = false)
+        {
+            return id < count || (optional && id == NO_EXPRESSION);
+        };
+
+        for (umm j = 0; j < cached->order_count; j++)
+            if (!child(order[cached->first_order + j]))
+                return NULL;
+
+        for (umm j = 0; j < cached->comment_count; j++)
+        {
+            Block_Comment* comment = &comments[cached->first_comment + j];
+            if (!valid_token(&comment->token) || !child(comment->relative_to, true)) return NULL;
+        }
+
+        for (umm j = 0; j < count; j++)
+        {
+            Parsed_Expression* expr = &expressions[cached->first_expression + j];
+            if (expr->kind >= COUNT_EXPRESSIONS) return NULL;
+
+            bool ok = true;
+            for_each_token(expr, [&](Token* token) { ok &= valid_token(token); });
+            if (!ok) return NULL;
+
+            switch (expr->kind)
+            {
+            case EXPRESSION_MEMBER:
+            case EXPRESSION_NOT:
+            case EXPRESSION_NEGATE:
+            case EXPRESSION_ADDRESS:
+            case EXPRESSION_DEREFERENCE:
+            case EXPRESSION_SIZEOF:
+            case EXPRESSION_ALIGNOF:
+            case EXPRESSION_CODEOF:
+            case EXPRESSION_DEBUG:
+            case EXPRESSION_DEBUG_ALLOC:
+            case EXPRESSION_DEBUG_FREE:
+            case EXPRESSION_RUN:
+                ok = child(expr->unary_operand);
+                break;
+            case EXPRESSION_ASSIGNMENT:
+            case EXPRESSION_ADD:
+            case EXPRESSION_SUBTRACT:
+            case EXPRESSION_MULTIPLY:
+            case EXPRESSION_DIVIDE_WHOLE:
+            case EXPRESSION_DIVIDE_FRACTIONAL:
+            case EXPRESSION_POINTER_ADD:
+            case EXPRESSION_POINTER_SUBTRACT:
+            case EXPRESSION_EQUAL:
+            case EXPRESSION_NOT_EQUAL:
+            case EXPRESSION_GREATER_THAN:
+            case EXPRESSION_GREATER_OR_EQUAL:
+            case EXPRESSION_LESS_THAN:
+            case EXPRESSION_LESS_OR_EQUAL:
+            case EXPRESSION_AND:
+            case EXPRESSION_OR:
+            case EXPRESSION_CAST:
+            case EXPRESSION_GOTO_UNIT:
+                ok = child(expr->binary.lhs) && child(expr->binary.rhs);
+                break;
+            case EXPRESSION_BRANCH:
+                ok = child(expr->branch.condition) && child(expr->branch.on_success) && child(expr->branch.on_failure, true);
+                break;
+            case EXPRESSION_DECLARATION:
+                ok = child(expr->declaration.type, true) && child(expr->declaration.value, true);
+                break;
+            case EXPRESSION_CALL:
+                ok = child(expr->call.lhs) && valid_list(expr->call.arguments, count);
+                break;
+            case EXPRESSION_YIELD:
+                ok = valid_list(expr->yield_assignments, count);
+                break;
+            case EXPRESSION_BLOCK:
+            case EXPRESSION_UNIT:
+            {
+                umm index = (umm) expr->parsed_block;
+                if (!(expr->flags & EXPRESSION_UNIT_IS_IMPORT))
+                {
+                    ok = index < header->blocks.count;
+                    break;
+                }
+                if (index >= header->imports.count || expr->to.atom != ATOM_STRING_LITERAL)
+                    return NULL;
+
+                // Imports are resolved again, because a module might resolve to another file now.
+                String written = { info_string[expr->to.info_index].value.length,
+                                   blob + (umm) info_string[expr->to.info_index].value.data };
+                ok = (resolve_import(ctx, imports_relative_to, written) == import_strings[index]);
+            } break;
+            default: break;
+            }
+            if (!ok) return NULL;
+        }
+    }
+
+    if (end_expression != header->expressions.count) return NULL;
+    if (end_order      != header->order.count)       return NULL;
+    if (end_comment    != header->comments.count)    return NULL;
+    if (ctx->sources.count > U16_MAX) return NULL;
+
+    lex_init(ctx);
+
+    // Register the source and token infos.
+    u16 source_index = ctx->sources.count;
+    Source_Info* source = reserve_item(&ctx->sources);
+    ZeroStruct(source);
+    source->path = path;
+    source->name = allocate_string(&ctx->lexer_memory, get_file_name(path));
+    source->code = code;
+    source->line_offsets = { header->line_offsets.count, line_offsets };
+
+    u32 first_other  = ctx->token_info_other .count;
+    u32 first_number = ctx->token_info_number.count;
+    u32 first_value  = ctx->number_values.count;
+    u32 first_string = ctx->token_info_string.count;
+
+    for (umm i = 0; i < header->info_other.count; i++)
+    {
+        Token_Info* info = reserve_item(&ctx->token_info_other);
+        *info = info_other[i];
+        info->source_index = source_index;
+    }
+
+    for (umm i = 0; i < header->info_number.count; i++)
+    {
+        Token_Info_Number* info = reserve_item(&ctx->token_info_number);
+        *info = info_number[i];
+        info->source_index = source_index;
+        if (info->value_index)
+            info->value_index += first_value;
+    }
+
+    for (umm i = 0; i < header->number_values.count; i++)
+    {
+        Fraction* value = reserve_item(&ctx->number_values);
+        *value = number_values[i];
+        if (!value->small_den)
+        {
+            // Digits point into the mapping, token values are never modified or freed.
+            value->num.digit = (u32*)(blob + (umm) value->num.digit);
+            value->den.digit = (u32*)(blob + (umm) value->den.digit);
+        }
+    }
+
+    for (umm i = 0; i < header->info_string.count; i++)
+    {
+        Token_Info_String* info = reserve_item(&ctx->token_info_string);
+        *info = info_string[i];
+        info->source_index = source_index;
+        info->value.data = blob + (umm) info->value.data;
+    }
+
+    Array<Atom> atoms = allocate_array<Atom>(temp, identifier_strings.count);
+    intern_identifiers(&ctx->atoms, identifier_strings, atoms.address);
+
+    auto decode_token = [&](Token* token)
+    {
+        if (token->atom == ATOM_INVALID) return;
+             if (token->atom == ATOM_NUMBER_LITERAL) token->info_index += first_number;
+        else if (token->atom == ATOM_STRING_LITERAL) token->info_index += first_string;
+        else                                         token->info_index += first_other;
+        if (is_identifier(token->atom))
+            token->atom = atoms[token->atom - ATOM_FIRST_IDENTIFIER];
+    };
+
+    // Allocate all blocks first, expressions refer to them by index.
+    Array<Block*> parsed_blocks = allocate_array<Block*>(temp, header->blocks.count);
+    For (parsed_blocks)
+    {
+        *it = alloc<Block>(&ctx->parser_memory);
+        ctx->count_parsed_blocks++;
+    }
+
+    // Register the top level block before resolving imports, to support cyclic imports.
+    Block* top_level = parsed_blocks[0];
+    String canonical_name = allocate_string(&ctx->parser_memory, path);
+    set(&ctx->top_level_blocks, &canonical_name, &top_level);
+
+    Array<Block*> imported_blocks = allocate_array<Block*>(temp, header->imports.count);
+    for (umm i = 0; i < imported_blocks.count; i++)
+    {
+        String import_path = allocate_string(&ctx->parser_memory, import_strings[i]);
+        imported_blocks[i] = parse_top_level_from_file(ctx, import_path);
+        if (!imported_blocks[i])
+            return NULL;
+    }
+
+    for (umm i = 0; i < header->blocks.count; i++)
+    {
+        Module_Cache_Block* cached = &blocks[i];
+        Block* block = parsed_blocks[i];
+        block->flags = cached->flags;
+        block->from  = cached->from;
+        block->to    = cached->to;
+        decode_token(&block->from);
+        decode_token(&block->to);
+
+        Parsed_Expression* block_expressions = expressions + cached->first_expression;
+        for (umm j = 0; j < cached->expression_count; j++)
+        {
+            Parsed_Expression* expr = &block_expressions[j];
+            for_each_token(expr, decode_token);
+
+            if (expr->kind == EXPRESSION_CALL)
+                expr->call.arguments = (Expression_List const*)(lists + (umm) expr->call.arguments);
+            if (expr->kind == EXPRESSION_YIELD)
+                expr->yield_assignments = (Expression_List const*)(lists + (umm) expr->yield_assignments);
+            if (expr->kind == EXPRESSION_BLOCK || expr->kind == EXPRESSION_UNIT)
+            {
+                umm index = (umm) expr->parsed_block;
+                expr->parsed_block = (expr->flags & EXPRESSION_UNIT_IS_IMPORT)
+                                   ? imported_blocks[index]
+                                   : parsed_blocks[index];
+            }
+
+            ctx->count_parsed_expressions++;
+            ctx->count_parsed_expressions_by_kind[expr->kind]++;
+        }
+
+        block->parsed_expressions = { cached->expression_count, block_expressions };
+        block->imperative_order   = { cached->order_count, order + cached->first_order };
+
+        Block_Comment* block_comments = comments + cached->first_comment;
+        for (umm j = 0; j < cached->comment_count; j++)
+            decode_token(&block_comments[j].token);
+        block->comments = { cached->comment_count, block_comments };
+        ctx->count_parsed_comments += cached->comment_count;
+        build_parsed_columns(&ctx->parser_memory, block);
+    }
+
+    return top_level;
+}
+
+
+ExitApplicationNamespace
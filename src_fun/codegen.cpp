@@ -0,0 +1,126 @@
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+
+EnterApplicationNamespace
+
+
+// :ParallelCodegen
+// With backend_threads > 1, units which are ready to be placed (or patched) at the same time are
+// generated on a pool of worker threads. Once its blocks are inferred, generating a unit only reads
+// its own blocks and the sizes of types which are already placed, and only writes into the unit,
+// so units don't have to wait for each other.
+//
+// The pumping thread hands out a batch, generates units from it too, and waits until the workers
+// report that the whole batch is done. Nothing else happens in the pipeline meanwhile, so nothing
+// changes under the workers. Everything that goes beyond the unit (counts and reports) is done on
+// the pumping thread afterwards, in the same order as without workers, see finish_bytecode_for_*.
+//
+// The pool lives as long as the compiler, finish_codegen stops the workers and frees it.
+
+struct Codegen_Pool
+{
+    Lock      lock;
+    Semaphore work;  // posted once for each worker which should help with the batch
+    Semaphore done;  // posted by a worker when there's nothing left in the batch for it
+
+    umm           worker_count;
+    Array<Thread> threads;
+    bool          quit;  // set by finish_codegen before it wakes up the workers
+
+    Array<Unit*> batch;
+    void(*generate)(Unit*);
+    umm next_unit;
+};
+
+static void generate_batch(Codegen_Pool* pool)
+{
+    while (true)
+    {
+        Unit* unit = NULL;
+        acquire(&pool->lock);
+        if (pool->next_unit < pool->batch.count)
+            unit = pool->batch[pool->next_unit++];
+        release(&pool->lock);
+        if (!unit) return;
+
+        pool->generate(unit);
+    }
+}
+
+static void codegen_worker(void* userdata)
+{
+    Codegen_Pool* pool = (Codegen_Pool*) userdata;
+    while (true)
+    {
+        wait(&pool->work);
+        if (pool->quit) return;
+        generate_batch(pool);
+        post(&pool->done);
+    }
+}
+
+void generate_bytecode_for_units(Compiler* ctx, Array<Unit*> units, void(*generate)(Unit*))
+{
+    // The IR is dumped while it's generated, so it has to be generated in order.
+    if (ctx->backend_threads <= 1 || units.count < 2 || ctx->dump_ir)
+    {
+        For (units)
+            generate(*it);
+        return;
+    }
+
+    Codegen_Pool* pool = ctx->codegen;
+    if (!pool)
+    {
+        // The pumping thread generates units too, so it counts as one of the threads.
+        pool = alloc<Codegen_Pool>(NULL);
+        pool->worker_count = ctx->backend_threads - 1;
+        pool->threads = allocate_array<Thread>(NULL, pool->worker_count);
+        make_lock(&pool->lock);
+        make_semaphore(&pool->work);
+        make_semaphore(&pool->done);
+        For (pool->threads)
+            spawn_thread("codegen"_s, pool, codegen_worker, it);
+        ctx->codegen = pool;
+    }
+
+    pool->batch     = units;
+    pool->generate  = generate;
+    pool->next_unit = 0;
+
+    umm helpers = pool->worker_count;
+    if (helpers > units.count - 1)
+        helpers = units.count - 1;
+    for (umm i = 0; i < helpers; i++)
+        post(&pool->work);
+
+    generate_batch(pool);
+    for (umm i = 0; i < helpers; i++)
+        wait(&pool->done);
+
+    ctx->count_parallel_codegen_batches++;
+}
+
+void finish_codegen(Compiler* ctx)
+{
+    Codegen_Pool* pool = ctx->codegen;
+    if (!pool) return;
+    ctx->codegen = NULL;
+
+    // Batches are finished before generate_bytecode_for_units returns, so all workers are waiting.
+    pool->quit = true;
+    for (umm i = 0; i < pool->worker_count; i++)
+        post(&pool->work);
+    For (pool->threads) wait(it);
+    free_heap_array(&pool->threads);
+
+    free_lock(&pool->lock);
+    free_semaphore(&pool->work);
+    free_semaphore(&pool->done);
+    free(pool);
+}
+
+
+ExitApplicationNamespace
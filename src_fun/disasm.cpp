@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+
+EnterApplicationNamespace
+
+
+String get_operation_name(Bytecode_Operation op)
+{
+    switch (op)
+    {
+    case INVALID_OP:                return "INVALID_OP"_s;
+    case OP_ZERO:                   return "OP_ZERO"_s;
+    case OP_ZERO_INDIRECT:          return "OP_ZERO_INDIRECT"_s;
+    case OP_LITERAL:                return "OP_LITERAL"_s;
+    case OP_COPY:                   return "OP_COPY"_s;
+    case OP_COPY_FROM_INDIRECT:     return "OP_COPY_FROM_INDIRECT"_s;
+    case OP_COPY_TO_INDIRECT:       return "OP_COPY_TO_INDIRECT"_s;
+    case OP_COPY_BETWEEN_INDIRECT:  return "OP_COPY_BETWEEN_INDIRECT"_s;
+    case OP_ADDRESS:                return "OP_ADDRESS"_s;
+    case OP_NOT:                    return "OP_NOT"_s;
+    case OP_NEGATE:                 return "OP_NEGATE"_s;
+    case OP_ADD:                    return "OP_ADD"_s;
+    case OP_SUBTRACT:               return "OP_SUBTRACT"_s;
+    case OP_MULTIPLY:               return "OP_MULTIPLY"_s;
+    case OP_DIVIDE_WHOLE:           return "OP_DIVIDE_WHOLE"_s;
+    case OP_DIVIDE_FRACTIONAL:      return "OP_DIVIDE_FRACTIONAL"_s;
+    case OP_COMPARE:                return "OP_COMPARE"_s;
+    case OP_ADD_IMMEDIATE:          return "OP_ADD_IMMEDIATE"_s;
+    case OP_SUBTRACT_IMMEDIATE:     return "OP_SUBTRACT_IMMEDIATE"_s;
+    case OP_MULTIPLY_IMMEDIATE:     return "OP_MULTIPLY_IMMEDIATE"_s;
+    case OP_COMPARE_IMMEDIATE:      return "OP_COMPARE_IMMEDIATE"_s;
+    case OP_MOVE_POINTER_CONSTANT:  return "OP_MOVE_POINTER_CONSTANT"_s;
+    case OP_MOVE_POINTER_FORWARD:   return "OP_MOVE_POINTER_FORWARD"_s;
+    case OP_MOVE_POINTER_BACKWARD:  return "OP_MOVE_POINTER_BACKWARD"_s;
+    case OP_MOVE_POINTER_IMMEDIATE: return "OP_MOVE_POINTER_IMMEDIATE"_s;
+    case OP_POINTER_DISTANCE:       return "OP_POINTER_DISTANCE"_s;
+    case OP_CAST:                   return "OP_CAST"_s;
+    case OP_GOTO:                   return "OP_GOTO"_s;
+    case OP_GOTO_IF_FALSE:          return "OP_GOTO_IF_FALSE"_s;
+    case OP_GOTO_INDIRECT:          return "OP_GOTO_INDIRECT"_s;
+    case OP_CALL:                   return "OP_CALL"_s;
+    case OP_SWITCH_UNIT:            return "OP_SWITCH_UNIT"_s;
+    case OP_FINISH_UNIT:            return "OP_FINISH_UNIT"_s;
+    case OP_INTRINSIC:              return "OP_INTRINSIC"_s;
+    case OP_DEBUG_PRINT:            return "OP_DEBUG_PRINT"_s;
+    case OP_DEBUG_ALLOC:            return "OP_DEBUG_ALLOC"_s;
+    case OP_DEBUG_FREE:             return "OP_DEBUG_FREE"_s;
+    case COUNT_OPS:                 break;
+    }
+    return "<invalid op>"_s;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Disassembly
+
+
+// :DumpBytecode
+// With -dump_bytecode, every unit is disassembled once it's compiled. That's after the IR passes,
+// so -no_ir_passes shows the code as it was generated. Storage operands are named after what's
+// placed there, the source line is printed above the code generated from it, and operands which
+// were patched say what they were patched to. Once the program is done, print_bytecode_summary
+// prints the totals for each unit and each operation.
+
+struct Storage_Name
+{
+    u64    offset;
+    u64    size;
+    String name;
+};
+
+struct Disassembly
+{
+    Unit*     unit;
+    Compiler* ctx;
+
+    Dynamic_Array<Block*>       blocks;
+    Table(u64, umm, hash_u64)   block_indices;  // block pointer -> index in blocks
+    Dynamic_Array<Storage_Name> names;
+    Table(u64, bool, hash_u64)  patched;        // block index in the high half, expression in the low half
+};
+
+static u64 get_patch_key(Disassembly* dis, Block* block, Expression expression)
+{
+    u64 block_key = (u64)(umm) block;
+    umm block_index;
+    if (!get(&dis->block_indices, &block_key, &block_index))
+        return U64_MAX;
+    return ((u64) block_index << 32) | (u64) expression;
+}
+
+static void collect_blocks(Disassembly* dis, Block* block)
+{
+    u64 key = (u64)(umm) block;
+    umm index = dis->blocks.count;
+    if (get(&dis->block_indices, &key, &index)) return;
+    set(&dis->block_indices, &key, &index);
+    add_item(&dis->blocks, &block);
+
+    for (umm i = 0; i < block->inferred_expressions.count; i++)
+        if (Block* called = block->inferred_expressions[i].called_block)
+            collect_blocks(dis, called);
+}
+
+static void collect_storage_names(Disassembly* dis)
+{
+    Unit*     unit = dis->unit;
+    Compiler* ctx  = dis->ctx;
+    auto add_name = [&](u64 offset, u64 size, String name)
+    {
+        Storage_Name storage_name = { offset, size, name };
+        add_item(&dis->names, &storage_name);
+    };
+
+    add_name(0, 3 * sizeof(void*), "unit_return"_s);
+    For (dis->blocks)
+    {
+        Block* block = *it;
+        if (block != unit->entry_block && (block->flags & BLOCK_HAS_BEEN_GENERATED))
+        {
+            u32 line;
+            get_line(ctx, get_token_info(ctx, &block->from), &line);
+            add_name(block->return_address_offset, sizeof(umm), Format(temp, "return_of_block_%", line));
+        }
+
+        for (auto* placement : block->declaration_placement)
+        {
+            Expression id = placement->key;
+            Type type = block->inferred_expressions[id].type;
+            u64  size = get_type_size(unit, type);
+            Atom atom = block->parsed_names[id];
+
+            // Return declarations don't have a name, but the members of their type do,
+            // so those come first, and the declaration is only named where they don't cover it.
+            bool is_return = block->parsed_flags[id] & EXPRESSION_DECLARATION_IS_RETURN;
+            if (is_return && is_user_defined_type(type))
+            {
+                Block* members = get_user_type_data(unit->env, type)->unit->entry_block;
+                for (auto* member : members->declaration_placement)
+                {
+                    Atom member_atom = members->parsed_names[member->key];
+                    if (!is_identifier(member_atom)) continue;
+                    u64 member_size = get_type_size(unit, members->inferred_expressions[member->key].type);
+                    add_name(placement->value + member->value, member_size, get_identifier(&ctx->atoms, member_atom));
+                }
+            }
+
+            String name = is_identifier(atom) ? get_identifier(&ctx->atoms, atom)
+                        : is_return            ? "return"_s
+                        : Format(temp, "declaration_%", (u32) id);
+            add_name(placement->value, size, name);
+        }
+    }
+
+    For (unit->temporary_storage)
+        add_name(it->offset, it->size, "tmp"_s);
+}
+
+static void print_location(Disassembly* dis, u64 offset)
+{
+    For (dis->names)
+    {
+        if (offset < it->offset || offset >= it->offset + it->size) continue;
+        if (it->name == "tmp"_s)
+            printf("tmp@%llu", (unsigned long long) offset);
+        else if (offset == it->offset)
+            printf("%.*s", StringArgs(it->name));
+        else
+            printf("%.*s+%llu", StringArgs(it->name), (unsigned long long)(offset - it->offset));
+        return;
+    }
+    printf("@%llu", (unsigned long long) offset);
+}
+
+static void print_value(u64 value)
+{
+    if (value < 1000000) printf("#%llu", (unsigned long long) value);
+    else                 printf("#0x%llx", (unsigned long long) value);
+}
+
+static bool has_type_in_s(Bytecode_Operation op)
+{
+    switch (op)
+    {
+    case OP_NEGATE:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE_WHOLE:
+    case OP_DIVIDE_FRACTIONAL:
+    case OP_COMPARE:
+    case OP_ADD_IMMEDIATE:
+    case OP_SUBTRACT_IMMEDIATE:
+    case OP_MULTIPLY_IMMEDIATE:
+    case OP_COMPARE_IMMEDIATE:
+    case OP_CAST:
+    case OP_DEBUG_PRINT:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static void print_patch(Disassembly* dis, Bytecode const* bc, Bytecode const* next)
+{
+    Compiler* ctx   = dis->ctx;
+    Block*    block = bc->generated_from_block;
+    auto*     expr  = &block->parsed_expressions  [bc->generated_from_expression];
+    auto*     infer = &block->inferred_expressions[bc->generated_from_expression];
+
+    printf("  ; patched");
+    if (bc->op == OP_CALL && infer->called_block)
+    {
+        u32 line;
+        get_line(ctx, get_token_info(ctx, &infer->called_block->from), &line);
+        printf(" call to the block at line %u", line);
+    }
+    else if (expr->kind == EXPRESSION_CODEOF && bc->op == OP_LITERAL)
+    {
+        Unit* target = (Unit*) bc->a;
+        String file;
+        u32 line, column;
+        get_line(ctx, get_token_info(ctx, &target->initiator_from), &line, &column, &file);
+        printf(" code of the unit at %.*s:%u:%u", StringArgs(file), line, column);
+    }
+    else if (expr->kind == EXPRESSION_DEBUG && bc->op == OP_LITERAL)
+    {
+        // :PatchDebugPlaceholder, the length comes first and the data right after it
+        if (next && next->op == OP_LITERAL && next->generated_from_block == block &&
+            next->generated_from_expression == bc->generated_from_expression)
+        {
+            String text = { (umm) bc->a, (u8*) next->a };
+            umm shown = text.length < 40 ? text.length : 40;
+            printf(" text \"%.*s\"%s", (int) shown, (char const*) text.data, shown < text.length ? "..." : "");
+        }
+        else printf(" text");
+    }
+    else if (expr->kind == EXPRESSION_DECLARATION)
+        printf(" offset of %.*s", StringArgs(get_identifier(ctx, &expr->declaration.name)));
+    else
+        printf(" constant");
+}
+
+static void print_instruction(Disassembly* dis, umm index)
+{
+    Unit*           unit = dis->unit;
+    Bytecode const* bc   = &unit->bytecode[index];
+    Ir_Effects effects = get_bytecode_effects(unit, bc);
+
+    String name = get_operation_name(bc->op);
+    printf("    %5llu  %-26.*s", (unsigned long long) index, StringArgs(name));
+
+    auto find_operand = [&](char field) -> Ir_Operand*
+    {
+        for (umm i = 0; i < effects.read_count; i++)
+            if (effects.reads[i].field == field)
+                return &effects.reads[i];
+        if (effects.writes && effects.write.field == field)
+            return &effects.write;
+        return NULL;
+    };
+
+    char const fields[] = { 'r', 'a', 'b' };
+    for (char field : fields)
+    {
+        u64 value = field == 'r' ? bc->r : field == 'a' ? bc->a : bc->b;
+        if (Ir_Operand* operand = find_operand(field))
+        {
+            printf(" %c=", field);
+            print_location(dis, operand->range.offset);
+        }
+        else if (field == 'r' && (effects.flags & IR_JUMPS))
+            printf(" r=@%llu", (unsigned long long) value);
+        else if (field == 'a' && bc->op == OP_LITERAL && (bc->flags & OP_A_IS_INSTRUCTION))
+            printf(" a=@%llu", (unsigned long long) value);
+        else if (field == 'a' && bc->op == OP_ADDRESS)
+        {
+            printf(" a=&");
+            print_location(dis, value);
+        }
+        else if (field == 'b' && bc->op == OP_CAST)
+        {
+            String type = exact_type_description(unit, (Type) value);
+            printf(" b=%.*s", StringArgs(type));
+        }
+        else if (bc->op == OP_INTRINSIC)
+        {
+            if (field == 'b')
+                printf(" \"%.*s\"", (int) bc->s, (char const*) value);
+        }
+        else if (value || field == 'a' && bc->op == OP_LITERAL)
+        {
+            printf(" %c=", field);
+            print_value(value);
+        }
+    }
+
+    if (has_type_in_s(bc->op))
+    {
+        String type = exact_type_description(unit, (Type) bc->s);
+        printf(" s=%.*s", StringArgs(type));
+    }
+    else if (bc->s && bc->op != OP_INTRINSIC)
+        printf(" s=%llu", (unsigned long long) bc->s);
+
+    if (bc->flags & OP_COMPARE_EQUAL)   printf(" equal");
+    if (bc->flags & OP_COMPARE_GREATER) printf(" greater");
+    if (bc->flags & OP_COMPARE_LESS)    printf(" less");
+
+    // Only these operations are ever patched, the others just come from the same expression.
+    bool can_be_patched = bc->op == OP_LITERAL || bc->op == OP_CALL || bc->op == OP_ADDRESS ||
+                          bc->op == OP_MOVE_POINTER_CONSTANT || bc->op == OP_MOVE_POINTER_IMMEDIATE ||
+                          bc->op == OP_ADD_IMMEDIATE || bc->op == OP_SUBTRACT_IMMEDIATE ||
+                          bc->op == OP_MULTIPLY_IMMEDIATE || bc->op == OP_COMPARE_IMMEDIATE;
+    u64 key = get_patch_key(dis, bc->generated_from_block, bc->generated_from_expression);
+    if (can_be_patched && get(&dis->patched, &key))
+    {
+        Bytecode const* next = index + 1 < unit->bytecode.count ? &unit->bytecode[index + 1] : NULL;
+        print_patch(dis, bc, next);
+    }
+    printf("\n");
+}
+
+void dump_bytecode(Unit* unit)
+{
+    Compiler* ctx = unit->env->ctx;
+    add_item(&ctx->dumped_units, &unit);
+
+    Disassembly dis = {};
+    dis.unit = unit;
+    dis.ctx  = ctx;
+    Defer(free_heap_array(&dis.blocks));
+    Defer(free_table(&dis.block_indices));
+    Defer(free_heap_array(&dis.names));
+    Defer(free_table(&dis.patched));
+
+    collect_blocks(&dis, unit->entry_block);
+    collect_storage_names(&dis);
+    For (unit->bytecode_patches)
+    {
+        u64 key = get_patch_key(&dis, it->block, it->expression);
+        bool yes = true;
+        set(&dis.patched, &key, &yes);
+    }
+
+    String file;
+    u32 line, column;
+    get_line(ctx, get_token_info(ctx, &unit->initiator_from), &line, &column, &file);
+    printf("[bytecode] %.*s:%u:%u, %llu instructions, %llu bytes of storage, entry at %llu, zeroed entry at %llu\n",
+           StringArgs(file), line, column, (unsigned long long) unit->bytecode.count,
+           (unsigned long long) unit->storage_size, (unsigned long long) unit->entry_block->first_instruction,
+           (unsigned long long) unit->entry_into_zeroed_storage);
+
+    Token_Info const* previous_info = NULL;
+    u32 previous_line = 0;
+    for (umm i = 0; i < unit->bytecode.count; i++)
+    {
+        Bytecode const* bc = &unit->bytecode[i];
+        if (bc->generated_from_block && bc->generated_from_expression != NO_EXPRESSION)
+        {
+            auto* expr = &bc->generated_from_block->parsed_expressions[bc->generated_from_expression];
+            Token_Info const* info = get_token_info(ctx, &expr->from);
+            u32 source_line;
+            get_line(ctx, info, &source_line, NULL, &file);
+            if (!previous_info || previous_info->source_index != info->source_index || previous_line != source_line)
+            {
+                Source_Info* source = &ctx->sources[info->source_index];
+                u32 start = source->line_offsets[source_line - 1];
+                u32 end   = source_line < source->line_offsets.count ? source->line_offsets[source_line] : source->code.length;
+                String text = trim({ end - start, source->code.data + start });
+                printf("           %.*s:%u | %.*s\n", StringArgs(file), source_line, StringArgs(text));
+            }
+            previous_info = info;
+            previous_line = source_line;
+        }
+        print_instruction(&dis, i);
+    }
+    fflush(stdout);
+}
+
+void print_bytecode_summary(Compiler* ctx)
+{
+    umm op_counts[COUNT_OPS] = {};
+    umm total_instructions = 0;
+    u64 total_storage = 0;
+
+    printf("[bytecode] summary of %llu units\n", (unsigned long long) ctx->dumped_units.count);
+    printf("    %-40s %12s %12s %12s %12s\n", "unit", "instructions", "bytes", "storage", "temporaries");
+    For (ctx->dumped_units)
+    {
+        Unit* unit = *it;
+        u64 temporaries = 0;
+        for (umm i = 0; i < unit->temporary_storage.count; i++)
+            temporaries += unit->temporary_storage[i].size;
+        for (umm i = 0; i < unit->bytecode.count; i++)
+            op_counts[unit->bytecode[i].op]++;
+        total_instructions += unit->bytecode.count;
+        total_storage      += unit->storage_size;
+
+        String file;
+        u32 line, column;
+        get_line(ctx, get_token_info(ctx, &unit->initiator_from), &line, &column, &file);
+        String location = Format(temp, "%:%:%", file, line, column);
+        printf("    %-40.*s %12llu %12llu %12llu %12llu\n", StringArgs(location),
+               (unsigned long long) unit->bytecode.count, (unsigned long long)(unit->bytecode.count * sizeof(Bytecode)),
+               (unsigned long long) unit->storage_size, (unsigned long long) temporaries);
+    }
+    printf("    %-40s %12llu %12llu %12llu\n", "total", (unsigned long long) total_instructions,
+           (unsigned long long)(total_instructions * sizeof(Bytecode)), (unsigned long long) total_storage);
+
+    printf("    %-40s %12s %12s\n", "operation", "count", "bytes");
+    for (umm op = 0; op < COUNT_OPS; op++)
+    {
+        if (!op_counts[op]) continue;
+        String name = get_operation_name((Bytecode_Operation) op);
+        printf("    %-40.*s %12llu %12llu\n", StringArgs(name),
+               (unsigned long long) op_counts[op], (unsigned long long)(op_counts[op] * sizeof(Bytecode)));
+    }
+    fflush(stdout);
+}
+
+
+
+ExitApplicationNamespace
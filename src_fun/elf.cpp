@@ -0,0 +1,1336 @@
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+#include <stdio.h>
+#include <elf.h>
+#include <sys/stat.h>
+
+EnterApplicationNamespace
+
+
+// :NativeBackend
+// With -compile:elf, the units which would run (see :BytecodeImage) are translated to x86-64 and
+// written out as a static Linux executable, which needs neither the compiler nor any library.
+//
+// Instructions are selected for one bytecode operation at a time, and operands stay where the
+// bytecode puts them: rbx points at the storage of the running unit. Within an operation, values
+// pass through rax, rcx, rdx, rsi, rdi and xmm0/xmm1.
+//
+// :NativeRegisterCache
+// Between operations, rbp and r12 to r15 keep copies of scalar operands, so an operand which was
+// just written or read doesn't have to be loaded again, and results are computed right into them.
+// Storage is still written through, so it's always up to date, and a copy only has to be forgotten
+// when something else might change the storage under it. That's decided with the same effects the
+// IR passes use (see :BytecodeIr): copies are forgotten when their storage is written by an
+// operation which doesn't update them, when memory is written through a pointer (except for
+// temporaries which don't have their address taken), when the operation runs code we don't see
+// (calls, unit switches, intrinsics), and at every instruction which can be jumped to. Copies are
+// zero extended, signed operands are sign extended out of them. Values are never kept in
+// registers across basic blocks, or instead of storage.
+//
+// Return addresses and the code of units (codeof) are addresses of machine code, instead of
+// instruction indices and Unit pointers. Each run unit gets fresh zeroed pages for its storage and
+// is called from _start, and a unit with nothing to return to ends with ret. The syscall intrinsic
+// is a syscall instruction with its parameters loaded straight from storage, and debug printing
+// is done by a few routines which are written into the executable once.
+//
+// Not supported yet: debug printing floating point values, and f16. Compiler intrinsics can't be
+// supported, there is no compiler at run time.
+
+static constexpr u64 NATIVE_BASE_ADDRESS = 0x400000;
+static constexpr u64 NATIVE_CODE_OFFSET  = sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr);
+
+enum: u8
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8,  R9,  R10, R11, R12, R13, R14, R15,
+};
+
+enum: u8
+{
+    XMM0, XMM1,
+};
+
+static u8 const NATIVE_CACHE_REGISTERS[] = { RBP, R12, R13, R14, R15 };  // see :NativeRegisterCache
+
+struct Native_Cached_Operand
+{
+    bool valid;
+    u64  offset;
+    u64  size;
+    u64  last_used;
+    umm  written_by;  // index of the instruction which wrote it, plus one
+};
+
+// Condition codes, as in jcc and setcc.
+enum: u8
+{
+    CC_B  = 0x2, CC_AE = 0x3, CC_E  = 0x4, CC_NE = 0x5, CC_BE = 0x6, CC_A  = 0x7,
+    CC_S  = 0x8, CC_NS = 0x9, CC_P  = 0xA, CC_NP = 0xB, CC_L  = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+};
+
+enum Native_Helper
+{
+    HELPER_WRITE,           // rsi = data, rdx = length, to stdout
+    HELPER_PRINT_STRING,    // rsi = data, rdx = length, followed by a newline
+    HELPER_PRINT_DECIMAL,   // rax = value, edx = whether it's signed
+    HELPER_PRINT_HEX,       // rax = value, as 16 digits
+    HELPER_CHECK_MMAP,      // rax = what mmap returned, exits if it failed
+
+    COUNT_NATIVE_HELPERS,
+};
+
+enum Native_Target_Kind
+{
+    TARGET_INSTRUCTION,  // of a unit
+    TARGET_HELPER,
+    TARGET_RODATA,
+};
+
+struct Native_Fixup
+{
+    umm                at;
+    bool               absolute;  // 64-bit address, otherwise 32-bit relative to the end of the fixup
+    Native_Target_Kind target;
+    u64                unit;
+    u64                index;
+};
+
+struct Native_Builder
+{
+    Compiler* ctx;
+
+    Dynamic_Array<u8>           code;
+    Dynamic_Array<u8>           rodata;
+    Dynamic_Array<Native_Fixup> fixups;
+    umm                         helpers[COUNT_NATIVE_HELPERS];
+
+    Dynamic_Array<Unit*>       units;
+    Dynamic_Array<Array<umm>>  labels;  // code offset of each instruction, and of the end, for each unit
+    Table(u64, u64, hash_u64)  unit_index;
+
+    u64 newline;  // in rodata
+
+    // :NativeRegisterCache
+    Native_Cached_Operand      cached[ArrayCount(NATIVE_CACHE_REGISTERS)];
+    u64                        cache_clock;
+    umm                        instruction;      // being written, plus one
+    umm                        result;           // index in cached, see result_register
+    Array<Storage_Range const> private_storage;  // temporaries which don't have their address taken
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Encoding
+
+    void emit(u8 byte) { add_item(&code, &byte); }
+    void emit32(u32 value) { add_items(&code, (u8*) &value, 4); }
+    void emit64(u64 value) { add_items(&code, (u8*) &value, 8); }
+
+    template <typename... T>
+    void bytes(T... values) { (emit((u8) values), ...); }
+
+    void rex(bool w, u8 reg, u8 rm, bool force = false)
+    {
+        u8 prefix = 0x40 | (w ? 0x08 : 0) | ((reg & 8) ? 0x04 : 0) | ((rm & 8) ? 0x01 : 0);
+        if (prefix != 0x40 || force) emit(prefix);
+    }
+
+    // [base + disp32]
+    void mem(u8 reg, u8 base, s32 disp)
+    {
+        emit(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == RSP) emit(0x24);  // rsp and r12 need a SIB byte
+        emit32(disp);
+    }
+
+    void modrm_registers(u8 reg, u8 rm) { emit(0xC0 | ((reg & 7) << 3) | (rm & 7)); }
+
+    // Zero or sign extends into the whole register.
+    void load(u8 reg, u8 base, s32 disp, u64 size, bool is_signed = false)
+    {
+        switch (size)
+        {
+        IllegalDefaultCase;
+        case 1: rex(is_signed, reg, base); bytes(0x0F, is_signed ? 0xBE : 0xB6); break;
+        case 2: rex(is_signed, reg, base); bytes(0x0F, is_signed ? 0xBF : 0xB7); break;
+        case 4: rex(is_signed, reg, base); emit(is_signed ? 0x63 : 0x8B);        break;
+        case 8: rex(true,      reg, base); emit(0x8B);                           break;
+        }
+        mem(reg, base, disp);
+    }
+
+    void store(u8 reg, u8 base, s32 disp, u64 size)
+    {
+        switch (size)
+        {
+        IllegalDefaultCase;
+        case 1: rex(false, reg, base, /* force */ true); emit(0x88); break;
+        case 2: emit(0x66); rex(false, reg, base);      emit(0x89); break;
+        case 4: rex(false, reg, base);                  emit(0x89); break;
+        case 8: rex(true,  reg, base);                  emit(0x89); break;
+        }
+        mem(reg, base, disp);
+    }
+
+    // Stores the low size bytes of rax, for sizes which aren't a power of two too.
+    void store_rax(u8 base, s32 disp, u64 size)
+    {
+        assert(size <= 8);
+        if (size == 8) return store(RAX, base, disp, 8);
+        for (u64 chunk = 4; size; chunk /= 2)
+        {
+            if (size < chunk) continue;
+            store(RAX, base, disp, chunk);
+            disp += chunk;
+            size -= chunk;
+            if (size) bytes(0x48, 0xC1, 0xE8, chunk * 8);  // shr rax, chunk * 8
+        }
+    }
+
+    void lea(u8 reg, u8 base, s32 disp) { rex(true, reg, base); emit(0x8D); mem(reg, base, disp); }
+
+    void mov_immediate(u8 reg, u64 value)
+    {
+        if (value <= U32_MAX)
+        {
+            rex(false, 0, reg);
+            emit(0xB8 | (reg & 7));
+            emit32(value);
+        }
+        else
+        {
+            rex(true, 0, reg);
+            emit(0xB8 | (reg & 7));
+            emit64(value);
+        }
+    }
+
+    // mov reg, address
+    void mov_address(u8 reg, Native_Target_Kind target, u64 unit, u64 index)
+    {
+        rex(true, 0, reg);
+        emit(0xB8 | (reg & 7));
+        *reserve_item(&fixups) = { code.count, true, target, unit, index };
+        emit64(0);
+    }
+
+    // add, or, and, sub, xor, cmp, test, mov between 64-bit registers
+    void op(u8 opcode, u8 destination, u8 source) { rex(true, source, destination); emit(opcode); modrm_registers(source, destination); }
+    void imul(u8 destination, u8 source) { rex(true, destination, source); bytes(0x0F, 0xAF); modrm_registers(destination, source); }
+    void unary(u8 extension, u8 reg) { rex(true, 0, reg); emit(0xF7); modrm_registers(extension, reg); }  // neg /3, div /6, idiv /7
+
+    // Only al, cl, dl and bl, without a REX prefix.
+    void op8(u8 opcode, u8 destination, u8 source) { emit(opcode); modrm_registers(source, destination); }
+    void setcc(u8 cc, u8 reg) { bytes(0x0F, 0x90 | cc); modrm_registers(0, reg); }
+
+    void sse(u8 prefix, bool w, u8 opcode, u8 reg, u8 rm)
+    {
+        if (prefix) emit(prefix);
+        rex(w, reg, rm);
+        bytes(0x0F, opcode);
+        modrm_registers(reg, rm);
+    }
+
+    void sse_memory(u8 prefix, u8 opcode, u8 reg, u8 base, s32 disp)
+    {
+        if (prefix) emit(prefix);
+        rex(false, reg, base);
+        bytes(0x0F, opcode);
+        mem(reg, base, disp);
+    }
+
+    void jump(u8 opcode_or_cc, Native_Target_Kind target, u64 unit, u64 index, bool conditional = false)
+    {
+        if (conditional) bytes(0x0F, 0x80 | opcode_or_cc);
+        else             emit(opcode_or_cc);  // 0xE9 jmp, 0xE8 call
+        *reserve_item(&fixups) = { code.count, false, target, unit, index };
+        emit32(0);
+    }
+
+    void call(Native_Helper helper) { jump(0xE8, TARGET_HELPER, 0, helper); }
+
+    // Jumps within the code being written.
+    umm jump_forward(u8 cc)
+    {
+        bytes(0x0F, 0x80 | cc);
+        umm at = code.count;
+        emit32(0);
+        return at;
+    }
+
+    umm jump_forward()
+    {
+        emit(0xE9);
+        umm at = code.count;
+        emit32(0);
+        return at;
+    }
+
+    void land(umm at)
+    {
+        s32 relative = code.count - (at + 4);
+        memcpy(&code[at], &relative, 4);
+    }
+
+    void jump_back(u8 cc, umm target)
+    {
+        bytes(0x0F, 0x80 | cc);
+        emit32((s32)(target - (code.count + 4)));
+    }
+
+    u64 add_rodata(void const* data, umm length)
+    {
+        u64 offset = rodata.count;
+        add_items(&rodata, (u8*) data, length);
+        return offset;
+    }
+
+    void write_text(String text)
+    {
+        mov_address(RSI, TARGET_RODATA, 0, add_rodata(text.data, text.length));
+        mov_immediate(RDX, text.length);
+        call(HELPER_WRITE);
+    }
+
+    void syscall(u64 number)
+    {
+        mov_immediate(RAX, number);
+        bytes(0x0F, 0x05);
+    }
+
+    // Zero or sign extends the low size bytes of source into the whole destination.
+    void extend(u8 destination, u8 source, u64 size, bool is_signed)
+    {
+        if (size == 8)
+        {
+            if (destination != source) op(0x89, destination, source);  // mov
+        }
+        else if (size == 4 && !is_signed)
+        {
+            rex(false, source, destination);  // mov r32, r32
+            emit(0x89);
+            modrm_registers(source, destination);
+        }
+        else
+        {
+            rex(true, destination, source);
+            switch (size)
+            {
+            IllegalDefaultCase;
+            case 1: bytes(0x0F, is_signed ? 0xBE : 0xB6); break;  // movsx or movzx
+            case 2: bytes(0x0F, is_signed ? 0xBF : 0xB7); break;
+            case 4: emit(0x63);                           break;  // movsxd
+            }
+            modrm_registers(destination, source);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////////
+    // Storage of the running unit, see :NativeRegisterCache
+
+    static bool is_cacheable(u64 size) { return size == 1 || size == 2 || size == 4 || size == 8; }
+
+    void forget_all()
+    {
+        for (umm c = 0; c < ArrayCount(cached); c++)
+            cached[c].valid = false;
+    }
+
+    void forget(u64 offset, u64 size, bool keep_written_now = false)
+    {
+        for (umm c = 0; c < ArrayCount(cached); c++)
+        {
+            Native_Cached_Operand* entry = &cached[c];
+            if (!entry->valid || !size) continue;
+            if (keep_written_now && entry->written_by == instruction) continue;
+            if (entry->offset < offset + size && offset < entry->offset + entry->size)
+                entry->valid = false;
+        }
+    }
+
+    bool is_private(u64 offset, u64 size)
+    {
+        umm index = find_storage_range(private_storage, offset);
+        if (index >= private_storage.count) return false;
+        Storage_Range const* range = &private_storage[index];
+        return range->offset <= offset && offset + size <= range->offset + range->size;
+    }
+
+    void forget_indirectly_writable()
+    {
+        for (umm c = 0; c < ArrayCount(cached); c++)
+            if (cached[c].valid && !is_private(cached[c].offset, cached[c].size))
+                cached[c].valid = false;
+    }
+
+    umm find_cached(u64 offset, u64 size)
+    {
+        for (umm c = 0; c < ArrayCount(cached); c++)
+            if (cached[c].valid && cached[c].offset == offset && cached[c].size == size)
+                return c;
+        return UMM_MAX;
+    }
+
+    umm cache(u64 offset, u64 size)
+    {
+        umm victim = 0;
+        for (umm c = 0; c < ArrayCount(cached); c++)
+        {
+            if (!cached[c].valid) { victim = c; break; }
+            if (cached[c].last_used < cached[victim].last_used) victim = c;
+        }
+        Native_Cached_Operand* entry = &cached[victim];
+        entry->valid      = true;
+        entry->offset     = offset;
+        entry->size       = size;
+        entry->last_used  = ++cache_clock;
+        entry->written_by = 0;
+        return victim;
+    }
+
+    // Returns the register which holds the operand, extended to 64 bits. It's either a register of
+    // the cache, which must not be written, or scratch.
+    u8 read_storage(u8 scratch, u64 offset, u64 size, bool is_signed = false)
+    {
+        if (!is_cacheable(size))
+        {
+            load(scratch, RBX, offset, size, is_signed);
+            return scratch;
+        }
+
+        umm c = find_cached(offset, size);
+        if (c == UMM_MAX)
+        {
+            c = cache(offset, size);
+            load(NATIVE_CACHE_REGISTERS[c], RBX, offset, size);
+        }
+        cached[c].last_used = ++cache_clock;
+
+        u8 reg = NATIVE_CACHE_REGISTERS[c];
+        if (!is_signed || size == 8) return reg;
+        extend(scratch, reg, size, /* is_signed */ true);
+        return scratch;
+    }
+
+    // Like load from rbx, but from a register if the operand is cached.
+    void load_storage(u8 reg, u64 offset, u64 size, bool is_signed = false)
+    {
+        extend(reg, read_storage(reg, offset, size, is_signed), 8, false);
+    }
+
+    // A register of the cache to compute a result into. Registers which hold an operand of the
+    // instruction were used more recently, so they aren't picked.
+    u8 result_register()
+    {
+        result = cache(0, 0);
+        cached[result].valid = false;
+        return NATIVE_CACHE_REGISTERS[result];
+    }
+
+    // Stores the result_register, and keeps it cached.
+    void write_result(u64 offset, u64 size)
+    {
+        u8 reg = NATIVE_CACHE_REGISTERS[result];
+        store(reg, RBX, offset, size);
+        forget(offset, size);
+        if (size != 8) extend(reg, reg, size, /* is_signed */ false);
+
+        Native_Cached_Operand* entry = &cached[result];
+        entry->valid      = true;
+        entry->offset     = offset;
+        entry->size       = size;
+        entry->last_used  = ++cache_clock;
+        entry->written_by = instruction;
+    }
+
+    // Like store to rbx, and the stored value stays cached.
+    void store_storage(u8 reg, u64 offset, u64 size)
+    {
+        if (!is_cacheable(size))
+        {
+            store(reg, RBX, offset, size);
+            forget(offset, size);
+            return;
+        }
+
+        extend(result_register(), reg, size, /* is_signed */ false);
+        write_result(offset, size);
+    }
+};
+
+
+static u64 add_unit(Native_Builder* b, Unit* unit)
+{
+    u64 key = (u64) unit;
+    u64 index;
+    if (get(&b->unit_index, &key, &index)) return index;
+    index = b->units.count;
+    set(&b->unit_index, &key, &index);
+    add_item(&b->units, &unit);
+    return index;
+}
+
+static bool native_error(Native_Builder* b, Unit* unit, String message)
+{
+    String file;
+    u32 line, column;
+    get_line(b->ctx, get_token_info(b->ctx, &unit->initiator_from), &line, &column, &file);
+    fprintf(stderr, "%.*s:%u:%u: %.*s, so the program can't be compiled to a native executable.\n",
+            StringArgs(file), line, column, StringArgs(message));
+    return false;
+}
+
+static u64 get_native_size(Type type)
+{
+    switch (type)
+    {
+    case TYPE_U8:  case TYPE_S8:  case TYPE_BOOL:              return 1;
+    case TYPE_U16: case TYPE_S16: case TYPE_F16:               return 2;
+    case TYPE_U32: case TYPE_S32: case TYPE_F32: case TYPE_TYPE: return 4;
+    case TYPE_U64: case TYPE_S64: case TYPE_F64:
+    case TYPE_UMM: case TYPE_SMM:                              return 8;
+    IllegalDefaultCase;
+    }
+}
+
+// The low bytes of an immediate operand, extended to 64 bits the way the operand is loaded.
+static u64 extend_immediate(u64 value, Type type)
+{
+    u64 bits = get_native_size(type) * 8;
+    if (bits == 64) return value;
+    value &= ((u64) 1 << bits) - 1;
+    if (is_signed_integer_type(type) && (value >> (bits - 1)))
+        value |= ~(((u64) 1 << bits) - 1);
+    return value;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Runtime routines
+////////////////////////////////////////////////////////////////////////////////
+
+
+static void write_helpers(Native_Builder* b)
+{
+    b->helpers[HELPER_WRITE] = b->code.count;
+    b->mov_immediate(RDI, 1);
+    b->syscall(1);  // write
+    b->emit(0xC3);  // ret
+
+    b->helpers[HELPER_PRINT_STRING] = b->code.count;
+    b->call(HELPER_WRITE);
+    b->mov_address(RSI, TARGET_RODATA, 0, b->newline);
+    b->mov_immediate(RDX, 1);
+    b->jump(0xE9, TARGET_HELPER, 0, HELPER_WRITE);
+
+    // Digits are written backwards into a buffer on the stack, with the newline at the end.
+    b->helpers[HELPER_PRINT_DECIMAL] = b->code.count;
+    {
+        b->bytes(0x48, 0x83, 0xEC, 0x20);      // sub rsp, 32
+        b->lea(RSI, RSP, 32);
+        b->bytes(0x48, 0xFF, 0xCE);            // dec rsi
+        b->bytes(0xC6, 0x06, '\n');            // mov byte [rsi], '\n'
+        b->bytes(0x45, 0x31, 0xC0);            // xor r8d, r8d
+        b->bytes(0x85, 0xD2);                  // test edx, edx
+        umm is_unsigned = b->jump_forward(CC_E);
+        b->op(0x85, RAX, RAX);                 // test rax, rax
+        umm is_positive = b->jump_forward(CC_NS);
+        b->unary(3, RAX);                      // neg rax
+        b->bytes(0x41, 0xB8, 1, 0, 0, 0);      // mov r8d, 1
+        b->land(is_unsigned);
+        b->land(is_positive);
+
+        b->mov_immediate(RCX, 10);
+        umm digit = b->code.count;
+        b->bytes(0x31, 0xD2);                  // xor edx, edx
+        b->unary(6, RCX);                      // div rcx
+        b->bytes(0x80, 0xC2, '0');             // add dl, '0'
+        b->bytes(0x48, 0xFF, 0xCE);            // dec rsi
+        b->bytes(0x88, 0x16);                  // mov [rsi], dl
+        b->op(0x85, RAX, RAX);                 // test rax, rax
+        b->jump_back(CC_NE, digit);
+
+        b->bytes(0x45, 0x85, 0xC0);            // test r8d, r8d
+        umm no_sign = b->jump_forward(CC_E);
+        b->bytes(0x48, 0xFF, 0xCE);            // dec rsi
+        b->bytes(0xC6, 0x06, '-');             // mov byte [rsi], '-'
+        b->land(no_sign);
+
+        b->lea(RDX, RSP, 32);
+        b->op(0x29, RDX, RSI);                 // sub rdx, rsi
+        b->call(HELPER_WRITE);
+        b->bytes(0x48, 0x83, 0xC4, 0x20);      // add rsp, 32
+        b->emit(0xC3);                         // ret
+    }
+
+    // Same format as the interpreter prints pointers with.
+    b->helpers[HELPER_PRINT_HEX] = b->code.count;
+    {
+        b->bytes(0x48, 0x83, 0xEC, 0x20);      // sub rsp, 32
+        b->bytes(0xC6, 0x44, 0x24, 16, '\n');  // mov byte [rsp + 16], '\n'
+        b->lea(RSI, RSP, 16);
+        b->mov_immediate(RCX, 16);
+        umm digit = b->code.count;
+        b->bytes(0x89, 0xC2);                  // mov edx, eax
+        b->bytes(0x83, 0xE2, 0x0F);            // and edx, 15
+        b->bytes(0x83, 0xFA, 10);              // cmp edx, 10
+        umm is_decimal = b->jump_forward(CC_B);
+        b->bytes(0x83, 0xC2, 'a' - '0' - 10);  // add edx, 'a' - '0' - 10
+        b->land(is_decimal);
+        b->bytes(0x83, 0xC2, '0');             // add edx, '0'
+        b->bytes(0x48, 0xFF, 0xCE);            // dec rsi
+        b->bytes(0x88, 0x16);                  // mov [rsi], dl
+        b->bytes(0x48, 0xC1, 0xE8, 4);         // shr rax, 4
+        b->bytes(0xFF, 0xC9);                  // dec ecx
+        b->jump_back(CC_NE, digit);
+
+        b->mov_immediate(RDX, 17);
+        b->call(HELPER_WRITE);
+        b->bytes(0x48, 0x83, 0xC4, 0x20);      // add rsp, 32
+        b->emit(0xC3);                         // ret
+    }
+
+    // mmap returns -errno when it fails. Same message and exit code as the interpreter's allocator.
+    b->helpers[HELPER_CHECK_MMAP] = b->code.count;
+    {
+        b->bytes(0x48, 0x3D, 0x00, 0xF0, 0xFF, 0xFF);  // cmp rax, -4096
+        umm failed = b->jump_forward(CC_A);
+        b->emit(0xC3);                         // ret
+        b->land(failed);
+        String message = "user code is out of memory\n"_s;
+        b->mov_immediate(RDI, 2);
+        b->mov_address(RSI, TARGET_RODATA, 0, b->add_rodata(message.data, message.length));
+        b->mov_immediate(RDX, message.length);
+        b->syscall(1);                         // write
+        b->mov_immediate(RDI, 1);
+        b->syscall(231);                       // exit_group
+    }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Instruction selection
+////////////////////////////////////////////////////////////////////////////////
+
+
+static bool write_unit(Native_Builder* b, u64 unit_index)
+{
+    Unit* unit = b->units[unit_index];
+    assert(unit->compiled_bytecode);
+    if (unit->storage_size > S32_MAX)
+        return native_error(b, unit, "The storage of the unit is too large to address"_s);
+
+    Array<umm> labels = allocate_array<umm>(NULL, unit->bytecode.count + 1);
+    add_item(&b->labels, &labels);
+
+    // :NativeRegisterCache
+    // Same basic blocks and private temporaries as in the IR, see lift_bytecode and build_blocks.
+    umm count = unit->bytecode.count;
+    Array<Ir_Effects> effects   = allocate_array<Ir_Effects>(NULL, count);
+    Array<bool>       is_leader = allocate_array<bool>(NULL, count + 1);
+    Defer(free_heap_array(&effects));
+    Defer(free_heap_array(&is_leader));
+
+    Dynamic_Array<Storage_Range> private_storage = {};
+    Defer(free_heap_array(&private_storage));
+    {
+        Array<bool> address_taken = allocate_array<bool>(NULL, unit->temporary_storage.count);
+        Defer(free_heap_array(&address_taken));
+
+        auto mark = [&](u64 instruction) { if (instruction < count) is_leader[instruction] = true; };
+        mark(0);
+        mark(unit->entry_block->first_instruction);
+        mark(unit->entry_into_zeroed_storage);
+        for (umm i = 0; i < count; i++)
+        {
+            Bytecode const* bc = &unit->bytecode[i];
+            effects[i] = get_bytecode_effects(unit, bc);
+            flags32 flags = effects[i].flags;
+            if (flags & IR_JUMPS)
+                mark(bc->r);
+            if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_INSTRUCTION))
+                mark(bc->a);
+            if (!(flags & IR_FALLS_THROUGH) || (flags & (IR_JUMPS | IR_CLOBBERS_ALL)))
+                mark(i + 1);
+
+            if (bc->op != OP_ADDRESS) continue;
+            umm index = find_storage_range(unit->temporary_storage, bc->a);
+            if (index < address_taken.count && unit->temporary_storage[index].offset <= bc->a)
+                address_taken[index] = true;
+        }
+
+        for (umm i = 0; i < unit->temporary_storage.count; i++)
+            if (!address_taken[i])
+                add_item(&private_storage, (Storage_Range*) &unit->temporary_storage[i]);
+    }
+    b->private_storage = const_array(private_storage);
+    b->forget_all();
+
+    for (umm i = 0; i < count; i++)
+    {
+        labels[i] = b->code.count;
+        b->instruction = i + 1;
+        if (is_leader[i])
+            b->forget_all();
+
+        Bytecode const* bc = &unit->bytecode[i];
+        flags32 flags = bc->flags;
+        u64 r = bc->r, a = bc->a, s = bc->s;
+        u64 immediate = bc->b;
+
+        s32 rd = (s32) r;
+        s32 ad = (s32) a;
+        s32 bd = (s32) bc->b;
+
+        Type type  = (Type) s;
+        bool is_f  = is_floating_point_type(type);
+        u8   sse_p = (type == TYPE_F32) ? 0xF3 : 0xF2;  // ss or sd
+        if (type == TYPE_F16 && (bc->op == OP_NEGATE || bc->op == OP_ADD || bc->op == OP_SUBTRACT ||
+                                 bc->op == OP_MULTIPLY || bc->op == OP_DIVIDE_FRACTIONAL || bc->op == OP_COMPARE ||
+                                 bc->op == OP_ADD_IMMEDIATE || bc->op == OP_SUBTRACT_IMMEDIATE ||
+                                 bc->op == OP_MULTIPLY_IMMEDIATE || bc->op == OP_COMPARE_IMMEDIATE || bc->op == OP_CAST))
+            return native_error(b, unit, "The unit uses f16 arithmetic, which isn't supported"_s);
+
+        auto copy_bytes = [&](u64 size)  // from rsi to rdi
+        {
+            if (size == 1 || size == 2 || size == 4 || size == 8)
+            {
+                b->load(RAX, RSI, 0, size);
+                b->store(RAX, RDI, 0, size);
+            }
+            else if (size)
+            {
+                b->mov_immediate(RCX, size);
+                b->bytes(0xF3, 0xA4);  // rep movsb
+            }
+        };
+
+        auto load_float = [&](u8 xmm, u8 base, s32 disp) { b->sse_memory(sse_p, 0x10, xmm, base, disp); };
+        auto store_float = [&](u8 xmm, u8 base, s32 disp) { b->sse_memory(sse_p, 0x11, xmm, base, disp); };
+        auto float_immediate = [&](u8 xmm)
+        {
+            b->mov_immediate(RCX, type == TYPE_F32 ? (u32) immediate : immediate);
+            b->sse(0x66, true, 0x6E, xmm, RCX);  // movq xmm, rcx
+        };
+
+        auto compare = [&](bool immediate_rhs)
+        {
+            flags32 wanted = flags & (OP_COMPARE_EQUAL | OP_COMPARE_LESS | OP_COMPARE_GREATER);
+            if (is_f)
+            {
+                load_float(XMM0, RBX, ad);
+                if (immediate_rhs) float_immediate(XMM1);
+                else               load_float(XMM1, RBX, bd);
+                b->sse(type == TYPE_F32 ? 0 : 0x66, false, 0x2E, XMM0, XMM1);  // ucomis
+
+                // Unordered compares as greater, same as in the interpreter.
+                b->setcc(CC_E,  RAX);
+                b->setcc(CC_NP, RCX);
+                b->op8(0x20, RAX, RCX);          // and al, cl   equal
+                b->setcc(CC_B,  RDX);
+                b->op8(0x20, RDX, RCX);          // and dl, cl   less
+                b->op8(0x88, RCX, RAX);          // mov cl, al
+                b->op8(0x08, RCX, RDX);          // or  cl, dl
+                b->bytes(0x80, 0xF1, 0x01);      // xor cl, 1    greater
+                if (!(wanted & OP_COMPARE_EQUAL))   b->op8(0x30, RAX, RAX);  // xor al, al
+                if (wanted & OP_COMPARE_LESS)       b->op8(0x08, RAX, RDX);  // or  al, dl
+                if (wanted & OP_COMPARE_GREATER)    b->op8(0x08, RAX, RCX);  // or  al, cl
+            }
+            else
+            {
+                bool is_signed = is_signed_integer_type(type);
+                u64  size      = get_native_size(type);
+                u8 lhs = b->read_storage(RAX, ad, size, is_signed);
+                u8 rhs = RCX;
+                if (immediate_rhs) b->mov_immediate(RCX, extend_immediate(immediate, type));
+                else               rhs = b->read_storage(RCX, bd, size, is_signed);
+                b->op(0x39, lhs, rhs);  // cmp lhs, rhs
+
+                u8 cc = 0;
+                switch (wanted)
+                {
+                case 0:                                                          break;
+                case OP_COMPARE_EQUAL:                         cc = CC_E;         break;
+                case OP_COMPARE_LESS:                          cc = is_signed ? CC_L  : CC_B;  break;
+                case OP_COMPARE_GREATER:                       cc = is_signed ? CC_G  : CC_A;  break;
+                case OP_COMPARE_EQUAL | OP_COMPARE_LESS:       cc = is_signed ? CC_LE : CC_BE; break;
+                case OP_COMPARE_EQUAL | OP_COMPARE_GREATER:    cc = is_signed ? CC_GE : CC_AE; break;
+                case OP_COMPARE_LESS  | OP_COMPARE_GREATER:    cc = CC_NE;        break;
+                default:                                                         break;
+                }
+                if (cc) b->setcc(cc, RAX);
+                else    b->mov_immediate(RAX, wanted ? 1 : 0);
+            }
+            b->store_storage(RAX, rd, 1);
+        };
+
+        auto arithmetic = [&](u8 int_opcode, u8 float_opcode, bool immediate_rhs)
+        {
+            if (is_f)
+            {
+                load_float(XMM0, RBX, ad);
+                if (immediate_rhs) float_immediate(XMM1);
+                else               load_float(XMM1, RBX, bd);
+                b->sse(sse_p, false, float_opcode, XMM0, XMM1);
+                store_float(XMM0, RBX, rd);
+                return;
+            }
+
+            u64 size = get_native_size(type);
+            u8 lhs = b->read_storage(RAX, ad, size);
+            u8 rhs = RCX;
+            if (immediate_rhs) b->mov_immediate(RCX, immediate);
+            else               rhs = b->read_storage(RCX, bd, size);
+            u8 result = b->result_register();
+            b->extend(result, lhs, 8, false);  // mov
+            if (int_opcode == 0xAF) b->imul(result, rhs);
+            else                    b->op(int_opcode, result, rhs);
+            b->write_result(rd, size);
+        };
+
+        switch (bc->op)
+        {
+        IllegalDefaultCase;
+
+        case OP_ZERO:
+        case OP_ZERO_INDIRECT:
+        {
+            if (bc->op == OP_ZERO) b->lea(RDI, RBX, rd);
+            else                   b->load_storage(RDI, rd, 8);
+            if (s == 1 || s == 2 || s == 4 || s == 8)
+            {
+                b->bytes(0x31, 0xC0);  // xor eax, eax
+                b->store(RAX, RDI, 0, s);
+            }
+            else if (s)
+            {
+                b->bytes(0x31, 0xC0);  // xor eax, eax
+                b->mov_immediate(RCX, s);
+                b->bytes(0xF3, 0xAA);  // rep stosb
+            }
+        } break;
+
+        case OP_LITERAL:
+        {
+            if (!(flags & (OP_A_IS_UNIT | OP_A_IS_DATA | OP_A_IS_INSTRUCTION)) && b->is_cacheable(s))
+            {
+                // Zero extended, like every cached operand.
+                b->mov_immediate(b->result_register(), s == 8 ? a : a & (((u64) 1 << (s * 8)) - 1));
+                b->write_result(rd, s);
+                break;
+            }
+
+            if (flags & OP_A_IS_UNIT)
+            {
+                Unit* target = (Unit*) a;
+                b->mov_address(RAX, TARGET_INSTRUCTION, add_unit(b, target), target->entry_block->first_instruction);
+            }
+            else if (flags & OP_A_IS_DATA)
+                b->mov_address(RAX, TARGET_RODATA, 0, b->add_rodata((void*) a, immediate));
+            else if (flags & OP_A_IS_INSTRUCTION)
+                b->mov_address(RAX, TARGET_INSTRUCTION, unit_index, a);
+            else
+                b->mov_immediate(RAX, a);
+            if (b->is_cacheable(s)) b->store_storage(RAX, rd, s);
+            else                    b->store_rax(RBX, rd, s);
+        } break;
+
+        case OP_COPY:
+        {
+            if (b->is_cacheable(s))
+            {
+                u8 source = b->read_storage(RAX, ad, s);
+                b->store_storage(source, rd, s);
+            }
+            else
+            {
+                b->lea(RDI, RBX, rd);
+                b->lea(RSI, RBX, ad);
+                copy_bytes(s);
+            }
+        } break;
+
+        case OP_COPY_FROM_INDIRECT:     b->lea(RDI, RBX, rd);        b->load_storage(RSI, ad, 8); copy_bytes(s); break;
+        case OP_COPY_TO_INDIRECT:       b->load_storage(RDI, rd, 8); b->lea(RSI, RBX, ad);        copy_bytes(s); break;
+        case OP_COPY_BETWEEN_INDIRECT:  b->load_storage(RDI, rd, 8); b->load_storage(RSI, ad, 8); copy_bytes(s); break;
+
+        case OP_ADDRESS:
+        {
+            b->lea(RAX, RBX, ad);
+            b->store_storage(RAX, rd, 8);
+        } break;
+
+        case OP_NOT:
+        {
+            b->load_storage(RAX, ad, 1);
+            b->bytes(0x84, 0xC0);  // test al, al
+            b->setcc(CC_E, RAX);
+            b->store_storage(RAX, rd, 1);
+        } break;
+
+        case OP_NEGATE:
+        {
+            u64 size = get_native_size(type);
+            b->load_storage(RAX, ad, size, !is_f);
+            if (is_f)
+            {
+                b->mov_immediate(RCX, (u64) 1 << (size * 8 - 1));
+                b->op(0x31, RAX, RCX);  // xor rax, rcx
+            }
+            else b->unary(3, RAX);      // neg rax
+            b->store_storage(RAX, rd, size);
+        } break;
+
+        case OP_ADD:                 arithmetic(0x01, 0x58, false); break;
+        case OP_SUBTRACT:            arithmetic(0x29, 0x5C, false); break;
+        case OP_MULTIPLY:            arithmetic(0xAF, 0x59, false); break;
+        case OP_DIVIDE_FRACTIONAL:   arithmetic(0,    0x5E, false); break;
+        case OP_ADD_IMMEDIATE:       arithmetic(0x01, 0x58, true);  break;
+        case OP_SUBTRACT_IMMEDIATE:  arithmetic(0x29, 0x5C, true);  break;
+        case OP_MULTIPLY_IMMEDIATE:  arithmetic(0xAF, 0x59, true);  break;
+        case OP_COMPARE:             compare(false);                break;
+        case OP_COMPARE_IMMEDIATE:   compare(true);                 break;
+
+        case OP_DIVIDE_WHOLE:
+        {
+            bool is_signed = is_signed_integer_type(type);
+            u64  size      = get_native_size(type);
+            b->load_storage(RAX, ad, size, is_signed);
+            b->load_storage(RCX, bd, size, is_signed);
+            if (is_signed) { b->bytes(0x48, 0x99); b->unary(7, RCX); }  // cqo, idiv rcx
+            else           { b->bytes(0x31, 0xD2); b->unary(6, RCX); }  // xor edx, edx, div rcx
+            b->store_storage(RAX, rd, size);
+        } break;
+
+        case OP_MOVE_POINTER_CONSTANT:
+        case OP_MOVE_POINTER_FORWARD:
+        case OP_MOVE_POINTER_BACKWARD:
+        case OP_MOVE_POINTER_IMMEDIATE:
+        {
+            b->load_storage(RAX, ad, 8);
+            if (bc->op == OP_MOVE_POINTER_CONSTANT)
+                b->mov_immediate(RCX, s);
+            else if (bc->op == OP_MOVE_POINTER_IMMEDIATE)
+                b->mov_immediate(RCX, immediate * s);
+            else
+            {
+                b->load_storage(RCX, bd, 8);
+                b->mov_immediate(RDX, s);
+                b->imul(RCX, RDX);
+            }
+            b->op(bc->op == OP_MOVE_POINTER_BACKWARD ? 0x29 : 0x01, RAX, RCX);
+            b->store_storage(RAX, rd, 8);
+        } break;
+
+        case OP_POINTER_DISTANCE:
+        {
+            b->load_storage(RAX, bd, 8);
+            b->load_storage(RCX, ad, 8);
+            b->op(0x29, RAX, RCX);     // sub rax, rcx
+            b->mov_immediate(RCX, s);
+            b->bytes(0x31, 0xD2);      // xor edx, edx
+            b->unary(6, RCX);          // div rcx
+            b->store_storage(RAX, rd, 8);
+        } break;
+
+        case OP_CAST:
+        {
+            Type from = (Type) immediate;
+            Type to   = type;
+            bool from_f = is_floating_point_type(from);
+            u8   from_p = (from == TYPE_F32) ? 0xF3 : 0xF2;
+            if (from == TYPE_F16)
+                return native_error(b, unit, "The unit uses f16 arithmetic, which isn't supported"_s);
+
+            if (from_f) b->sse_memory(from_p, 0x10, XMM0, RBX, ad);
+            else        b->load_storage(RAX, ad, get_native_size(from), is_signed_integer_type(from));
+
+            if (to == TYPE_BOOL)
+            {
+                if (from_f)
+                {
+                    b->sse(0, false, 0x57, XMM1, XMM1);                          // xorps xmm1, xmm1
+                    b->sse(from == TYPE_F32 ? 0 : 0x66, false, 0x2E, XMM0, XMM1);  // ucomis xmm0, xmm1
+                    b->setcc(CC_NE, RAX);
+                    b->setcc(CC_P,  RCX);
+                    b->op8(0x08, RAX, RCX);  // or al, cl, NaN is true
+                }
+                else
+                {
+                    b->op(0x85, RAX, RAX);  // test rax, rax
+                    b->setcc(CC_NE, RAX);
+                }
+                b->store_storage(RAX, rd, 1);
+            }
+            else if (is_f)
+            {
+                if (from_f)
+                {
+                    if (from != to) b->sse(from_p, false, 0x5A, XMM0, XMM0);  // cvtss2sd or cvtsd2ss
+                }
+                else if (from == TYPE_U64 || from == TYPE_UMM)
+                {
+                    // cvtsi2s* is signed, so values with the top bit set are halved and doubled.
+                    b->op(0x85, RAX, RAX);                                     // test rax, rax
+                    umm is_big = b->jump_forward(CC_S);
+                    b->sse(sse_p, true, 0x2A, XMM0, RAX);                      // cvtsi2s* xmm0, rax
+                    umm done = b->jump_forward();
+                    b->land(is_big);
+                    b->op(0x89, RCX, RAX);                                     // mov rcx, rax
+                    b->bytes(0x48, 0xD1, 0xE9);                                // shr rcx, 1
+                    b->bytes(0x83, 0xE0, 0x01);                                // and eax, 1
+                    b->op(0x09, RCX, RAX);                                     // or rcx, rax
+                    b->sse(sse_p, true, 0x2A, XMM0, RCX);                      // cvtsi2s* xmm0, rcx
+                    b->sse(sse_p, false, 0x58, XMM0, XMM0);                    // adds* xmm0, xmm0
+                    b->land(done);
+                }
+                else b->sse(sse_p, true, 0x2A, XMM0, RAX);                     // cvtsi2s* xmm0, rax
+                store_float(XMM0, RBX, rd);
+            }
+            else
+            {
+                if (from_f) b->sse(from_p, true, 0x2C, RAX, XMM0);  // cvtts*2si rax, xmm0
+                b->store_storage(RAX, rd, get_native_size(to));
+            }
+        } break;
+
+        case OP_GOTO:
+        {
+            b->jump(0xE9, TARGET_INSTRUCTION, unit_index, r);
+        } break;
+
+        case OP_GOTO_IF_FALSE:
+        {
+            u8 condition = b->read_storage(RAX, ad, 1);
+            b->op(0x85, condition, condition);  // test, the byte is zero extended
+            b->jump(CC_E, TARGET_INSTRUCTION, unit_index, r, /* conditional */ true);
+        } break;
+
+        case OP_GOTO_INDIRECT:
+        {
+            b->rex(false, 0, RBX);
+            b->emit(0xFF);
+            b->mem(4, RBX, rd);  // jmp [r]
+        } break;
+
+        case OP_CALL:
+        {
+            b->mov_address(RAX, TARGET_INSTRUCTION, unit_index, i + 1);
+            b->store(RAX, RBX, ad, 8);
+            b->jump(0xE9, TARGET_INSTRUCTION, unit_index, r);
+        } break;
+
+        case OP_SWITCH_UNIT:
+        {
+            // The unit to return to only has to be something other than zero, see OP_FINISH_UNIT.
+            b->load(RAX, RBX, rd, 8);
+            b->load(RDI, RBX, ad, 8);
+            b->mov_address(RCX, TARGET_INSTRUCTION, unit_index, unit->entry_block->first_instruction);
+            b->store(RCX, RDI, 0, 8);
+            b->mov_address(RCX, TARGET_INSTRUCTION, unit_index, i + 1);
+            b->store(RCX, RDI, 8, 8);
+            b->store(RBX, RDI, 16, 8);
+            b->op(0x89, RBX, RDI);   // mov rbx, rdi
+            b->bytes(0xFF, 0xE0);    // jmp rax
+        } break;
+
+        case OP_FINISH_UNIT:
+        {
+            b->load(RAX, RBX, 0, 8);
+            b->op(0x85, RAX, RAX);        // test rax, rax
+            b->bytes(0x75, 0x01, 0xC3);   // jnz over ret, back to _start
+            b->load(RAX, RBX, 8, 8);
+            b->load(RBX, RBX, 16, 8);
+            b->bytes(0xFF, 0xE0);         // jmp rax
+        } break;
+
+        case OP_INTRINSIC:
+        {
+            String name = { (umm) s, (u8*) immediate };
+            Dynamic_Array<Intrinsic_Field> fields = {};
+            Defer(free_heap_array(&fields));
+            bind_intrinsic(unit, (Block*) a, &fields);
+
+            auto find = [&](String field_name, bool is_return, Type type_assertion, u64* out_offset) -> bool
+            {
+                For (fields)
+                {
+                    if (it->is_return != is_return || it->name != field_name) continue;
+                    if (type_assertion != INVALID_TYPE && it->type != type_assertion) return false;
+                    *out_offset = it->offset;
+                    return true;
+                }
+                return false;
+            };
+
+            if (name == "syscall"_s)
+            {
+                static String const parameters[] = { "sys"_s, "rdi"_s, "rsi"_s, "rdx"_s, "r10"_s, "r8"_s, "r9"_s };
+                static u8     const registers [] = { RAX, RDI, RSI, RDX, R10, R8, R9 };
+                for (umm p = 0; p < ArrayCount(parameters); p++)
+                {
+                    u64 offset;
+                    if (!find(parameters[p], false, TYPE_UMM, &offset))
+                        return native_error(b, unit, Format(temp, "The parameter '%' to intrinsic 'syscall' is missing, or isn't of type 'umm'", parameters[p]));
+                    b->load(registers[p], RBX, offset, 8);
+                }
+
+                u64 result;
+                if (!find("rax"_s, true, TYPE_UMM, &result))
+                    return native_error(b, unit, "The return 'rax' of intrinsic 'syscall' is missing, or isn't of type 'umm'"_s);
+                b->bytes(0x0F, 0x05);  // syscall
+                b->store(RAX, RBX, result, 8);
+            }
+            else if (name == "test_assert"_s)
+            {
+                u64 condition;
+                if (!find("condition"_s, false, INVALID_TYPE, &condition))
+                    return native_error(b, unit, "The parameter 'condition' to intrinsic 'test_assert' is missing"_s);
+                b->load(RAX, RBX, condition, 1);
+                b->bytes(0x84, 0xC0);  // test al, al
+                umm holds = b->jump_forward(CC_NE);
+                String message = "Assertion failure!\n"_s;
+                b->mov_immediate(RDI, 2);
+                b->mov_address(RSI, TARGET_RODATA, 0, b->add_rodata(message.data, message.length));
+                b->mov_immediate(RDX, message.length);
+                b->syscall(1);    // write
+                b->mov_immediate(RDI, 2);
+                b->syscall(231);  // exit_group
+                b->land(holds);
+            }
+            else if (prefix_equals(name, "compiler_"_s))
+                return native_error(b, unit, Format(temp, "The unit uses the intrinsic '%', which needs the compiler when it runs", name));
+            else
+                return native_error(b, unit, Format(temp, "The unit uses an unknown intrinsic '%'", name));
+        } break;
+
+        case OP_DEBUG_PRINT:
+        {
+            switch (type)
+            {
+            case TYPE_VOID: b->write_text("void\n"_s); break;
+            case TYPE_U8:  case TYPE_U16: case TYPE_U32: case TYPE_U64: case TYPE_UMM:
+            case TYPE_S8:  case TYPE_S16: case TYPE_S32: case TYPE_S64: case TYPE_SMM:
+            {
+                bool is_signed = is_signed_integer_type(type);
+                b->load_storage(RAX, rd, get_native_size(type), is_signed);
+                b->mov_immediate(RDX, is_signed);
+                b->call(HELPER_PRINT_DECIMAL);
+            } break;
+            case TYPE_BOOL:
+            {
+                String yes = "true"_s, no = "false"_s;
+                u64 yes_offset = b->add_rodata(yes.data, yes.length);
+                u64 no_offset  = b->add_rodata(no.data,  no.length);
+                b->load_storage(RAX, rd, 1);
+                b->bytes(0x84, 0xC0);  // test al, al
+                umm is_false = b->jump_forward(CC_E);
+                b->mov_address(RSI, TARGET_RODATA, 0, yes_offset);
+                b->mov_immediate(RDX, yes.length);
+                umm print = b->jump_forward();
+                b->land(is_false);
+                b->mov_address(RSI, TARGET_RODATA, 0, no_offset);
+                b->mov_immediate(RDX, no.length);
+                b->land(print);
+                b->call(HELPER_PRINT_STRING);
+            } break;
+            case TYPE_TYPE:
+            {
+                b->write_text("type "_s);
+                b->load_storage(RAX, rd, 4);
+                b->mov_immediate(RDX, 0);
+                b->call(HELPER_PRINT_DECIMAL);
+            } break;
+            case TYPE_STRING:
+            {
+                b->load(RDX, RBX, rd + MemberOffset(String, length), 8);
+                b->load(RSI, RBX, rd + MemberOffset(String, data),   8);
+                b->call(HELPER_PRINT_STRING);
+            } break;
+            case TYPE_F16:
+            case TYPE_F32:
+            case TYPE_F64:
+                return native_error(b, unit, "The unit prints a floating point value with debug, which isn't supported"_s);
+            default:
+            {
+                if (is_pointer_type(type))
+                {
+                    b->load_storage(RAX, rd, 8);
+                    b->call(HELPER_PRINT_HEX);
+                }
+                else
+                {
+                    assert(is_user_defined_type(type));
+                    b->write_text("user defined type\n"_s);
+                }
+            } break;
+            }
+        } break;
+
+        case OP_DEBUG_ALLOC:
+        {
+            // The size is kept in front of the allocation, munmap needs it.
+            b->load_storage(RSI, ad, 8);
+            b->bytes(0x48, 0x83, 0xC6, 0x10);  // add rsi, 16
+            b->emit(0x56);                     // push rsi
+            b->bytes(0x31, 0xFF);              // xor edi, edi
+            b->mov_immediate(RDX, 3);          // PROT_READ | PROT_WRITE
+            b->mov_immediate(R10, 0x22);       // MAP_PRIVATE | MAP_ANONYMOUS
+            b->bytes(0x49, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF);  // mov r8, -1
+            b->bytes(0x45, 0x31, 0xC9);        // xor r9d, r9d
+            b->syscall(9);                     // mmap
+            b->call(HELPER_CHECK_MMAP);
+            b->emit(0x59);                     // pop rcx
+            b->store(RCX, RAX, 0, 8);
+            b->bytes(0x48, 0x83, 0xC0, 0x10);  // add rax, 16
+            b->store_storage(RAX, rd, 8);
+        } break;
+
+        case OP_DEBUG_FREE:
+        {
+            b->load_storage(RDI, rd, 8);
+            b->bytes(0x48, 0x83, 0xEF, 0x10);  // sub rdi, 16
+            b->load(RSI, RDI, 0, 8);
+            b->syscall(11);                    // munmap
+        } break;
+        }
+
+        // Storage which was written without going through store_storage.
+        Ir_Effects* effect = &effects[i];
+        if (effect->writes)
+            b->forget(effect->write.range.offset, effect->write.range.size, /* keep_written_now */ true);
+        if (effect->flags & IR_WRITES_MEMORY)
+            b->forget_indirectly_writable();
+        if (effect->flags & IR_CLOBBERS_ALL)
+            b->forget_all();
+    }
+
+    labels[unit->bytecode.count] = b->code.count;
+    return true;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Executable
+////////////////////////////////////////////////////////////////////////////////
+
+
+bool save_elf_executable(Compiler* ctx, String path)
+{
+    Native_Builder builder = {};
+    Native_Builder* b = &builder;
+    b->ctx = ctx;
+    Defer(free_heap_array(&b->code));
+    Defer(free_heap_array(&b->rodata));
+    Defer(free_heap_array(&b->fixups));
+    Defer(free_heap_array(&b->units));
+    Defer(free_table(&b->unit_index));
+    Defer(For (b->labels) free_heap_array(it); free_heap_array(&b->labels));
+
+    b->newline = b->add_rodata("\n", 1);
+
+    // _start
+    For (ctx->run_units)
+    {
+        Unit* unit = *it;
+        u64 index = add_unit(b, unit);
+
+        // Fresh anonymous pages are zeroed, see :ZeroedUnitStorage
+        u64 size = unit->storage_size ? unit->storage_size : 1;
+        b->bytes(0x31, 0xFF);                 // xor edi, edi
+        b->mov_immediate(RSI, size);
+        b->mov_immediate(RDX, 3);             // PROT_READ | PROT_WRITE
+        b->mov_immediate(R10, 0x22);          // MAP_PRIVATE | MAP_ANONYMOUS
+        b->bytes(0x49, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF);  // mov r8, -1
+        b->bytes(0x45, 0x31, 0xC9);           // xor r9d, r9d
+        b->syscall(9);                        // mmap
+        b->call(HELPER_CHECK_MMAP);
+        b->op(0x89, RBX, RAX);                // mov rbx, rax
+        b->jump(0xE8, TARGET_INSTRUCTION, index, unit->entry_into_zeroed_storage);
+    }
+    b->bytes(0x31, 0xFF);  // xor edi, edi
+    b->syscall(231);       // exit_group
+
+    write_helpers(b);
+
+    // Units are added while they are written, when they are referred to.
+    for (umm unit_i = 0; unit_i < b->units.count; unit_i++)
+        if (!write_unit(b, unit_i))
+            return false;
+
+    // Read-only data goes right after the code, in the same segment.
+    while (b->code.count % 16) b->emit(0xCC);
+    u64 code_address   = NATIVE_BASE_ADDRESS + NATIVE_CODE_OFFSET;
+    u64 rodata_address = code_address + b->code.count;
+
+    For (b->fixups)
+    {
+        u64 target = 0;
+        switch (it->target)
+        {
+        IllegalDefaultCase;
+        case TARGET_INSTRUCTION: target = code_address + b->labels[it->unit][it->index]; break;
+        case TARGET_HELPER:      target = code_address + b->helpers[it->index];          break;
+        case TARGET_RODATA:      target = rodata_address + it->index;                    break;
+        }
+
+        if (it->absolute)
+            memcpy(&b->code[it->at], &target, 8);
+        else
+        {
+            s32 relative = (s32)(target - (code_address + it->at + 4));
+            memcpy(&b->code[it->at], &relative, 4);
+        }
+    }
+
+    umm file_size = NATIVE_CODE_OFFSET + b->code.count + b->rodata.count;
+
+    Elf64_Ehdr header = {};
+    memcpy(header.e_ident, ELFMAG, SELFMAG);
+    header.e_ident[EI_CLASS]   = ELFCLASS64;
+    header.e_ident[EI_DATA]    = ELFDATA2LSB;
+    header.e_ident[EI_VERSION] = EV_CURRENT;
+    header.e_ident[EI_OSABI]   = ELFOSABI_SYSV;
+    header.e_type      = ET_EXEC;
+    header.e_machine   = EM_X86_64;
+    header.e_version   = EV_CURRENT;
+    header.e_entry     = code_address;  // _start is the first thing in the code
+    header.e_phoff     = sizeof(Elf64_Ehdr);
+    header.e_ehsize    = sizeof(Elf64_Ehdr);
+    header.e_phentsize = sizeof(Elf64_Phdr);
+    header.e_phnum     = 2;
+
+    Elf64_Phdr segments[2] = {};
+    segments[0].p_type   = PT_LOAD;
+    segments[0].p_flags  = PF_R | PF_X;
+    segments[0].p_offset = 0;
+    segments[0].p_vaddr  = NATIVE_BASE_ADDRESS;
+    segments[0].p_paddr  = NATIVE_BASE_ADDRESS;
+    segments[0].p_filesz = file_size;
+    segments[0].p_memsz  = file_size;
+    segments[0].p_align  = 0x1000;
+    segments[1].p_type   = PT_GNU_STACK;
+    segments[1].p_flags  = PF_R | PF_W;
+    segments[1].p_align  = 16;
+
+    String_Concatenator cat = {};
+    add(&cat, &header, sizeof(header));
+    add(&cat, segments, sizeof(segments));
+    add(&cat, b->code.address, b->code.count);
+    add(&cat, b->rodata.address, b->rodata.count);
+    String file = resolve_to_string_and_free(&cat, temp);
+    assert(file.length == file_size);
+
+    if (!write_entire_file(path, file) || chmod(make_c_style_string(path), 0755) != 0)
+    {
+        fprintf(stderr, "Failed to write the executable to %.*s\n", StringArgs(path));
+        return false;
+    }
+    return true;
+}
+
+
+ExitApplicationNamespace
@@ -7,6 +7,9 @@
 EnterApplicationNamespace
 
 
+typedef __int128          s128;
+typedef unsigned __int128 u128;
+
 static Integer int_pow(u64 a, u64 b)
 {
     Integer a_int = {};
@@ -125,8 +128,113 @@ String int_base16(Integer const* integer, Region* memory, umm min_digits)
 }
 
 
+// Small fractions keep the numerator and denominator inline, and are only
+// promoted to Integer when an intermediate result doesn't fit. The small
+// range is symmetric so negation can't overflow. Every operation returns
+// the canonical representation: a value that fits is always small, so
+// fract_equals and fract_hash can compare representations directly.
+static constexpr s64 SMALL_FRACTION_MAX = S64_MAX;
+
+static inline bool is_small(Fraction const* f)
+{
+    return f->small_den != 0;
+}
+
+static void int_sets64(Integer* v, s64 value)
+{
+    int_setu64(v, value < 0 ? -(u64) value : (u64) value);
+    if (value < 0)
+        int_negate(v);
+}
+
+static bool int_get_s64(s64* out, Integer const* i)
+{
+    u64 abs;
+    if (!int_get_abs_u64(&abs, i) || abs > (u64) SMALL_FRACTION_MAX)
+        return false;
+    *out = i->negative ? -(s64) abs : (s64) abs;
+    return true;
+}
+
+static u128 gcd_u128(u128 a, u128 b)
+{
+    while (b)
+    {
+        u128 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Reduces num/den and stores it in the small representation, if it fits.
+static bool make_small(Fraction* out, s128 num, s128 den)
+{
+    assert(den != 0);
+    if (den < 0)
+    {
+        num = -num;
+        den = -den;
+    }
+
+    u128 abs_num = num < 0 ? -(u128) num : (u128) num;
+    u128 gcd = gcd_u128(abs_num, (u128) den);
+    if (gcd > 1)
+    {
+        num /= (s128) gcd;
+        den /= (s128) gcd;
+    }
+
+    if (num < -(s128) SMALL_FRACTION_MAX || num > (s128) SMALL_FRACTION_MAX) return false;
+    if (den > (s128) SMALL_FRACTION_MAX) return false;
+
+    ZeroStruct(out);
+    out->small_num = (s64) num;
+    out->small_den = (s64) den;
+    return true;
+}
+
+// Demotes a reduced big fraction to the small representation, if it fits.
+static void normalize(Fraction* f)
+{
+    if (is_small(f)) return;
+
+    s64 num, den;
+    if (!int_get_s64(&num, &f->num)) return;
+    if (!int_get_s64(&den, &f->den)) return;
+
+    int_free(&f->num);
+    int_free(&f->den);
+    ZeroStruct(f);
+    f->small_num = num;
+    f->small_den = den;
+}
+
+// Returns a big copy of the fraction, the caller frees it.
+static Fraction promote(Fraction const* f)
+{
+    Fraction result = {};
+    if (is_small(f))
+    {
+        int_sets64(&result.num, f->small_num);
+        int_sets64(&result.den, f->small_den);
+    }
+    else
+    {
+        result.num = int_clone(&f->num);
+        result.den = int_clone(&f->den);
+    }
+    return result;
+}
+
 static void quick_asserts(Fraction const* f)
 {
+    if (is_small(f))
+    {
+        assert(f->small_den > 0);
+        return;
+    }
+
     assert(!f->den.negative);
     assert(!int_is_zero(&f->den));
     assert(!int_is_zero(&f->num) || !f->num.negative);
@@ -135,15 +243,47 @@ static void quick_asserts(Fraction const* f)
 Fraction fract_make_u64(u64 integer)
 {
     Fraction result = {};
+    if (integer <= (u64) SMALL_FRACTION_MAX)
+    {
+        result.small_num = (s64) integer;
+        result.small_den = 1;
+        return result;
+    }
+
     int_setu64(&result.num, integer);
     int_setu64(&result.den, 1);
     return result;
 }
 
+Fraction fract_make_scaled(u64 mantissa, u32 base, s64 exponent)
+{
+    if (!exponent || !mantissa)
+        return fract_make_u64(mantissa);
+
+    Integer num = {};
+    Integer den = {};
+    Integer power = int_pow(base, exponent < 0 ? -exponent : exponent);
+    int_setu64(&num, mantissa);
+    int_set16(&den, 1);
+    int_mul(exponent < 0 ? &den : &num, &power);
+
+    Fraction result = fract_make(&num, &den);
+    int_free(&num);
+    int_free(&den);
+    int_free(&power);
+    return result;
+}
+
 Fraction fract_make(Integer const* num, Integer const* den)
 {
     assert(!int_is_zero(den));
     Fraction result = {};
+
+    s64 small_num, small_den;
+    if (int_get_s64(&small_num, num) && int_get_s64(&small_den, den))
+        if (make_small(&result, small_num, small_den))
+            return result;
+
     result.num = int_clone(num);
     result.den = int_clone(den);
     fract_reduce(&result);
@@ -152,22 +292,31 @@ Fraction fract_make(Integer const* num, Integer const* den)
 
 void fract_free(Fraction* f)
 {
-    int_free(&f->num);
-    int_free(&f->den);
+    if (!is_small(f))
+    {
+        int_free(&f->num);
+        int_free(&f->den);
+    }
     ZeroStruct(f);
 }
 
 Fraction fract_clone(Fraction const* from)
 {
     quick_asserts(from);
-    Fraction result = {};
-    result.num = int_clone(&from->num);
-    result.den = int_clone(&from->den);
-    return result;
+    if (is_small(from))
+        return *from;
+    return promote(from);
 }
 
 void fract_reduce(Fraction* f)
 {
+    if (is_small(f))
+    {
+        bool ok = make_small(f, f->small_num, f->small_den);
+        assert(ok);
+        return;
+    }
+
     assert(!int_is_zero(&f->den));
     if (f->den.negative)
     {
@@ -182,23 +331,28 @@ void fract_reduce(Fraction* f)
     bool ok1 = int_div(&f->num, &gcd, NULL);
     bool ok2 = int_div(&f->den, &gcd, NULL);
     assert(ok1 && ok2);
+
+    normalize(f);
 }
 
 bool fract_is_zero(Fraction const* f)
 {
     quick_asserts(f);
+    if (is_small(f)) return f->small_num == 0;
     return int_is_zero(&f->num);
 }
 
 bool fract_is_negative(Fraction const* f)
 {
     quick_asserts(f);
+    if (is_small(f)) return f->small_num < 0;
     return f->num.negative;
 }
 
 bool fract_is_integer(Fraction const* f)
 {
     quick_asserts(f);
+    if (is_small(f)) return f->small_den == 1;
     return f->den.size == 1 && f->den.digit[0] == 1;
 }
 
@@ -206,15 +360,56 @@ bool fract_equals(Fraction const* a, Fraction const* b)
 {
     quick_asserts(a);
     quick_asserts(b);
+    if (is_small(a) != is_small(b))
+        return false;  // representations are canonical
+    if (is_small(a))
+        return a->small_num == b->small_num
+            && a->small_den == b->small_den;
     return int_compare(&a->num, &b->num) == 0
         && int_compare(&a->den, &b->den) == 0;
 }
 
+u64 fract_hash(Fraction const* f)
+{
+    quick_asserts(f);
+    if (is_small(f))
+        return hash_u64(f->small_num) ^ (hash_u64(f->small_den) * 3);
+
+    u64 hash = hash_u64(f->num.negative);
+    hash ^= hash64(f->num.digit, f->num.size * sizeof(*f->num.digit));
+    hash ^= hash64(f->den.digit, f->den.size * sizeof(*f->den.digit)) * 5;
+    return hash;
+}
+
+Integer fract_get_numerator(Fraction const* f)
+{
+    quick_asserts(f);
+    Integer result = {};
+    if (is_small(f))
+        int_sets64(&result, f->small_num);
+    else
+        result = int_clone(&f->num);
+    return result;
+}
+
+Integer fract_get_denominator(Fraction const* f)
+{
+    quick_asserts(f);
+    Integer result = {};
+    if (is_small(f))
+        int_sets64(&result, f->small_den);
+    else
+        result = int_clone(&f->den);
+    return result;
+}
+
 Fraction fract_neg(Fraction const* a)
 {
     quick_asserts(a);
     Fraction result = fract_clone(a);
-    if (!int_is_zero(&result.num))
+    if (is_small(&result))
+        result.small_num = -result.small_num;
+    else if (!int_is_zero(&result.num))
         int_negate(&result.num);
     return result;
 }
@@ -225,11 +420,25 @@ Fraction fract_add(Fraction const* a, Fraction const* b)
     quick_asserts(b);
 
     Fraction result = {};
-    int_mul(&result.num, &a->num, &b->den);
-    int_mul(&result.den, &a->den, &b->den);
+    if (is_small(a) && is_small(b))
+    {
+        // |num| < 2^127 and den < 2^126, so this can't overflow.
+        s128 num = (s128) a->small_num * b->small_den + (s128) b->small_num * a->small_den;
+        s128 den = (s128) a->small_den * b->small_den;
+        if (make_small(&result, num, den))
+            return result;
+    }
+
+    Fraction big_a = promote(a);
+    Fraction big_b = promote(b);
+    Defer(fract_free(&big_a));
+    Defer(fract_free(&big_b));
+
+    int_mul(&result.num, &big_a.num, &big_b.den);
+    int_mul(&result.den, &big_a.den, &big_b.den);
 
     Integer temp = {};
-    int_mul(&temp, &b->num, &a->den);
+    int_mul(&temp, &big_b.num, &big_a.den);
     int_add(&result.num, &temp);
     int_free(&temp);
 
@@ -243,11 +452,24 @@ Fraction fract_sub(Fraction const* a, Fraction const* b)
     quick_asserts(b);
 
     Fraction result = {};
-    int_mul(&result.num, &a->num, &b->den);
-    int_mul(&result.den, &a->den, &b->den);
+    if (is_small(a) && is_small(b))
+    {
+        s128 num = (s128) a->small_num * b->small_den - (s128) b->small_num * a->small_den;
+        s128 den = (s128) a->small_den * b->small_den;
+        if (make_small(&result, num, den))
+            return result;
+    }
+
+    Fraction big_a = promote(a);
+    Fraction big_b = promote(b);
+    Defer(fract_free(&big_a));
+    Defer(fract_free(&big_b));
+
+    int_mul(&result.num, &big_a.num, &big_b.den);
+    int_mul(&result.den, &big_a.den, &big_b.den);
 
     Integer temp = {};
-    int_mul(&temp, &b->num, &a->den);
+    int_mul(&temp, &big_b.num, &big_a.den);
     int_sub(&result.num, &temp);
     int_free(&temp);
 
@@ -259,9 +481,20 @@ Fraction fract_mul(Fraction const* a, Fraction const* b)
 {
     quick_asserts(a);
     quick_asserts(b);
-    Fraction result = fract_clone(a);
-    int_mul(&result.num, &b->num);
-    int_mul(&result.den, &b->den);
+
+    if (is_small(a) && is_small(b))
+    {
+        Fraction result;
+        if (make_small(&result, (s128) a->small_num * b->small_num,
+                                (s128) a->small_den * b->small_den))
+            return result;
+    }
+
+    Fraction result = promote(a);
+    Fraction big_b  = promote(b);
+    Defer(fract_free(&big_b));
+    int_mul(&result.num, &big_b.num);
+    int_mul(&result.den, &big_b.den);
     fract_reduce(&result);
     return result;
 }
@@ -273,9 +506,17 @@ bool fract_div_fract(Fraction* out, Fraction const* a, Fraction const* b)
     quick_asserts(b);
     if (fract_is_zero(b))
         return false;
-    Fraction result = fract_clone(a);
-    int_mul(&result.num, &b->den);
-    int_mul(&result.den, &b->num);
+
+    if (is_small(a) && is_small(b))
+        if (make_small(out, (s128) a->small_num * b->small_den,
+                            (s128) a->small_den * b->small_num))
+            return true;
+
+    Fraction result = promote(a);
+    Fraction big_b  = promote(b);
+    Defer(fract_free(&big_b));
+    int_mul(&result.num, &big_b.den);
+    int_mul(&result.den, &big_b.num);
     fract_reduce(&result);
     *out = result;
     return true;
@@ -285,8 +526,17 @@ bool fract_div_whole(Fraction* out, Fraction const* a, Fraction const* b)
 {
     if (!fract_div_fract(out, a, b))
         return false;
+
+    if (is_small(out))
+    {
+        out->small_num /= out->small_den;  // truncates toward zero, same as int_div
+        out->small_den = 1;
+        return true;
+    }
+
     int_div(&out->num, &out->den, NULL);
     int_set16(&out->den, 1);
+    normalize(out);
     return true;
 }
 
@@ -294,6 +544,13 @@ bool fract_div_whole(Fraction* out, Fraction const* a, Fraction const* b)
 String fract_display(Fraction const* f, Region* memory)
 {
     quick_asserts(f);
+    if (is_small(f) && f->small_den == 1)
+        return Format(memory, "%", f->small_num);
+
+    Fraction big = promote(f);
+    Defer(fract_free(&big));
+    f = &big;
+
     if (fract_is_integer(f))
     {
         return int_base10(&f->num, memory);
@@ -344,6 +601,10 @@ String fract_display(Fraction const* f, Region* memory)
 String fract_display_hex(Fraction const* f, Region* memory)
 {
     quick_asserts(f);
+    Fraction big = promote(f);
+    Defer(fract_free(&big));
+    f = &big;
+
     if (fract_is_integer(f))
     {
         String result = int_base16(&f->num);
@@ -395,6 +656,10 @@ String fract_display_hex(Fraction const* f, Region* memory)
 bool fract_scientific_abs(Fraction const* f, umm count_decimals,
                           Integer* mantissa, smm* exponent, umm* mantissa_size, umm* msb)
 {
+    Fraction big = promote(f);
+    Defer(fract_free(&big));
+    f = &big;
+
     bool exact;
     {
         Integer num = int_clone(&f->num);
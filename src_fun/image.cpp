@@ -0,0 +1,622 @@
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+EnterApplicationNamespace
+
+
+// :BytecodeImage
+// With -compile, the program is compiled as usual, but the units which would run are only recorded
+// in Compiler::run_units. Once the pipeline is done, they are saved to an image, together with
+// every unit whose code they refer to, and the image can be run later without lexing, parsing or
+// inference.
+//
+// Patched bytecode is position independent, except for a few operands which are addresses:
+//  - OP_LITERALs with OP_A_IS_UNIT are the code of a unit, saved as an index into the unit list,
+//  - OP_LITERALs with OP_A_IS_DATA point at string data, saved as an offset into the blob,
+//  - OP_INTRINSICs point at their parameter block, and at their name. The parameters are looked up
+//    ahead of time, and saved as an Intrinsic_Binding, the name goes into the blob.
+// Units which use compiler intrinsics need the compiler when they run, so they can't be saved.
+//
+// The image holds Bytecode as it is in memory, so it can only be run by the same version of the
+// compiler, on the same kind of machine. The file is mapped copy-on-write and relocated in place.
+// Loaded units share an environment which has nothing but the user, there are no types or blocks.
+
+static constexpr u64 BYTECODE_IMAGE_MAGIC   = 0x31474D49424E5546ull;  // "FUNBIMG1"
+static constexpr u32 BYTECODE_IMAGE_VERSION = 1;
+
+struct Bytecode_Image_Section
+{
+    u64 offset;
+    u64 count;
+};
+
+struct Bytecode_Image_String
+{
+    u64 offset;  // into the blob
+    u64 length;
+};
+
+struct Bytecode_Image_Unit
+{
+    u64 storage_size;
+    u64 storage_alignment;
+    u64 first_bytecode;
+    u64 bytecode_count;
+    u64 first_instruction;
+    u64 entry_into_zeroed_storage;
+};
+
+struct Bytecode_Image_Binding
+{
+    u64 first_field;
+    u64 field_count;
+};
+
+struct Bytecode_Image_Field
+{
+    Bytecode_Image_String name;
+    Type                  type;
+    u32                   is_return;
+    u64                   offset;
+};
+
+struct Bytecode_Image_Header
+{
+    u64 magic;
+    u32 version;
+    u32 bytecode_size;  // sizeof(Bytecode)
+    u32 pointer_size;
+    u32 op_count;       // COUNT_OPS
+
+    Bytecode_Image_Section units;     // Bytecode_Image_Unit
+    Bytecode_Image_Section runs;      // u64, indices into units, in the order the units run
+    Bytecode_Image_Section bytecode;  // Bytecode
+    Bytecode_Image_Section bindings;  // Bytecode_Image_Binding
+    Bytecode_Image_Section fields;    // Bytecode_Image_Field
+    Bytecode_Image_Section blob;      // u8
+};
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Saving
+////////////////////////////////////////////////////////////////////////////////
+
+
+void bind_intrinsic(Unit* unit, Block* block, Dynamic_Array<Intrinsic_Field>* out_fields)
+{
+    Compiler* ctx = unit->env->ctx;
+
+    auto add_field = [&](Block* scope, Expression id, bool is_return, u64 base_offset)
+    {
+        auto* expr  = &scope->parsed_expressions  [id];
+        auto* infer = &scope->inferred_expressions[id];
+        if (is_soft_type(infer->type)) return;  // not in storage, so run_intrinsic wouldn't find it either
+
+        u64 offset;
+        assert(get(&scope->declaration_placement, &id, &offset));
+        Intrinsic_Field* field = reserve_item(out_fields);
+        field->name      = get_identifier(ctx, &expr->declaration.name);
+        field->type      = infer->type;
+        field->is_return = is_return;
+        field->offset    = base_offset + offset;
+    };
+
+    for (Expression id = {}; id < block->inferred_expressions.count; id = (Expression)(id + 1))
+    {
+        auto* expr  = &block->parsed_expressions  [id];
+        auto* infer = &block->inferred_expressions[id];
+        if (expr->flags & EXPRESSION_DECLARATION_IS_PARAMETER)
+            add_field(block, id, false, 0);
+        else if ((expr->flags & EXPRESSION_DECLARATION_IS_RETURN) && is_user_defined_type(infer->type))
+        {
+            u64 structure_offset;
+            assert(get(&block->declaration_placement, &id, &structure_offset));
+
+            Block* structure = get_user_type_data(unit->env, infer->type)->unit->entry_block;
+            for (Expression member = {}; member < structure->inferred_expressions.count; member = (Expression)(member + 1))
+                if (structure->parsed_expressions[member].kind == EXPRESSION_DECLARATION)
+                    add_field(structure, member, true, structure_offset);
+        }
+    }
+}
+
+
+struct Bytecode_Image_Writer
+{
+    String_Concatenator cat;
+    umm                 size;
+
+    String_Concatenator blob;
+    umm                 blob_size;
+
+    void add_section(Bytecode_Image_Section* section, void const* data, umm item_size, umm count)
+    {
+        while (size % 8) { *reserve_item(&cat) = 0; size++; }
+        section->offset = size;
+        section->count  = count;
+        add(&cat, data, item_size * count);
+        size += item_size * count;
+    }
+
+    u64 add_blob(void const* data, umm length)
+    {
+        u64 offset = blob_size;
+        add(&blob, data, length);
+        blob_size += length;
+        return offset;
+    }
+
+    Bytecode_Image_String add_string(String string)
+    {
+        return { add_blob(string.data, string.length), string.length };
+    }
+};
+
+bool save_bytecode_image(Compiler* ctx, String path)
+{
+    Bytecode_Image_Writer w = {};
+    Defer(free_concatenator(&w.cat));
+    Defer(free_concatenator(&w.blob));
+
+    Bytecode_Image_Header header = {};
+    header.magic         = BYTECODE_IMAGE_MAGIC;
+    header.version       = BYTECODE_IMAGE_VERSION;
+    header.bytecode_size = sizeof(Bytecode);
+    header.pointer_size  = sizeof(void*);
+    header.op_count      = COUNT_OPS;
+    add(&w.cat, &header, sizeof(header));
+    w.size = sizeof(header);
+
+    Dynamic_Array<Unit*>                  units    = {};
+    Dynamic_Array<u64>                    runs     = {};
+    Dynamic_Array<Bytecode_Image_Unit>    saved    = {};
+    Dynamic_Array<Bytecode>               bytecode = {};
+    Dynamic_Array<Bytecode_Image_Binding> bindings = {};
+    Dynamic_Array<Bytecode_Image_Field>   fields   = {};
+    Table(u64, u64, hash_u64) unit_index    = {};
+    Table(u64, u64, hash_u64) binding_index = {};
+    Defer(free_heap_array(&units));
+    Defer(free_heap_array(&runs));
+    Defer(free_heap_array(&saved));
+    Defer(free_heap_array(&bytecode));
+    Defer(free_heap_array(&bindings));
+    Defer(free_heap_array(&fields));
+    Defer(free_table(&unit_index));
+    Defer(free_table(&binding_index));
+
+    auto add_unit = [&](Unit* unit) -> u64
+    {
+        u64 key = (u64) unit;
+        u64 index;
+        if (get(&unit_index, &key, &index)) return index;
+        index = units.count;
+        set(&unit_index, &key, &index);
+        add_item(&units, &unit);
+        return index;
+    };
+
+    auto add_binding = [&](Unit* unit, Block* block) -> u64
+    {
+        u64 key = (u64) block;
+        u64 index;
+        if (get(&binding_index, &key, &index)) return index;
+        index = bindings.count;
+        set(&binding_index, &key, &index);
+
+        Dynamic_Array<Intrinsic_Field> bound = {};
+        Defer(free_heap_array(&bound));
+        bind_intrinsic(unit, block, &bound);
+
+        *reserve_item(&bindings) = { fields.count, bound.count };
+        For (bound)
+        {
+            Bytecode_Image_Field* field = reserve_item(&fields);
+            field->name      = w.add_string(it->name);
+            field->type      = it->type;
+            field->is_return = it->is_return;
+            field->offset    = it->offset;
+        }
+        return index;
+    };
+
+    For (ctx->run_units)
+    {
+        u64 index = add_unit(*it);
+        add_item(&runs, &index);
+    }
+
+    // Units are added while they are saved, when they are referred to.
+    for (umm unit_i = 0; unit_i < units.count; unit_i++)
+    {
+        Unit* unit = units[unit_i];
+        assert(unit->compiled_bytecode);
+
+        Bytecode_Image_Unit* image_unit = reserve_item(&saved);
+        image_unit->storage_size              = unit->storage_size;
+        image_unit->storage_alignment         = unit->storage_alignment;
+        image_unit->first_bytecode            = bytecode.count;
+        image_unit->bytecode_count            = unit->bytecode.count;
+        image_unit->first_instruction         = unit->entry_block->first_instruction;
+        image_unit->entry_into_zeroed_storage = unit->entry_into_zeroed_storage;
+
+        For (unit->bytecode)
+        {
+            Bytecode* bc = reserve_item(&bytecode);
+            *bc = *it;
+            bc->generated_from_block      = NULL;
+            bc->generated_from_expression = NO_EXPRESSION;
+
+            if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_UNIT))
+                bc->a = add_unit((Unit*) bc->a);
+            else if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_DATA))
+                bc->a = w.add_blob((void*) bc->a, bc->b);
+            else if (bc->op == OP_INTRINSIC)
+            {
+                String name = { (umm) bc->s, (u8*) bc->b };
+                if (prefix_equals(name, "compiler_"_s))
+                {
+                    String file;
+                    u32 line, column;
+                    get_line(ctx, get_token_info(ctx, &unit->initiator_from), &line, &column, &file);
+                    fprintf(stderr, "%.*s:%u:%u: The unit uses the intrinsic '%.*s', which needs the compiler when it runs, "
+                                    "so the program can't be compiled to an image.\n",
+                            StringArgs(file), line, column, StringArgs(name));
+                    return false;
+                }
+
+                bc->a = add_binding(unit, (Block*) bc->a);
+                bc->b = w.add_blob(name.data, name.length);
+                bc->flags |= OP_A_IS_BINDING;
+            }
+        }
+    }
+
+    w.add_section(&header.units,    saved.address,    sizeof(Bytecode_Image_Unit),    saved.count);
+    w.add_section(&header.runs,     runs.address,     sizeof(u64),                    runs.count);
+    w.add_section(&header.bytecode, bytecode.address, sizeof(Bytecode),               bytecode.count);
+    w.add_section(&header.bindings, bindings.address, sizeof(Bytecode_Image_Binding), bindings.count);
+    w.add_section(&header.fields,   fields.address,   sizeof(Bytecode_Image_Field),   fields.count);
+
+    String blob = resolve_to_string_and_free(&w.blob, temp);
+    w.add_section(&header.blob, blob.data, 1, blob.length);
+
+    String image = resolve_to_string_and_free(&w.cat, temp);
+    memcpy(image.data, &header, sizeof(header));
+    if (!write_entire_file(path, image))
+    {
+        fprintf(stderr, "Failed to write the image to %.*s\n", StringArgs(path));
+        return false;
+    }
+    return true;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Loading
+////////////////////////////////////////////////////////////////////////////////
+
+
+// Sizes of the types which bytecode refers to. A loaded image has no types of its own, strings are
+// the only user type it knows the size of. Returns false for types that can't be in bytecode.
+static bool get_image_type_size(u64 type, u64* out_size)
+{
+    if (type > U32_MAX) return false;
+    if (get_indirection((Type) type))  { *out_size = sizeof(void*);  return true; }
+    if (type == TYPE_STRING)           { *out_size = sizeof(String); return true; }
+    switch (type)
+    {
+    case TYPE_VOID:                                                  *out_size = 0;             return true;
+    case TYPE_U8:  case TYPE_S8:  case TYPE_BOOL:                    *out_size = 1;             return true;
+    case TYPE_U16: case TYPE_S16: case TYPE_F16:                     *out_size = 2;             return true;
+    case TYPE_U32: case TYPE_S32: case TYPE_F32: case TYPE_TYPE:     *out_size = 4;             return true;
+    case TYPE_U64: case TYPE_S64: case TYPE_F64:                     *out_size = 8;             return true;
+    case TYPE_UMM: case TYPE_SMM:                                    *out_size = sizeof(umm);   return true;
+    default:                                                                                    return false;
+    }
+}
+
+// Whether the instruction only refers to the storage and the instructions of its own unit. These are
+// the operands the IR sees (see get_bytecode_effects), checked before the image runs, so a broken image can't
+// make the interpreter read or write outside of the storage, or jump outside of the unit.
+static bool is_valid_image_instruction(Bytecode_Image_Unit const* unit, Bytecode const* bc, Array<Intrinsic_Binding> bindings)
+{
+    bool ok = true;
+    auto storage = [&](u64 offset, u64 size)
+    {
+        ok = ok && offset <= unit->storage_size && size <= unit->storage_size - offset;
+    };
+    auto type_size = [&](u64 type) -> u64
+    {
+        u64 size = 0;
+        ok = ok && get_image_type_size(type, &size);
+        return size;
+    };
+    auto target = [&](u64 instruction) { ok = ok && instruction < unit->bytecode_count; };
+
+    u64 pointer_size = sizeof(void*);
+    switch (bc->op)
+    {
+    default: return false;
+    case OP_ZERO:                   storage(bc->r, bc->s); break;
+    case OP_ZERO_INDIRECT:          storage(bc->r, pointer_size); break;
+    case OP_LITERAL:                storage(bc->r, bc->s); ok = ok && bc->s <= sizeof(bc->a); break;
+    case OP_COPY:                   storage(bc->r, bc->s);       storage(bc->a, bc->s); break;
+    case OP_COPY_FROM_INDIRECT:     storage(bc->r, bc->s);       storage(bc->a, pointer_size); break;
+    case OP_COPY_TO_INDIRECT:       storage(bc->r, pointer_size); storage(bc->a, bc->s); break;
+    case OP_COPY_BETWEEN_INDIRECT:  storage(bc->r, pointer_size); storage(bc->a, pointer_size); break;
+    case OP_ADDRESS:                storage(bc->r, pointer_size); storage(bc->a, 0); break;
+    case OP_NOT:                    storage(bc->r, 1); storage(bc->a, 1); break;
+    case OP_NEGATE:
+    case OP_ADD_IMMEDIATE:
+    case OP_SUBTRACT_IMMEDIATE:
+    case OP_MULTIPLY_IMMEDIATE:     storage(bc->r, type_size(bc->s)); storage(bc->a, type_size(bc->s)); break;
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE_WHOLE:
+    case OP_DIVIDE_FRACTIONAL:      storage(bc->r, type_size(bc->s)); storage(bc->a, type_size(bc->s)); storage(bc->b, type_size(bc->s)); break;
+    case OP_COMPARE:                storage(bc->r, 1); storage(bc->a, type_size(bc->s)); storage(bc->b, type_size(bc->s)); break;
+    case OP_COMPARE_IMMEDIATE:      storage(bc->r, 1); storage(bc->a, type_size(bc->s)); break;
+    case OP_MOVE_POINTER_CONSTANT:
+    case OP_MOVE_POINTER_IMMEDIATE: storage(bc->r, pointer_size); storage(bc->a, pointer_size); break;
+    case OP_MOVE_POINTER_FORWARD:
+    case OP_MOVE_POINTER_BACKWARD:
+    case OP_POINTER_DISTANCE:       storage(bc->r, pointer_size); storage(bc->a, pointer_size); storage(bc->b, pointer_size); break;
+    case OP_CAST:                   storage(bc->r, type_size(bc->s)); storage(bc->a, type_size(bc->b)); break;
+    case OP_GOTO:                   target(bc->r); break;
+    case OP_GOTO_IF_FALSE:          target(bc->r); storage(bc->a, 1); break;
+    case OP_GOTO_INDIRECT:          storage(bc->r, sizeof(umm)); break;
+    case OP_CALL:                   target(bc->r); storage(bc->a, sizeof(umm)); break;
+    case OP_SWITCH_UNIT:            storage(bc->r, pointer_size); storage(bc->a, pointer_size); break;
+    case OP_FINISH_UNIT:            storage(0, 3 * pointer_size); break;
+    case OP_DEBUG_PRINT:
+    {
+        // Other user types are printed without reading them.
+        bool is_other_user_type = bc->s <= U32_MAX && is_user_defined_type((Type) bc->s) && bc->s != TYPE_STRING;
+        if (!is_other_user_type) storage(bc->r, type_size(bc->s));
+    } break;
+    case OP_DEBUG_ALLOC:            storage(bc->r, pointer_size); storage(bc->a, sizeof(umm)); break;
+    case OP_DEBUG_FREE:             storage(bc->r, pointer_size); break;
+    case OP_INTRINSIC:
+    {
+        ok = (bc->flags & OP_A_IS_BINDING) && bc->a < bindings.count;
+        if (ok)
+            For (bindings[bc->a].fields)
+                storage(it->offset, type_size(it->type));
+    } break;
+    }
+    return ok;
+}
+
+bool run_bytecode_image(String path)
+{
+    int fd = open(make_c_style_string(path), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to read file %.*s\n", StringArgs(path));
+        return false;
+    }
+    Defer(close_file_descriptor(fd));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(Bytecode_Image_Header))
+    {
+        fprintf(stderr, "%.*s is not a bytecode image.\n", StringArgs(path));
+        return false;
+    }
+    umm size = st.st_size;
+
+    // Mapped privately and never unmapped, the loaded units run straight from the mapping.
+    byte* base = (byte*) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed to map file %.*s\n", StringArgs(path));
+        return false;
+    }
+
+    Bytecode_Image_Header* header = (Bytecode_Image_Header*) base;
+    if (header->magic != BYTECODE_IMAGE_MAGIC)
+    {
+        fprintf(stderr, "%.*s is not a bytecode image.\n", StringArgs(path));
+        return false;
+    }
+    if (header->version       != BYTECODE_IMAGE_VERSION ||
+        header->bytecode_size != sizeof(Bytecode)       ||
+        header->pointer_size  != sizeof(void*)          ||
+        header->op_count      != COUNT_OPS)
+    {
+        fprintf(stderr, "%.*s was compiled by a different version of the compiler, compile it again.\n", StringArgs(path));
+        return false;
+    }
+
+    auto section = [&]<typename T>(Bytecode_Image_Section const* s, T** out) -> bool
+    {
+        if (s->offset % alignof(T)) return false;
+        if (s->offset > size || s->count > (size - s->offset) / sizeof(T)) return false;
+        *out = (T*)(base + s->offset);
+        return true;
+    };
+
+    auto in_range = [](u64 first, u64 count, u64 total) -> bool
+    {
+        return first <= total && count <= total - first;
+    };
+
+    Bytecode_Image_Unit*    saved;
+    u64*                    runs;
+    Bytecode*               bytecode;
+    Bytecode_Image_Binding* saved_bindings;
+    Bytecode_Image_Field*   saved_fields;
+    u8*                     blob;
+    bool ok = section(&header->units,    &saved)          &&
+              section(&header->runs,     &runs)           &&
+              section(&header->bytecode, &bytecode)       &&
+              section(&header->bindings, &saved_bindings) &&
+              section(&header->fields,   &saved_fields)   &&
+              section(&header->blob,     &blob);
+
+    User* user = create_user();
+    Environment* env = alloc<Environment>(NULL);
+    env->user              = user;
+    env->pointer_size      = sizeof (void*);
+    env->pointer_alignment = alignof(void*);
+
+    Array<Intrinsic_Binding> bindings = allocate_array<Intrinsic_Binding>(NULL, ok ? header->bindings.count : 0);
+    for (umm i = 0; i < bindings.count && ok; i++)
+    {
+        Bytecode_Image_Binding* binding = &saved_bindings[i];
+        ok = in_range(binding->first_field, binding->field_count, header->fields.count);
+        if (!ok) break;
+
+        bindings[i].fields = allocate_array<Intrinsic_Field>(NULL, binding->field_count);
+        for (umm j = 0; j < binding->field_count && ok; j++)
+        {
+            Bytecode_Image_Field* saved_field = &saved_fields[binding->first_field + j];
+            Intrinsic_Field*      field       = &bindings[i].fields[j];
+            ok = in_range(saved_field->name.offset, saved_field->name.length, header->blob.count);
+            field->name      = { saved_field->name.length, blob + saved_field->name.offset };
+            field->type      = saved_field->type;
+            field->is_return = saved_field->is_return;
+            field->offset    = saved_field->offset;
+        }
+    }
+
+    Array<Unit>  units  = allocate_array<Unit> (NULL, ok ? header->units.count : 0);
+    Array<Block> blocks = allocate_array<Block>(NULL, units.count);
+    for (umm i = 0; i < units.count && ok; i++)
+    {
+        Bytecode_Image_Unit* image_unit = &saved[i];
+        ok = in_range(image_unit->first_bytecode, image_unit->bytecode_count, header->bytecode.count) &&
+             image_unit->first_instruction         < image_unit->bytecode_count &&
+             image_unit->entry_into_zeroed_storage < image_unit->bytecode_count &&
+             image_unit->storage_alignment && !(image_unit->storage_alignment & (image_unit->storage_alignment - 1));
+        for (umm j = 0; j < image_unit->bytecode_count && ok; j++)
+            ok = is_valid_image_instruction(image_unit, &bytecode[image_unit->first_bytecode + j], bindings);
+        if (!ok) break;
+
+        Block* entry = &blocks[i];
+        entry->first_instruction = image_unit->first_instruction;
+
+        Unit* unit = &units[i];
+        unit->flags                     = UNIT_IS_PLACED | UNIT_IS_PATCHED;
+        unit->entry_block               = entry;
+        unit->storage_size              = image_unit->storage_size;
+        unit->storage_alignment         = image_unit->storage_alignment;
+        unit->env                       = env;
+        unit->compiled_bytecode         = true;
+        unit->bytecode                  = { image_unit->bytecode_count, bytecode + image_unit->first_bytecode };
+        unit->entry_into_zeroed_storage = image_unit->entry_into_zeroed_storage;
+    }
+
+    for (umm i = 0; i < header->bytecode.count && ok; i++)
+    {
+        Bytecode* bc = &bytecode[i];
+        ok = bc->op < COUNT_OPS;
+        if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_UNIT))
+        {
+            ok = ok && bc->a < units.count;
+            if (ok) bc->a = (u64) &units[bc->a];
+        }
+        else if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_DATA))
+        {
+            ok = ok && in_range(bc->a, bc->b, header->blob.count);
+            bc->a = (u64)(blob + bc->a);
+        }
+        else if (bc->op == OP_INTRINSIC)
+        {
+            ok = ok && (bc->flags & OP_A_IS_BINDING) && bc->a < bindings.count && in_range(bc->b, bc->s, header->blob.count);
+            if (ok) bc->a = (u64) &bindings[bc->a];
+            bc->b = (u64)(blob + bc->b);
+        }
+    }
+
+    for (umm i = 0; i < header->runs.count && ok; i++)
+        ok = runs[i] < units.count;
+
+    if (!ok)
+    {
+        fprintf(stderr, "%.*s is not a valid bytecode image.\n", StringArgs(path));
+        return false;
+    }
+
+    for (umm i = 0; i < header->runs.count; i++)
+    {
+        Unit* unit = &units[runs[i]];
+
+        // Same as the pipeline does, see :ZeroedUnitStorage
+        byte* storage = user_alloc_zeroed(user, unit->storage_size, unit->storage_alignment);
+        enter_lockdown(user);
+        run_bytecode(user, { unit, unit->entry_into_zeroed_storage, storage });
+        exit_lockdown(user);
+    }
+    return true;
+}
+
+Dynamic_Array<String> make_broken_bytecode_images(String image)
+{
+    Dynamic_Array<String> broken = {};
+
+    Bytecode_Image_Header header;
+    if (image.length < sizeof(header)) return broken;
+    memcpy(&header, image.data, sizeof(header));
+
+    // The copies are in temp, which doesn't keep the alignment, so items are copied in and out.
+    auto read = [&]<typename T>(Bytecode_Image_Section const* section, umm index, T* out)
+    {
+        memcpy(out, image.data + section->offset + index * sizeof(T), sizeof(T));
+    };
+    auto add_broken = [&]<typename T>(Bytecode_Image_Section const* section, umm index, T const* item)
+    {
+        String copy = allocate_string(temp, image);
+        memcpy(copy.data + section->offset + index * sizeof(T), item, sizeof(T));
+        add_item(&broken, &copy);
+    };
+
+    for (umm i = 0; i < header.units.count; i++)
+    {
+        Bytecode_Image_Unit unit;
+        read(&header.units, i, &unit);
+        if (i == 0)
+        {
+            Bytecode_Image_Unit bad = unit;
+            bad.storage_alignment = 0;
+            add_broken(&header.units, i, &bad);
+            bad.storage_alignment = 3;
+            add_broken(&header.units, i, &bad);
+        }
+
+        bool broke_target  = false;
+        bool broke_operand = false;
+        for (umm j = 0; j < unit.bytecode_count; j++)
+        {
+            Bytecode bc;
+            read(&header.bytecode, unit.first_bytecode + j, &bc);
+
+            bool is_jump = bc.op == OP_GOTO || bc.op == OP_GOTO_IF_FALSE || bc.op == OP_CALL;
+            if (is_jump && !broke_target)
+            {
+                broke_target = true;
+                bc.r = unit.bytecode_count;  // one past the last instruction
+                add_broken(&header.bytecode, unit.first_bytecode + j, &bc);
+            }
+            else if ((bc.op == OP_ZERO || bc.op == OP_COPY) && bc.s && !broke_operand)
+            {
+                broke_operand = true;
+                bc.r = unit.storage_size - bc.s + 1;  // ends one byte past the storage
+                add_broken(&header.bytecode, unit.first_bytecode + j, &bc);
+            }
+        }
+    }
+    return broken;
+}
+
+
+ExitApplicationNamespace
@@ -69,6 +69,77 @@ static Block* materialize_block(Unit* unit, Block* materialize_from,
 }
 
 
+// :LazyImports
+// In lazy import mode, top-level aliases of imported units are inferred only when a name lookup
+// reaches them. Aliases always have soft types, so they don't allocate storage and don't generate
+// any code, which means deferring them doesn't change the placement of the unit.
+
+static Expression get_first_expression_of_statement(Block* block, Expression statement)
+{
+    // Subexpressions of a statement are parsed after the previous statement, and before the statement itself.
+    Expression first = {};
+    For (block->imperative_order)
+    {
+        if (*it == statement) return first;
+        first = (Expression)(*it + 1);
+    }
+    Unreachable;
+}
+
+static void make_aliases_lazy(Compiler* ctx, Block* block)
+{
+    For (block->imperative_order)
+    {
+        Expression statement = *it;
+        auto* expr = &block->parsed_expressions[statement];
+        if (expr->kind != EXPRESSION_DECLARATION) continue;
+        if (!(expr->flags & EXPRESSION_DECLARATION_IS_ALIAS)) continue;
+        if (expr->flags & EXPRESSION_DECLARATION_IS_USING) continue;  // every lookup in the unit goes through these
+
+        // Calls materialize blocks in this unit, which can't happen once the unit is placed.
+        Expression first = get_first_expression_of_statement(block, statement);
+        bool has_call = false;
+        for (Expression id = first; id <= statement; id = (Expression)(id + 1))
+            if (block->parsed_expressions[id].kind == EXPRESSION_CALL)
+                has_call = true;
+        if (has_call) continue;
+
+        for (Expression id = first; id <= statement; id = (Expression)(id + 1))
+        {
+            auto* infer = &block->inferred_expressions[id];
+            infer->flags |= INFERRED_EXPRESSION_IS_LAZY | INFERRED_EXPRESSION_IS_NOT_DEMANDED;
+            infer->flags |= INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME;
+            infer->flags |= INFERRED_EXPRESSION_DOES_NOT_ALLOCATE_STORAGE;
+        }
+        ctx->count_lazy_declarations++;
+    }
+}
+
+static void demand_declaration(Block* block, Expression declaration)
+{
+    if (!(block->inferred_expressions[declaration].flags & INFERRED_EXPRESSION_IS_NOT_DEMANDED))
+        return;
+
+    Expression first = get_first_expression_of_statement(block, declaration);
+    for (Expression id = first; id <= declaration; id = (Expression)(id + 1))
+        block->inferred_expressions[id].flags &= ~INFERRED_EXPRESSION_IS_NOT_DEMANDED;
+
+    Unit* unit = block->materialized_by_unit;
+    unit->env->ctx->count_demanded_declarations++;
+
+    // If the block is still being inferred, it will pick up the declaration by itself.
+    if (!(block->flags & BLOCK_HAS_COMPLETED_INFERENCE)) return;
+    if (block->flags & BLOCK_IS_INFERRING_ON_DEMAND)     return;
+    block->flags |= BLOCK_IS_INFERRING_ON_DEMAND;
+
+    Pipeline_Task task = {};
+    task.kind  = PIPELINE_TASK_INFER_BLOCK;
+    task.unit  = unit;
+    task.block = block;
+    add_item(&unit->env->pipeline, &task);
+}
+
+
 
 User_Type* get_user_type_data(Environment* env, Type type)
 {
@@ -182,6 +253,24 @@ String exact_type_description(Unit* unit, Type type)
 
 
 
+// Returns the index of the first occurrence of 'atom' at or after 'from', or atoms.count if there is none.
+// This is the inner loop of name lookup, so it compares four atoms at a time.
+static umm find_atom(Array<Atom const> atoms, umm from, Atom atom)
+{
+    umm i = from;
+    __m128i needle = _mm_set1_epi32((int) atom);
+    for (; i + 4 <= atoms.count; i += 4)
+    {
+        __m128i column = _mm_loadu_si128((__m128i const*) &atoms.address[i]);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(column, needle)));
+        if (mask) return i + __builtin_ctz(mask);
+    }
+    for (; i < atoms.count; i++)
+        if (atoms[i] == atom)
+            return i;
+    return atoms.count;
+}
+
 static Find_Result find_declaration_internal(
         Environment* env, Token const* name,
         Block* scope, Visibility visibility_limit,
@@ -200,13 +289,15 @@ static Find_Result find_declaration_internal(
         add_item(visited_scopes, &scope);
 
         // 1: try to find normal declarations
-        for (Expression id = {}; id < scope->parsed_expressions.count; id = (Expression)(id + 1))
+        // Only expressions which declare or delete this name matter, so skip straight to them.
+        Array<Atom const> names = scope->parsed_names;
+        for (umm i = find_atom(names, 0, name->atom); i < names.count; i = find_atom(names, i + 1, name->atom))
         {
+            Expression id = (Expression) i;
             auto* expr = &scope->parsed_expressions[id];
             // if the name is deleted, forget it
             if (expr->kind == EXPRESSION_DELETE &&
-                (expr->visibility_limit <= visibility_limit || visibility_limit == NO_VISIBILITY) &&
-                expr->deleted_name.atom == name->atom)
+                (expr->visibility_limit <= visibility_limit || visibility_limit == NO_VISIBILITY))
             {
                 *out_decl_scope = scope;
                 *out_decl_expr = id;
@@ -216,8 +307,7 @@ static Find_Result find_declaration_internal(
             // if we found a name and didn't delete it, no need to keep looking
             else if (status != FIND_FAILURE && status != FIND_DELETED) continue;
             // if it's not a declaration of the name we want, don't care
-            else if (expr->kind != EXPRESSION_DECLARATION ||
-                     expr->declaration.name.atom != name->atom) continue;
+            else if (expr->kind != EXPRESSION_DECLARATION) continue;
             // if the declaration is not visible, don't care
             else if ((expr->flags & EXPRESSION_DECLARATION_IS_ORDERED) &&
                      (expr->visibility_limit >= visibility_limit ||
@@ -233,14 +323,13 @@ static Find_Result find_declaration_internal(
         // 2: try to find declarations from a used scope
         if (out_use_chain)
         {
-            for (Expression id = {}; id < scope->parsed_expressions.count; id = (Expression)(id + 1))
+            for (Expression id = {}; id < scope->parsed_kinds.count; id = (Expression)(id + 1))
             {
-                auto* expr = &scope->parsed_expressions[id];
+                Expression_Kind kind = scope->parsed_kinds[id];
 
                 // if the name is deleted, forget it
-                if (expr->kind == EXPRESSION_DELETE &&
-                    (expr->visibility_limit <= visibility_limit || visibility_limit == NO_VISIBILITY) &&
-                    expr->deleted_name.atom == name->atom)
+                if (kind == EXPRESSION_DELETE && scope->parsed_names[id] == name->atom &&
+                    (scope->parsed_expressions[id].visibility_limit <= visibility_limit || visibility_limit == NO_VISIBILITY))
                 {
                     *out_decl_scope = scope;
                     *out_decl_expr = id;
@@ -250,8 +339,8 @@ static Find_Result find_declaration_internal(
                 // if we found a name and didn't delete it, no need to keep looking
                 else if (status != FIND_FAILURE && status != FIND_DELETED) continue;
                 // if it's not a using declaration, don't care
-                if (expr->kind != EXPRESSION_DECLARATION ||
-                    !(expr->flags & EXPRESSION_DECLARATION_IS_USING)) continue;
+                if (kind != EXPRESSION_DECLARATION ||
+                    !(scope->parsed_flags[id] & EXPRESSION_DECLARATION_IS_USING)) continue;
 
                 auto* infer = &scope->inferred_expressions[id];
                 if (infer->type == INVALID_TYPE)
@@ -558,13 +647,40 @@ static bool set_inferred_type(Block* block, Expression id, Type type)
 
 
 
-Constant* get_constant(Block* block, Expression expr, Type type_assertion)
+Constant const* get_constant(Block* block, Expression expr, Type type_assertion)
 {
     auto* infer = &block->inferred_expressions[expr];
     assert(infer->type == type_assertion);
     if (infer->constant == INVALID_CONSTANT)
         return NULL;
-    return &block->constants[infer->constant];
+    Compiler* ctx = block->materialized_by_unit->env->ctx;
+    return ctx->constant_pool[infer->constant];
+}
+
+// Takes ownership of the value. If an equal constant is already pooled,
+// the value is freed and the existing index is returned.
+u64 intern_constant(Compiler* ctx, Type type, Constant* value)
+{
+    assert(is_soft_type(type) && type != TYPE_SOFT_ZERO);
+
+    Constant_Key key = { type, value };
+    u64 existing;
+    if (get(&ctx->constant_pool_index, &key, &existing))
+    {
+        if (type == TYPE_SOFT_NUMBER)
+            fract_free(&value->number);
+        return existing;
+    }
+
+    Constant* pooled = PushValue(&ctx->constant_memory, Constant);
+    *pooled = *value;
+
+    u64 index = ctx->constant_pool.count;
+    add_item(&ctx->constant_pool, (Constant const**) &pooled);
+
+    key.constant = pooled;
+    set(&ctx->constant_pool_index, &key, &index);
+    return index;
 }
 
 void set_constant(Compiler* ctx, Block* block, Expression expr, Type type_assertion, Constant* value)
@@ -573,8 +689,7 @@ void set_constant(Compiler* ctx, Block* block, Expression expr, Type type_assert
     assert(!(infer->flags & INFERRED_EXPRESSION_COMPLETED_INFERENCE));
     assert(infer->type == type_assertion);
     assert(infer->constant == INVALID_CONSTANT);
-    infer->constant = block->constants.count;
-    add_item(&block->constants, value);
+    infer->constant = intern_constant(ctx, type_assertion, value);
     ctx->count_inferred_constants++;
 }
 
@@ -582,47 +697,42 @@ void set_constant(Compiler* ctx, Block* block, Expression expr, Type type_assert
 
 static bool copy_constant(Environment* env, Block* to_block, Expression to_id, Block* from_block, Expression from_id, Type type_assertion, Token const* alias = NULL)
 {
-    Constant* constant_ptr = get_constant(from_block, from_id, type_assertion);
-    if (!constant_ptr) return false;
-    Constant constant = *constant_ptr;
+    auto* from_infer = &from_block->inferred_expressions[from_id];
+    auto* to_infer   = &to_block  ->inferred_expressions[to_id];
+    assert(from_infer->type == type_assertion);
+    if (from_infer->constant == INVALID_CONSTANT) return false;
 
-    switch (type_assertion)
+    Constant const* constant = env->ctx->constant_pool[from_infer->constant];
+    if (type_assertion == TYPE_SOFT_TYPE && alias && is_user_defined_type(constant->type))
     {
-
-    case TYPE_SOFT_NUMBER:
-        constant.number = fract_clone(&constant.number);
-        break;
-
-    case TYPE_SOFT_BOOL:
-        break;
-
-    case TYPE_SOFT_TYPE:
-        if (alias && is_user_defined_type(constant.type))
-        {
-            User_Type* data = get_user_type_data(env, constant.type);
-            if (!data->has_alias)
-            {
-                data->has_alias = true;
-                data->alias = *alias;
-            }
-        }
-        break;
-
-    case TYPE_SOFT_BLOCK:
-        if (alias && !constant.block.has_alias)
+        User_Type* data = get_user_type_data(env, constant->type);
+        if (!data->has_alias)
         {
-            constant.block.has_alias = true;
-            constant.block.alias = *alias;
+            data->has_alias = true;
+            data->alias = *alias;
         }
-        break;
+    }
 
-    IllegalDefaultCase;
+    if (type_assertion == TYPE_SOFT_BLOCK && alias && !constant->block.has_alias)
+    {
+        // The alias is part of the pooled value, so this is a different constant.
+        Constant aliased = *constant;
+        aliased.block.has_alias = true;
+        aliased.block.alias = *alias;
+        set_constant(env->ctx, to_block, to_id, type_assertion, &aliased);
+        return true;
     }
 
-    set_constant(env->ctx, to_block, to_id, type_assertion, &constant);
+    // Pooled constants are immutable, so sharing the index is enough.
+    assert(!(to_infer->flags & INFERRED_EXPRESSION_COMPLETED_INFERENCE));
+    assert(to_infer->type == type_assertion);
+    assert(to_infer->constant == INVALID_CONSTANT);
+    to_infer->constant = from_infer->constant;
+    env->ctx->count_inferred_constants++;
     return true;
 }
 
+
 static bool check_constant_fits_in_runtime_type(Unit* unit, Parsed_Expression const* expr, Fraction const* fraction, Type type)
 {
 #define Error(...) return (report_error(ctx, expr, Format(temp, ##__VA_ARGS__)), false)
@@ -679,10 +789,14 @@ static bool check_constant_fits_in_runtime_type(Unit* unit, Parsed_Expression co
         // Check if the number is too small.
         else if (int_is_zero(&mantissa) || exponent < numeric.min_exponent_subnormal)
         {
-            int_set16(&f_prev.num, 0);
-            int_set16(&f_prev.den, 1);
-            int_set16(&f_next.num, 1);
-            int_set_bit(&f_next.den, count_decimals);
+            Integer one = {};
+            Integer den = {};
+            int_set16(&one, 1);
+            int_set_bit(&den, count_decimals);
+            f_prev = fract_make_u64(0);
+            f_next = fract_make(&one, &den);
+            int_free(&one);
+            int_free(&den);
             fits = false;
         }
         // Check if the mantissa is inexact.
@@ -744,13 +858,14 @@ static bool check_constant_fits_in_runtime_type(Unit* unit, Parsed_Expression co
         bool negative = fract_is_negative(fraction);
         if (negative)
         {
-            if (!fract_is_zero(&f_prev)) f_prev.num.negative = true;
-            if (!fract_is_zero(&f_next)) f_next.num.negative = true;
+            Fraction neg_prev = fract_neg(&f_prev);
+            Fraction neg_next = fract_neg(&f_next);
+            fract_free(&f_prev);
+            fract_free(&f_next);
+            f_prev = neg_prev;
+            f_next = neg_next;
         }
 
-        fract_reduce(&f_prev);
-        fract_reduce(&f_next);
-
         String s_prev = fract_display(&f_prev);
         String s_next = fract_display(&f_next);
         String s_frac = fract_display(fraction);
@@ -848,7 +963,9 @@ static bool check_constant_fits_in_runtime_type(Unit* unit, Parsed_Expression co
 
     u64 target_size = get_type_size(unit, type);
 
-    Integer const* integer = &fraction->num;
+    Integer numerator = fract_get_numerator(fraction);
+    Defer(int_free(&numerator));
+    Integer const* integer = &numerator;
     if (integer->negative)
     {
         if (is_unsigned_integer_type(type))
@@ -1197,20 +1314,13 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
     switch (expr->kind)
     {
 
-    case EXPRESSION_COMMENT:
-        infer->flags |= INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME;
-        infer->flags |= INFERRED_EXPRESSION_DOES_NOT_ALLOCATE_STORAGE;
-        InferType(TYPE_VOID);
-        InferenceComplete();
-
     case EXPRESSION_ZERO:    InferType(TYPE_SOFT_ZERO); InferenceComplete();
     case EXPRESSION_TRUE:    InferType(TYPE_SOFT_BOOL); set_constant_bool(ctx, block, id, true);  InferenceComplete();
     case EXPRESSION_FALSE:   InferType(TYPE_SOFT_BOOL); set_constant_bool(ctx, block, id, false); InferenceComplete();
     case EXPRESSION_NUMERIC_LITERAL:
     {
         InferType(TYPE_SOFT_NUMBER);
-        Token_Info_Number* token_info = (Token_Info_Number*) get_token_info(ctx, &expr->literal);
-        set_constant_number(ctx, block, id, fract_clone(&token_info->value));
+        set_constant_number(ctx, block, id, fract_clone(get_number_value(ctx, &expr->literal)));
         InferenceComplete();
     } break;
 
@@ -1244,7 +1354,10 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
         InferType(TYPE_SOFT_TYPE);
 
         Block* parent = (expr->flags & EXPRESSION_UNIT_IS_IMPORT) ? NULL : block;
+        umm unit_count_before = env->materialized_unit_count;
         Unit* new_unit = materialize_unit(env, expr->parsed_block, parent);
+        if (ctx->lazy_imports && (expr->flags & EXPRESSION_UNIT_IS_IMPORT) && env->materialized_unit_count != unit_count_before)
+            make_aliases_lazy(ctx, new_unit->entry_block);  // :LazyImports
         if (expr->parsed_block->flags & BLOCK_HAS_STRUCTURE_PLACEMENT)
             new_unit->flags |= UNIT_IS_STRUCT;
         set_constant_type(ctx, block, id, new_unit->type_id);
@@ -1278,9 +1391,10 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
                 return YIELD_ERROR;
             }
             assert(result == FIND_SUCCESS);
-            assert(!(unit->flags & UNIT_IS_PLACED));
+            assert(!(unit->flags & UNIT_IS_PLACED) || (infer->flags & INFERRED_EXPRESSION_IS_LAZY));
 
             set(&block->resolved_names, &id, &resolved);
+            demand_declaration(resolved.scope, resolved.declaration);
         }
 
         Inferred_Expression* decl_infer = &resolved.scope->inferred_expressions[resolved.declaration];
@@ -1338,9 +1452,10 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
                 return YIELD_ERROR;
             }
             assert(result == FIND_SUCCESS);
-            assert(!(unit->flags & UNIT_IS_PLACED));
+            assert(!(unit->flags & UNIT_IS_PLACED) || (infer->flags & INFERRED_EXPRESSION_IS_LAZY));
 
             set(&block->resolved_names, &id, &resolved);
+            demand_declaration(resolved.scope, resolved.declaration);
         }
 
         Inferred_Expression* decl_infer = &resolved.scope->inferred_expressions[resolved.declaration];
@@ -2174,12 +2289,12 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
                             return YIELD_ERROR;
                         }
 
-                        Constant* constant = get_constant(block, arg.expr_id, arg_type);
+                        Constant const* constant = get_constant(block, arg.expr_id, arg_type);
                         if (!constant)
                             WaitOperand(arg.expr_id);
 
                         equivalence_key->type     =  arg_type;
-                        equivalence_key->constant = *constant;
+                        equivalence_key->constant = constant;
                     }
                 }
             }
@@ -2213,7 +2328,7 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
                 {
                     printf("  type = %d", it->type);
                     if (it->type == TYPE_SOFT_NUMBER)
-                        printf("  number = %.*s", StringArgs(fract_display(&it->constant.number)));
+                        printf("  number = %.*s", StringArgs(fract_display(&it->constant->number)));
                     printf("\n");
                 }
                 printf(" ]\n");
@@ -2223,9 +2338,8 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
             {
                 // We didn't find an equivalent call, so we're the first here.
 
-                For (argument_keys)
-                    if (it->type == TYPE_SOFT_NUMBER)
-                        it->constant.number = fract_clone(&it->constant.number);
+                // Argument key constants point into the constant pool, which is immutable
+                // and outlives the call table, so they don't need to be cloned.
                 argument_keys = {};  // :ClearArgumentKeysOnMaterialization
 
                 call_value.caller_block    = block;
@@ -2244,7 +2358,7 @@ static Yield_Result infer_expression(Pipeline_Task* task, Expression id)
                 {
                     printf("  type = %d", it->type);
                     if (it->type == TYPE_SOFT_NUMBER)
-                        printf("  number = %.*s", StringArgs(fract_display(&it->constant.number)));
+                        printf("  number = %.*s", StringArgs(fract_display(&it->constant->number)));
                     printf("\n");
                 }
                 printf(" ]\n");
@@ -2701,6 +2815,7 @@ static Yield_Result infer_block(Pipeline_Task* task)
 #endif
         auto* infer = &block->inferred_expressions[id];
         if (infer->flags & INFERRED_EXPRESSION_COMPLETED_INFERENCE) continue;
+        if (infer->flags & INFERRED_EXPRESSION_IS_NOT_DEMANDED)     continue;
 
         Yield_Result result = infer_expression(task, id);
         if (result == YIELD_COMPLETED || result == YIELD_MADE_PROGRESS)
@@ -2725,17 +2840,19 @@ static Yield_Result infer_block(Pipeline_Task* task)
         // check if we are ready to do placement
         for (umm i = 0; i < block->inferred_expressions.count; i++)
         {
-            auto* expr  = &block->parsed_expressions  [i];
             auto* infer = &block->inferred_expressions[i];
 
+            if (infer->flags & INFERRED_EXPRESSION_IS_LAZY)
+                continue;  // :LazyImports
+
             if (infer->type == INVALID_TYPE)
                 goto skip_placement;
 
             if (!(infer->flags & INFERRED_EXPRESSION_IS_NOT_EVALUATED_AT_RUNTIME) &&
                 block->flags & BLOCK_HAS_STRUCTURE_PLACEMENT &&
-                expr->kind != EXPRESSION_DECLARATION)
+                block->parsed_kinds[i] != EXPRESSION_DECLARATION)
             {
-                report_error(ctx, expr, "Blocks with structured placement may not contain any expressions evaluated at runtime."_s);
+                report_error(ctx, &block->parsed_expressions[i], "Blocks with structured placement may not contain any expressions evaluated at runtime."_s);
                 return YIELD_ERROR;
             }
 
@@ -2766,6 +2883,14 @@ static Yield_Result infer_block(Pipeline_Task* task)
     if (waiting)
         return made_progress ? YIELD_MADE_PROGRESS : YIELD_NO_PROGRESS;
 
+    // The block was already counted as completed, this time we only inferred demanded declarations.
+    if (block->flags & BLOCK_IS_INFERRING_ON_DEMAND)
+    {
+        block->flags &= ~BLOCK_IS_INFERRING_ON_DEMAND;
+        return YIELD_COMPLETED;
+    }
+
+    block->flags |= BLOCK_HAS_COMPLETED_INFERENCE;
     assert(unit->blocks_not_completed > 0);
     if (--unit->blocks_not_completed == 0)
     {
@@ -2850,16 +2975,21 @@ Environment* make_environment(Compiler* ctx, Environment* puppeteer)
 
     add_item(&ctx->environments, &env);
 
-    String imports_relative_to_directory = "."_s; // not important, preload doesn't import
-    materialize_unit(env, parse_top_level_from_memory(
-        ctx, imports_relative_to_directory, "<preload>"_s,
-        R"XXX(
-            `string`@ :: struct
-            {
-                length: umm;
-                base: &u8;
-            }
-        )XXX"_s));
+    // Parsed blocks are immutable, so every environment can share the preload.
+    if (!ctx->preload)
+    {
+        String imports_relative_to_directory = "."_s; // not important, preload doesn't import
+        ctx->preload = parse_top_level_from_memory(
+            ctx, imports_relative_to_directory, "<preload>"_s,
+            R"XXX(
+                `string`@ :: struct
+                {
+                    length: umm;
+                    base: &u8;
+                }
+            )XXX"_s);
+    }
+    materialize_unit(env, ctx->preload);
     return env;
 }
 
@@ -2883,6 +3013,10 @@ Yield_Result pump_environment(Environment* env)
     Compiler* ctx = env->ctx;
     bool made_progress = false;
 
+    // Units which are generated together, see :ParallelCodegen
+    Dynamic_Array<Unit*> units_to_generate = {};
+    Defer(free_heap_array(&units_to_generate));
+
 continue_pipeline:
     if (env->puppeteer_event.kind != INVALID_PIPELINE_TASK)
     {
@@ -2901,6 +3035,7 @@ continue_pipeline:
 
     bool had_inference_tasks_to_do = false;
     bool had_placing_to_do = false;
+    units_to_generate.count = 0;
     for (umm it_index = 0; it_index < env->pipeline.count; it_index++)
     {
         bool task_completed = false;
@@ -2923,14 +3058,16 @@ continue_pipeline:
                 goto continue_pipeline;
             }
 
-            generate_bytecode_for_unit_placement(unit);
-            confirm_unit_placed(unit, unit->next_storage_offset, unit->storage_alignment);
-
             if (env->puppeteer)
             {
+                generate_bytecode_for_unit_placement(unit);
+                finish_bytecode_for_unit_placement(unit);
+                confirm_unit_placed(unit, unit->next_storage_offset, unit->storage_alignment);
                 wake_puppeteer(env, task, /* actionable */ false);
                 goto continue_pipeline;
             }
+
+            add_item(&units_to_generate, &unit);
         }
         else if (task.kind == PIPELINE_TASK_INFER_BLOCK)
         {
@@ -2971,6 +3108,17 @@ continue_pipeline:
         }
     }
 
+    if (units_to_generate.count)
+    {
+        generate_bytecode_for_units(ctx, units_to_generate, generate_bytecode_for_unit_placement);
+        For (units_to_generate)
+        {
+            Unit* unit = *it;
+            finish_bytecode_for_unit_placement(unit);
+            confirm_unit_placed(unit, unit->next_storage_offset, unit->storage_alignment);
+        }
+    }
+
     if (had_inference_tasks_to_do || had_placing_to_do)
     {
         if (made_progress)
@@ -3040,6 +3188,7 @@ continue_pipeline:
 
 
     bool had_patching_to_do = false;
+    units_to_generate.count = 0;
     for (umm it_index = 0; it_index < env->pipeline.count; it_index++)
     {
         Pipeline_Task task = env->pipeline[it_index];
@@ -3061,14 +3210,26 @@ continue_pipeline:
             goto continue_pipeline;
         }
 
-        generate_bytecode_for_unit_completion(unit);
-        confirm_unit_patched(unit);
-
         if (env->puppeteer)
         {
+            generate_bytecode_for_unit_completion(unit);
+            finish_bytecode_for_unit_completion(unit);
+            confirm_unit_patched(unit);
             wake_puppeteer(env, task, /* actionable */ false);
             goto continue_pipeline;
         }
+
+        add_item(&units_to_generate, &unit);
+    }
+
+    if (units_to_generate.count)
+    {
+        generate_bytecode_for_units(ctx, units_to_generate, generate_bytecode_for_unit_completion);
+        For (units_to_generate)
+        {
+            finish_bytecode_for_unit_completion(*it);
+            confirm_unit_patched(*it);
+        }
     }
 
     if (had_patching_to_do)
@@ -3082,9 +3243,19 @@ continue_pipeline:
         if (!(unit->flags & UNIT_IS_PATCHED))
             goto continue_pipeline;
 
+        if (ctx->compile_only && !env->puppeteer)
+        {
+            // The unit runs when the image is run instead, see :BytecodeImage
+            add_item(&ctx->run_units, &unit);
+            env->pipeline[0] = env->pipeline[env->pipeline.count - 1];
+            env->pipeline.count--;
+            made_progress = true;
+            goto continue_pipeline;
+        }
+
         Environment* env = unit->env;
-        byte* storage = user_alloc(env->user, unit->storage_size, unit->storage_alignment);
-        memset(storage, 0, 3 * sizeof(void*));
+        // Zeroed storage also means there's no unit to return to when this one finishes.
+        byte* storage = user_alloc_zeroed(env->user, unit->storage_size, unit->storage_alignment);
 
         task.kind = PIPELINE_TASK_RUN;
         if (env->puppeteer && env->puppeteer_has_custom_backend)
@@ -3095,7 +3266,7 @@ continue_pipeline:
         {
             assert(unit->compiled_bytecode);
             task.run_environment = env;
-            task.run_from = { unit, unit->entry_block->first_instruction, storage };
+            task.run_from = { unit, unit->entry_into_zeroed_storage, storage };  // :ZeroedUnitStorage
         }
     }
 
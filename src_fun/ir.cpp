@@ -0,0 +1,1037 @@
+#include <stdio.h>
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+
+EnterApplicationNamespace
+
+
+// :BytecodeIr
+// Once a unit's bytecode is patched, it's lifted into an IR which the optimization passes run
+// on, and then lowered back into bytecode.
+//
+// The IR is the bytecode itself, split into basic blocks, together with the effects of every
+// instruction: which ranges of storage it reads and writes, whether it reads or
+// writes memory through a pointer, and whether it runs code the IR doesn't see (calls, unit
+// switches and intrinsics). Values live in storage, not in virtual registers,
+// so it isn't SSA. Instead, the passes learn facts about those locations as they walk through
+// a basic block (this one holds a constant, that one holds a copy of another one), and forget
+// them whenever something might overwrite the location. No facts cross blocks.
+//
+// Declarations might be written through pointers, by intrinsics, or by other units, so only
+// facts about temporary storage (see Unit::temporary_storage) survive a write
+// through a pointer. Temporary storage which has its address taken is treated like any other.
+//
+// Passes only rewrite instructions in place or remove them. They never move them or allocate
+// storage, which was already confirmed at placement. So lowering just drops the removed
+// instructions, and moves jump targets, call targets and return address literals (see
+// OP_A_IS_INSTRUCTION) to where their instructions ended up.
+//
+// That's narrower than an SSA IR with virtual registers, on purpose. The interpreter, the native
+// backend and bytecode images all take bytecode whose operands are storage offsets, and storage
+// is confirmed at placement, before the unit is generated. Going out of SSA would need an
+// allocator which maps values back onto that storage, and the passes which SSA makes easy
+// (constant and copy propagation, common subexpressions, dead code) work well enough on facts
+// within a basic block, which is where nearly all the redundancy of the generated code is.
+// Passes which need facts across blocks, like global value numbering or loop invariant code
+// motion, aren't done here; loop invariant code motion happens while generating bytecode
+// instead, see :LoopInvariantCodeMotion.
+
+struct Ir_Instruction
+{
+    Bytecode   bc;
+    Ir_Effects effects;
+    bool       removed;
+};
+
+struct Ir_Block
+{
+    umm first;          // index of the first instruction
+    umm one_past_last;  // removed instructions might be anywhere in between
+    umm successors[2];
+    umm successor_count;
+    bool reachable;
+};
+
+struct Ir
+{
+    Unit* unit;
+    Array<Ir_Instruction>   instructions;
+    Dynamic_Array<Ir_Block> blocks;
+    Array<umm>              block_of;     // for every instruction
+    Array<bool>             is_leader;    // for every instruction
+    Array<Storage_Range>    temporaries;  // temporary storage which doesn't have its address taken
+    umm count_removed;
+};
+
+static constexpr umm NO_BLOCK = UMM_MAX;
+static constexpr umm IR_MAX_ROUNDS = 4;
+static constexpr umm IR_MAX_FACTS  = 64;  // per pass, so long blocks don't take quadratic time
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Effects
+
+
+Ir_Effects get_bytecode_effects(Unit* unit, Bytecode const* bc)
+{
+    u64 pointer_size = unit->env->pointer_size;
+    auto type_size = [&](u64 type) -> u64 { return type == TYPE_VOID ? 0 : get_type_size(unit, (Type) type); };
+
+    Ir_Effects effects = {};
+    effects.flags = IR_FALLS_THROUGH;
+
+    auto operand = [&](char field, u64 size) -> Ir_Operand
+    {
+        Ir_Operand operand = {};
+        operand.field = field;
+        operand.range.size = size;
+        switch (field)
+        {
+        IllegalDefaultCase;
+        case 'r': operand.range.offset = bc->r; break;
+        case 'a': operand.range.offset = bc->a; break;
+        case 'b': operand.range.offset = bc->b; break;
+        }
+        return operand;
+    };
+
+    auto read  = [&](char field, u64 size) { effects.reads[effects.read_count++] = operand(field, size); };
+    auto write = [&](char field, u64 size) { effects.writes = true; effects.write = operand(field, size); };
+
+    auto implied = [&](u64 offset, u64 size) -> Ir_Operand
+    {
+        Ir_Operand operand = {};
+        operand.range = { offset, size };
+        return operand;
+    };
+
+    switch (bc->op)
+    {
+    IllegalDefaultCase;
+    case OP_ZERO:                   write('r', bc->s); break;
+    case OP_ZERO_INDIRECT:          read('r', pointer_size); effects.flags |= IR_WRITES_MEMORY; break;
+    case OP_LITERAL:                write('r', bc->s); break;
+    case OP_COPY:                   read('a', bc->s); write('r', bc->s); break;
+    case OP_COPY_FROM_INDIRECT:     read('a', pointer_size); write('r', bc->s); effects.flags |= IR_READS_MEMORY; break;
+    case OP_COPY_TO_INDIRECT:       read('r', pointer_size); read('a', bc->s); effects.flags |= IR_WRITES_MEMORY; break;
+    case OP_COPY_BETWEEN_INDIRECT:  read('r', pointer_size); read('a', pointer_size); effects.flags |= IR_READS_MEMORY | IR_WRITES_MEMORY; break;
+    case OP_ADDRESS:                write('r', pointer_size); break;
+    case OP_NOT:                    read('a', 1); write('r', 1); break;
+    case OP_NEGATE:                 read('a', type_size(bc->s)); write('r', type_size(bc->s)); break;
+
+    // Division might trap, so it isn't removed even if nobody reads the result.
+    case OP_DIVIDE_WHOLE:
+    case OP_DIVIDE_FRACTIONAL:      effects.flags |= IR_HAS_SIDE_EFFECT; // fallthrough
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:               read('a', type_size(bc->s)); read('b', type_size(bc->s)); write('r', type_size(bc->s)); break;
+    case OP_COMPARE:                read('a', type_size(bc->s)); read('b', type_size(bc->s)); write('r', 1); break;
+    case OP_ADD_IMMEDIATE:
+    case OP_SUBTRACT_IMMEDIATE:
+    case OP_MULTIPLY_IMMEDIATE:     read('a', type_size(bc->s)); write('r', type_size(bc->s)); break;
+    case OP_COMPARE_IMMEDIATE:      read('a', type_size(bc->s)); write('r', 1); break;
+
+    case OP_MOVE_POINTER_CONSTANT:
+    case OP_MOVE_POINTER_IMMEDIATE: read('a', pointer_size); write('r', pointer_size); break;
+    case OP_MOVE_POINTER_FORWARD:
+    case OP_MOVE_POINTER_BACKWARD:
+    case OP_POINTER_DISTANCE:       read('a', pointer_size); read('b', pointer_size); write('r', pointer_size); break;
+    case OP_CAST:                   read('a', type_size(bc->b)); write('r', type_size(bc->s)); break;
+
+    case OP_GOTO:                   effects.flags = IR_JUMPS; break;
+    case OP_GOTO_IF_FALSE:          read('a', 1); effects.flags |= IR_JUMPS; break;
+    case OP_GOTO_INDIRECT:          read('r', sizeof(umm)); effects.flags = IR_LEAVES; break;
+    case OP_CALL:                   write('a', sizeof(umm)); effects.flags |= IR_JUMPS | IR_CLOBBERS_ALL | IR_HAS_SIDE_EFFECT; break;
+    case OP_SWITCH_UNIT:            read('r', pointer_size); read('a', pointer_size); effects.flags |= IR_CLOBBERS_ALL | IR_HAS_SIDE_EFFECT; break;
+    case OP_FINISH_UNIT:
+    {
+        effects.reads[effects.read_count++] = implied(0, 3 * sizeof(void*));
+        effects.flags = IR_LEAVES | IR_HAS_SIDE_EFFECT;
+    } break;
+    case OP_INTRINSIC:              effects.flags |= IR_CLOBBERS_ALL | IR_HAS_SIDE_EFFECT; break;
+    case OP_DEBUG_PRINT:            read('r', type_size(bc->s)); effects.flags |= IR_READS_MEMORY | IR_HAS_SIDE_EFFECT; break;
+    case OP_DEBUG_ALLOC:            read('a', sizeof(umm)); write('r', pointer_size); effects.flags |= IR_HAS_SIDE_EFFECT; break;
+    case OP_DEBUG_FREE:             read('r', pointer_size); effects.flags |= IR_WRITES_MEMORY | IR_HAS_SIDE_EFFECT; break;
+    }
+
+    return effects;
+}
+
+static bool overlaps(Ir_Range a, Ir_Range b)
+{
+    return a.size && b.size
+        && a.offset < b.offset + b.size
+        && b.offset < a.offset + a.size;
+}
+
+static bool same_range(Ir_Range a, Ir_Range b)
+{
+    return a.offset == b.offset && a.size == b.size;
+}
+
+umm find_storage_range(Array<Storage_Range const> ranges, u64 offset)
+{
+    umm low = 0, high = ranges.count;
+    while (low < high)
+    {
+        umm middle = low + (high - low) / 2;
+        Storage_Range const* range = &ranges[middle];
+        if (range->offset + range->size <= offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static umm find_temporary(Ir* ir, u64 offset)
+{
+    return find_storage_range(const_array(ir->temporaries), offset);
+}
+
+// Whether the range can only be read and written by instructions which name it directly.
+static bool is_private(Ir* ir, Ir_Range range)
+{
+    umm index = find_temporary(ir, range.offset);
+    if (index >= ir->temporaries.count) return false;
+    Storage_Range* temporary = &ir->temporaries[index];
+    return temporary->offset <= range.offset && range.offset + range.size <= temporary->offset + temporary->size;
+}
+
+static u64* get_operand(Bytecode* bc, char field)
+{
+    switch (field)
+    {
+    IllegalDefaultCase;
+    case 'r': return &bc->r;
+    case 'a': return &bc->a;
+    case 'b': return &bc->b;
+    }
+}
+
+static Ir_Operand* find_read(Ir_Instruction* in, char field)
+{
+    for (umm i = 0; i < in->effects.read_count; i++)
+        if (in->effects.reads[i].field == field)
+            return &in->effects.reads[i];
+    return NULL;
+}
+
+static void update_effects(Ir* ir, Ir_Instruction* in)
+{
+    in->effects = get_bytecode_effects(ir->unit, &in->bc);
+}
+
+static void remove_instruction(Ir* ir, Ir_Instruction* in)
+{
+    assert(!in->removed);
+    in->removed = true;
+    ir->count_removed++;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Control flow
+
+
+// The instruction itself if it isn't removed, otherwise the first one after it which isn't.
+static umm resolve(Ir* ir, umm instruction)
+{
+    while (instruction < ir->instructions.count && ir->instructions[instruction].removed)
+        instruction++;
+    return instruction;
+}
+
+static bool ends_block(Ir_Instruction* in)
+{
+    flags32 flags = in->effects.flags;
+    return !(flags & IR_FALLS_THROUGH) || (flags & (IR_JUMPS | IR_CLOBBERS_ALL));
+}
+
+static void build_blocks(Ir* ir)
+{
+    umm count = ir->instructions.count;
+    ir->blocks.count = 0;
+    memset(ir->is_leader.address, 0, count * sizeof(bool));
+
+    auto mark = [&](umm instruction)
+    {
+        instruction = resolve(ir, instruction);
+        if (instruction < count)
+            ir->is_leader[instruction] = true;
+    };
+
+    mark(0);
+    mark(ir->unit->entry_block->first_instruction);
+    mark(ir->unit->entry_into_zeroed_storage);
+    for (umm i = 0; i < count; i++)
+    {
+        Ir_Instruction* in = &ir->instructions[i];
+        if (in->removed) continue;
+        if (in->effects.flags & IR_JUMPS)
+            mark(in->bc.r);
+        if (in->bc.op == OP_LITERAL && (in->bc.flags & OP_A_IS_INSTRUCTION))
+            mark(in->bc.a);
+        if (ends_block(in))
+            mark(i + 1);
+    }
+
+    for (umm i = 0; i < count; i++)
+    {
+        ir->block_of[i] = NO_BLOCK;
+        if (ir->is_leader[i])
+        {
+            if (ir->blocks.count)
+                ir->blocks[ir->blocks.count - 1].one_past_last = i;
+            Ir_Block* block = reserve_item(&ir->blocks);
+            ZeroStruct(block);
+            block->first = i;
+        }
+        if (ir->blocks.count)
+            ir->block_of[i] = ir->blocks.count - 1;
+    }
+    if (ir->blocks.count)
+        ir->blocks[ir->blocks.count - 1].one_past_last = count;
+
+    For (ir->blocks)
+    {
+        umm last = it->one_past_last - 1;
+        while (ir->instructions[last].removed) last--;
+
+        Ir_Instruction* in = &ir->instructions[last];
+        umm next = resolve(ir, last + 1);
+        if ((in->effects.flags & IR_FALLS_THROUGH) && next < count)
+            it->successors[it->successor_count++] = ir->block_of[next];
+        if (in->effects.flags & IR_JUMPS)
+        {
+            umm target = resolve(ir, in->bc.r);
+            if (target < count)
+                it->successors[it->successor_count++] = ir->block_of[target];
+        }
+    }
+
+    Dynamic_Array<umm> worklist = {};
+    Defer(free_heap_array(&worklist));
+    auto reach = [&](umm instruction)
+    {
+        instruction = resolve(ir, instruction);
+        if (instruction >= count) return;
+        umm block = ir->block_of[instruction];
+        if (ir->blocks[block].reachable) return;
+        ir->blocks[block].reachable = true;
+        add_item(&worklist, &block);
+    };
+
+    reach(0);
+    reach(ir->unit->entry_block->first_instruction);
+    reach(ir->unit->entry_into_zeroed_storage);
+    while (worklist.count)
+    {
+        Ir_Block* block = &ir->blocks[worklist[worklist.count - 1]];
+        worklist.count--;
+        for (umm i = 0; i < block->successor_count; i++)
+            reach(ir->blocks[block->successors[i]].first);
+
+        // Return addresses are jumped to indirectly, so they are reachable if the literal is.
+        for (umm i = block->first; i < block->one_past_last; i++)
+        {
+            Ir_Instruction* in = &ir->instructions[i];
+            if (!in->removed && in->bc.op == OP_LITERAL && (in->bc.flags & OP_A_IS_INSTRUCTION))
+                reach(in->bc.a);
+        }
+    }
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Dumping and verification
+
+
+static void print_ir(Ir* ir, char const* title)
+{
+    Unit*     unit = ir->unit;
+    Compiler* ctx  = unit->env->ctx;
+
+    String file;
+    u32 line, column;
+    get_line(ctx, get_token_info(ctx, &unit->initiator_from), &line, &column, &file);
+    printf("[ir] %.*s:%u:%u %s, %llu instructions in %llu blocks\n", StringArgs(file), line, column, title,
+           (unsigned long long)(ir->instructions.count - ir->count_removed), (unsigned long long) ir->blocks.count);
+
+    for (umm b = 0; b < ir->blocks.count; b++)
+    {
+        Ir_Block* block = &ir->blocks[b];
+        printf("  block %llu%s", (unsigned long long) b, block->reachable ? "" : " (unreachable)");
+        for (umm i = 0; i < block->successor_count; i++)
+            printf("%s%llu", i ? ", " : " -> ", (unsigned long long) block->successors[i]);
+        printf("\n");
+
+        for (umm i = block->first; i < block->one_past_last; i++)
+        {
+            Ir_Instruction* in = &ir->instructions[i];
+            if (in->removed) continue;
+
+            Bytecode* bc = &in->bc;
+            String name = get_operation_name(bc->op);
+            printf("    %5llu  %-26.*s r %-6llx a %-6llx b %-6llx s %-6llx", (unsigned long long) i, StringArgs(name),
+                   (unsigned long long) bc->r, (unsigned long long) bc->a, (unsigned long long) bc->b, (unsigned long long) bc->s);
+            if (bc->flags & OP_A_IS_INSTRUCTION) printf(" a:instruction");
+            if (bc->flags & OP_A_IS_UNIT)        printf(" a:unit");
+            if (bc->flags & OP_A_IS_DATA)        printf(" a:data");
+            if (bc->flags & OP_COMPARE_EQUAL)    printf(" equal");
+            if (bc->flags & OP_COMPARE_GREATER)  printf(" greater");
+            if (bc->flags & OP_COMPARE_LESS)     printf(" less");
+            printf("\n");
+        }
+    }
+    fflush(stdout);
+}
+
+static void verify_ir(Ir* ir, char const* after)
+{
+    Unit* unit  = ir->unit;
+    umm   count = ir->instructions.count;
+
+    char const* problem = NULL;
+    umm instruction = 0;
+    auto fail = [&](umm at, char const* what) { if (!problem) { problem = what; instruction = at; } };
+
+    umm last = count;
+    for (umm i = 0; i < count; i++)
+    {
+        Ir_Instruction* in = &ir->instructions[i];
+        if (in->removed) continue;
+        last = i;
+
+        Bytecode* bc = &in->bc;
+        if (bc->op <= INVALID_OP || bc->op >= COUNT_OPS)
+        {
+            fail(i, "invalid operation");
+            continue;
+        }
+
+        if (in->effects.flags & IR_JUMPS)
+            if (resolve(ir, bc->r) >= count)
+                fail(i, "jump target is out of range");
+        if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_INSTRUCTION))
+            if (resolve(ir, bc->a) >= count)
+                fail(i, "return address is out of range");
+
+        auto check = [&](Ir_Operand* operand)
+        {
+            if (!operand->field) return;
+            Ir_Range range = operand->range;
+            if (range.offset + range.size > unit->storage_size)
+                fail(i, "operand is out of unit storage");
+        };
+        for (umm r = 0; r < in->effects.read_count; r++)
+            check(&in->effects.reads[r]);
+        if (in->effects.writes)
+            check(&in->effects.write);
+    }
+
+    if (last == count)
+        fail(0, "there are no instructions");
+    else if (ir->instructions[last].effects.flags & IR_FALLS_THROUGH)
+        fail(last, "the last instruction falls through");
+
+    umm entry = resolve(ir, unit->entry_block->first_instruction);
+    if (entry >= count)
+        fail(entry, "the entry block has no instructions");
+
+    if (!problem) return;
+    fprintf(stderr, "IR verification failed after %s, at instruction %llu: %s\n", after, (unsigned long long) instruction, problem);
+    print_ir(ir, after);
+    assert(false);
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Facts
+
+
+// Something known about a location, until it or one of the sources is written.
+struct Ir_Fact
+{
+    Ir_Range location;
+    Ir_Range sources[3];
+    umm      source_count;
+    bool     reads_memory;
+    u64      value;  // the constant, or the instruction which computed the location
+};
+
+static void forget_overwritten_facts(Ir* ir, Dynamic_Array<Ir_Fact>* facts, Ir_Instruction* in)
+{
+    Ir_Effects* effects = &in->effects;
+    if (effects->flags & IR_CLOBBERS_ALL)
+    {
+        facts->count = 0;
+        return;
+    }
+
+    bool writes_shared = effects->writes && !is_private(ir, effects->write.range);
+    for (umm i = 0; i < facts->count;)
+    {
+        Ir_Fact* fact = &(*facts)[i];
+        bool forget = false;
+
+        // Pointers might point to any storage which isn't private.
+        if (effects->flags & IR_WRITES_MEMORY)
+        {
+            forget |= fact->reads_memory || !is_private(ir, fact->location);
+            for (umm s = 0; s < fact->source_count; s++)
+                forget |= !is_private(ir, fact->sources[s]);
+        }
+        if (effects->writes)
+        {
+            forget |= writes_shared && fact->reads_memory;
+            forget |= overlaps(fact->location, effects->write.range);
+            for (umm s = 0; s < fact->source_count; s++)
+                forget |= overlaps(fact->sources[s], effects->write.range);
+        }
+
+        if (forget) unordered_remove_item(facts, i);
+        else        i++;
+    }
+}
+
+static Ir_Fact* learn_fact(Dynamic_Array<Ir_Fact>* facts)
+{
+    if (facts->count >= IR_MAX_FACTS)
+        unordered_remove_item(facts, 0);
+    Ir_Fact* fact = reserve_item(facts);
+    ZeroStruct(fact);
+    return fact;
+}
+
+static Ir_Fact* find_fact(Dynamic_Array<Ir_Fact>* facts, Ir_Range location)
+{
+    For (*facts)
+        if (same_range(it->location, location))
+            return it;
+    return NULL;
+}
+
+// Walks the instructions of every basic block, with the facts learned from earlier instructions
+// in the same block. The visitor returns true if it changed something.
+template <typename Visit>
+static bool visit_with_facts(Ir* ir, Visit&& visit)
+{
+    Dynamic_Array<Ir_Fact> facts = {};
+    Defer(free_heap_array(&facts));
+
+    bool changed = false;
+    For (ir->blocks)
+    {
+        facts.count = 0;
+        for (umm i = it->first; i < it->one_past_last; i++)
+        {
+            Ir_Instruction* in = &ir->instructions[i];
+            if (in->removed) continue;
+            if (visit(i, in, &facts))
+                changed = true;
+        }
+    }
+    return changed;
+}
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Passes
+
+
+static Expression_Kind get_compare_kind(flags32 flags)
+{
+    switch (flags & (OP_COMPARE_EQUAL | OP_COMPARE_GREATER | OP_COMPARE_LESS))
+    {
+    IllegalDefaultCase;
+    case OP_COMPARE_EQUAL:                      return EXPRESSION_EQUAL;
+    case OP_COMPARE_GREATER | OP_COMPARE_LESS:  return EXPRESSION_NOT_EQUAL;
+    case OP_COMPARE_GREATER:                    return EXPRESSION_GREATER_THAN;
+    case OP_COMPARE_GREATER | OP_COMPARE_EQUAL: return EXPRESSION_GREATER_OR_EQUAL;
+    case OP_COMPARE_LESS:                       return EXPRESSION_LESS_THAN;
+    case OP_COMPARE_LESS | OP_COMPARE_EQUAL:    return EXPRESSION_LESS_OR_EQUAL;
+    }
+}
+
+static void make_literal(Bytecode* bc, u64 value, u64 size)
+{
+    bc->op    = OP_LITERAL;
+    bc->flags = 0;
+    bc->a     = value;
+    bc->b     = 0;
+    bc->s     = size;
+}
+
+// Rewrites the instruction once, using the constants known to be in its operands.
+static bool fold_known_constants(Ir* ir, Ir_Instruction* in, Dynamic_Array<Ir_Fact>* facts)
+{
+    Unit* unit = ir->unit;
+    Bytecode* bc = &in->bc;
+
+    auto constant = [&](char field, u64* out_value) -> bool
+    {
+        Ir_Operand* operand = find_read(in, field);
+        if (!operand || operand->range.size > sizeof(u64)) return false;
+        Ir_Fact* fact = find_fact(facts, operand->range);
+        if (!fact) return false;
+        *out_value = fact->value;
+        return true;
+    };
+
+    u64 lhs, rhs;
+    switch (bc->op)
+    {
+    default: return false;
+
+    case OP_COPY:
+    {
+        if (bc->s > sizeof(u64) || !constant('a', &lhs)) return false;
+        make_literal(bc, lhs, bc->s);
+    } break;
+
+    case OP_NOT:
+    {
+        if (!constant('a', &lhs)) return false;
+        make_literal(bc, (u8) lhs ? 0 : 1, 1);
+    } break;
+
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_COMPARE:
+    {
+        if (!constant('b', &rhs))
+        {
+            if (bc->op == OP_SUBTRACT || !constant('a', &rhs)) return false;
+
+            // The constant is on the left, so the operands are swapped, see :ImmediateOperands
+            bc->a = bc->b;
+            bool greater = bc->flags & OP_COMPARE_GREATER;
+            bool less    = bc->flags & OP_COMPARE_LESS;
+            if (bc->op == OP_COMPARE && greater != less)
+                bc->flags ^= OP_COMPARE_GREATER | OP_COMPARE_LESS;
+        }
+
+        switch (bc->op)
+        {
+        IllegalDefaultCase;
+        case OP_ADD:      bc->op = OP_ADD_IMMEDIATE;      break;
+        case OP_SUBTRACT: bc->op = OP_SUBTRACT_IMMEDIATE; break;
+        case OP_MULTIPLY: bc->op = OP_MULTIPLY_IMMEDIATE; break;
+        case OP_COMPARE:  bc->op = OP_COMPARE_IMMEDIATE;  break;
+        }
+        bc->b = rhs;
+    } break;
+
+    case OP_ADD_IMMEDIATE:
+    case OP_SUBTRACT_IMMEDIATE:
+    case OP_MULTIPLY_IMMEDIATE:
+    case OP_COMPARE_IMMEDIATE:
+    {
+        if (!constant('a', &lhs)) return false;
+
+        Expression_Kind kind;
+        switch (bc->op)
+        {
+        IllegalDefaultCase;
+        case OP_ADD_IMMEDIATE:      kind = EXPRESSION_ADD;                  break;
+        case OP_SUBTRACT_IMMEDIATE: kind = EXPRESSION_SUBTRACT;             break;
+        case OP_MULTIPLY_IMMEDIATE: kind = EXPRESSION_MULTIPLY;             break;
+        case OP_COMPARE_IMMEDIATE:  kind = get_compare_kind(bc->flags);     break;
+        }
+
+        Type type = (Type) bc->s;
+        if (type == TYPE_F16) return false;
+        u64 size = bc->op == OP_COMPARE_IMMEDIATE ? 1 : get_type_size(unit, type);
+        make_literal(bc, fold_constant_operation(unit, kind, type, lhs, bc->b), size);
+    } break;
+
+    case OP_MOVE_POINTER_FORWARD:
+    case OP_MOVE_POINTER_BACKWARD:
+    {
+        if (!constant('b', &rhs)) return false;
+        if (bc->op == OP_MOVE_POINTER_BACKWARD)
+            rhs = -rhs;  // wraps around the same way the pointer would
+        bc->op = OP_MOVE_POINTER_IMMEDIATE;
+        bc->b  = rhs;
+    } break;
+
+    case OP_GOTO_IF_FALSE:
+    {
+        if (!constant('a', &lhs)) return false;
+        if ((u8) lhs)
+        {
+            remove_instruction(ir, in);
+            return true;
+        }
+        bc->op = OP_GOTO;
+        bc->a  = 0;
+    } break;
+    }
+
+    update_effects(ir, in);
+    return true;
+}
+
+static bool propagate_constants(Ir* ir)
+{
+    return visit_with_facts(ir, [&](umm index, Ir_Instruction* in, Dynamic_Array<Ir_Fact>* facts) -> bool
+    {
+        bool changed = false;
+        while (!in->removed && fold_known_constants(ir, in, facts))
+            changed = true;
+        if (in->removed) return changed;
+
+        forget_overwritten_facts(ir, facts, in);
+
+        Bytecode* bc = &in->bc;
+        // Addresses stay in the literals they came from, so they can be relocated, see :BytecodeImage
+        bool is_literal = bc->op == OP_LITERAL && !(bc->flags & (OP_A_IS_INSTRUCTION | OP_A_IS_UNIT | OP_A_IS_DATA));
+        if ((is_literal || bc->op == OP_ZERO) && bc->s <= sizeof(u64))
+        {
+            Ir_Fact* fact = learn_fact(facts);
+            fact->location = in->effects.write.range;
+            if (is_literal)
+                memcpy(&fact->value, &bc->a, bc->s);
+        }
+        return changed;
+    });
+}
+
+static bool propagate_copies(Ir* ir)
+{
+    return visit_with_facts(ir, [&](umm index, Ir_Instruction* in, Dynamic_Array<Ir_Fact>* facts) -> bool
+    {
+        bool changed = false;
+        Bytecode* bc = &in->bc;
+        for (umm i = 0; i < in->effects.read_count; i++)
+        {
+            Ir_Operand* operand = &in->effects.reads[i];
+            if (!operand->field) continue;
+
+            Ir_Fact* fact = find_fact(facts, operand->range);
+            if (!fact) continue;
+
+            *get_operand(bc, operand->field) = fact->sources[0].offset;
+            changed = true;
+        }
+        if (changed)
+            update_effects(ir, in);
+
+        forget_overwritten_facts(ir, facts, in);
+
+        if (bc->op == OP_COPY && !overlaps(in->effects.reads[0].range, in->effects.write.range))
+        {
+            Ir_Fact* fact = learn_fact(facts);
+            fact->location     = in->effects.write.range;
+            fact->sources[0]   = in->effects.reads[0].range;
+            fact->source_count = 1;
+        }
+        return changed;
+    });
+}
+
+static bool is_pure_expression(Bytecode_Operation op)
+{
+    switch (op)
+    {
+    case OP_COPY_FROM_INDIRECT:
+    case OP_ADDRESS:
+    case OP_NOT:
+    case OP_NEGATE:
+    case OP_ADD:
+    case OP_SUBTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE_WHOLE:
+    case OP_DIVIDE_FRACTIONAL:
+    case OP_COMPARE:
+    case OP_ADD_IMMEDIATE:
+    case OP_SUBTRACT_IMMEDIATE:
+    case OP_MULTIPLY_IMMEDIATE:
+    case OP_COMPARE_IMMEDIATE:
+    case OP_MOVE_POINTER_CONSTANT:
+    case OP_MOVE_POINTER_FORWARD:
+    case OP_MOVE_POINTER_BACKWARD:
+    case OP_MOVE_POINTER_IMMEDIATE:
+    case OP_POINTER_DISTANCE:
+    case OP_CAST:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool eliminate_common_subexpressions(Ir* ir)
+{
+    return visit_with_facts(ir, [&](umm index, Ir_Instruction* in, Dynamic_Array<Ir_Fact>* facts) -> bool
+    {
+        Bytecode* bc = &in->bc;
+        if (!is_pure_expression(bc->op))
+        {
+            forget_overwritten_facts(ir, facts, in);
+            return false;
+        }
+
+        For (*facts)
+        {
+            Bytecode* earlier = &ir->instructions[it->value].bc;
+            if (earlier->op != bc->op || earlier->a != bc->a || earlier->b != bc->b || earlier->s != bc->s) continue;
+            if (earlier->flags != bc->flags) continue;
+            if (it->location.size != in->effects.write.range.size) continue;
+
+            // A division by zero would have trapped at the earlier one already.
+            bc->op    = OP_COPY;
+            bc->flags = 0;
+            bc->a     = it->location.offset;
+            bc->b     = 0;
+            bc->s     = it->location.size;
+            update_effects(ir, in);
+            forget_overwritten_facts(ir, facts, in);
+            return true;
+        }
+
+        forget_overwritten_facts(ir, facts, in);
+
+        Ir_Effects* effects = &in->effects;
+        for (umm i = 0; i < effects->read_count; i++)
+            if (overlaps(effects->reads[i].range, effects->write.range))
+                return false;
+
+        Ir_Fact* fact = learn_fact(facts);
+        fact->location     = effects->write.range;
+        fact->source_count = effects->read_count;
+        for (umm i = 0; i < effects->read_count; i++)
+            fact->sources[i] = effects->reads[i].range;
+        fact->reads_memory = effects->flags & IR_READS_MEMORY;
+        fact->value        = index;
+        return false;
+    });
+}
+
+static bool is_removable(Ir* ir, Ir_Instruction* in)
+{
+    Ir_Effects* effects = &in->effects;
+    if (effects->flags & (IR_JUMPS | IR_LEAVES | IR_WRITES_MEMORY | IR_CLOBBERS_ALL | IR_HAS_SIDE_EFFECT)) return false;
+    if (!effects->writes) return false;
+    if (in->bc.op == OP_LITERAL && (in->bc.flags & OP_A_IS_INSTRUCTION)) return false;
+    return is_private(ir, effects->write.range);
+}
+
+static bool remove_unreachable_code(Ir* ir)
+{
+    bool changed = false;
+    For (ir->blocks)
+    {
+        if (it->reachable) continue;
+        for (umm i = it->first; i < it->one_past_last; i++)
+        {
+            if (ir->instructions[i].removed) continue;
+            remove_instruction(ir, &ir->instructions[i]);
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static bool remove_redundant_jumps(Ir* ir)
+{
+    bool changed = false;
+    for (umm i = 0; i < ir->instructions.count; i++)
+    {
+        Ir_Instruction* in = &ir->instructions[i];
+        if (in->removed) continue;
+        if (in->bc.op != OP_GOTO && in->bc.op != OP_GOTO_IF_FALSE) continue;
+        if (resolve(ir, in->bc.r) != resolve(ir, i + 1)) continue;
+        remove_instruction(ir, in);
+        changed = true;
+    }
+    return changed;
+}
+
+static bool remove_dead_temporary_writes(Ir* ir)
+{
+    Array<bool> is_read = allocate_array<bool>(NULL, ir->temporaries.count);
+    Defer(free_heap_array(&is_read));
+
+    For (ir->instructions)
+    {
+        if (it->removed) continue;
+        for (umm i = 0; i < it->effects.read_count; i++)
+        {
+            Ir_Range range = it->effects.reads[i].range;
+            for (umm t = find_temporary(ir, range.offset); t < ir->temporaries.count; t++)
+            {
+                if (ir->temporaries[t].offset >= range.offset + range.size) break;
+                is_read[t] = true;
+            }
+        }
+    }
+
+    bool changed = false;
+    For (ir->instructions)
+    {
+        if (it->removed || !it->effects.writes) continue;
+        if (!is_removable(ir, it)) continue;
+        if (is_read[find_temporary(ir, it->effects.write.range.offset)]) continue;
+        remove_instruction(ir, it);
+        changed = true;
+    }
+    return changed;
+}
+
+static bool eliminate_dead_code(Ir* ir)
+{
+    bool changed = false;
+    bool (*steps[])(Ir*) = { remove_unreachable_code, remove_redundant_jumps, remove_dead_temporary_writes };
+    for (auto step : steps)
+    {
+        if (!step(ir)) continue;
+        build_blocks(ir);
+        changed = true;
+    }
+    return changed;
+}
+
+struct Ir_Pass
+{
+    char const* name;
+    bool      (*run)(Ir* ir);
+};
+
+static Ir_Pass const ir_passes[] =
+{
+    { "constant propagation",             propagate_constants             },
+    { "copy propagation",                 propagate_copies                },
+    { "common subexpression elimination", eliminate_common_subexpressions },
+    { "dead code elimination",            eliminate_dead_code             },
+};
+
+
+
+////////////////////////////////////////////////////////////////////////////////
+// Lifting and lowering
+
+
+static void lift_bytecode(Ir* ir, Unit* unit)
+{
+    umm count = unit->bytecode.count;
+    ir->unit         = unit;
+    ir->instructions = allocate_array<Ir_Instruction>(NULL, count);
+    ir->block_of     = allocate_array<umm>(NULL, count);
+    ir->is_leader    = allocate_array<bool>(NULL, count);
+    for (umm i = 0; i < count; i++)
+    {
+        ir->instructions[i].bc = unit->bytecode[i];
+        update_effects(ir, &ir->instructions[i]);
+    }
+
+    // Temporaries which have their address taken might be read and written through pointers.
+    Array<bool> address_taken = allocate_array<bool>(NULL, unit->temporary_storage.count);
+    Defer(free_heap_array(&address_taken));
+    For (ir->instructions)
+    {
+        if (it->bc.op != OP_ADDRESS) continue;
+        umm index = find_storage_range(unit->temporary_storage, it->bc.a);
+        if (index < address_taken.count && unit->temporary_storage[index].offset <= it->bc.a)
+            address_taken[index] = true;
+    }
+
+    Dynamic_Array<Storage_Range> temporaries = {};
+    for (umm i = 0; i < unit->temporary_storage.count; i++)
+        if (!address_taken[i])
+            add_item(&temporaries, (Storage_Range*) &unit->temporary_storage[i]);
+    ir->temporaries = temporaries;
+
+    build_blocks(ir);
+}
+
+static void lower_ir(Ir* ir)
+{
+    Unit* unit  = ir->unit;
+    umm   count = ir->instructions.count;
+    if (!ir->count_removed)
+    {
+        Bytecode* bytecode = (Bytecode*) unit->bytecode.address;
+        for (umm i = 0; i < count; i++)
+            bytecode[i] = ir->instructions[i].bc;
+        return;
+    }
+
+    // Removed instructions are replaced by the first instruction after them that isn't.
+    Array<umm> new_index = allocate_array<umm>(NULL, count + 1);
+    Defer(free_heap_array(&new_index));
+    umm next = count - ir->count_removed;
+    new_index[count] = next;
+    for (umm i = count; i--;)
+    {
+        if (!ir->instructions[i].removed) next--;
+        new_index[i] = next;
+    }
+
+    Array<Bytecode> bytecode = allocate_array<Bytecode>(&unit->memory, count - ir->count_removed);
+    For (ir->instructions)
+    {
+        if (it->removed) continue;
+        Bytecode* bc = &bytecode[next++];
+        *bc = it->bc;
+        if (bc->op == OP_GOTO || bc->op == OP_GOTO_IF_FALSE || bc->op == OP_CALL)
+            bc->r = new_index[bc->r];
+        if (bc->op == OP_LITERAL && (bc->flags & OP_A_IS_INSTRUCTION))
+            bc->a = new_index[bc->a];
+    }
+    assert(next == bytecode.count);
+
+    // Other blocks' first instructions aren't used once the calls to them are patched.
+    unit->entry_block->first_instruction = new_index[unit->entry_block->first_instruction];
+    unit->entry_into_zeroed_storage      = new_index[unit->entry_into_zeroed_storage];
+    unit->bytecode = const_array(bytecode);
+}
+
+static void free_ir(Ir* ir)
+{
+    free_heap_array(&ir->instructions);
+    free_heap_array(&ir->blocks);
+    free_heap_array(&ir->block_of);
+    free_heap_array(&ir->is_leader);
+    free_heap_array(&ir->temporaries);
+}
+
+void optimize_bytecode(Unit* unit)
+{
+    Compiler* ctx = unit->env->ctx;
+    if (ctx->skip_ir_passes && !ctx->dump_ir) return;
+
+    Ir ir = {};
+    Defer(free_ir(&ir));
+    lift_bytecode(&ir, unit);
+    verify_ir(&ir, "lifting");
+    if (ctx->dump_ir) print_ir(&ir, "lifted");
+    if (ctx->skip_ir_passes) return;
+
+    bool changed = true;
+    for (umm round = 0; round < IR_MAX_ROUNDS && changed; round++)
+    {
+        changed = false;
+        for (Ir_Pass const& pass : ir_passes)
+        {
+            if (!pass.run(&ir)) continue;
+            changed = true;
+            build_blocks(&ir);
+            verify_ir(&ir, pass.name);
+        }
+    }
+
+    if (ctx->dump_ir) print_ir(&ir, "optimized");
+    lower_ir(&ir);
+    unit->count_ir_removed_instructions += ir.count_removed;
+}
+
+
+ExitApplicationNamespace
@@ -7,73 +7,150 @@
 EnterApplicationNamespace
 
 
-static void lex_init(Compiler* ctx)
+void lex_init(Compiler* ctx)
 {
     if (ctx->lexer_initialized)
         return;
 
     ctx->lexer_initialized = true;
-    ctx->lexer_memory.page_size = Megabyte(64);
-    set_capacity(&ctx->token_info_other,  Megabyte(256) / sizeof(ctx->token_info_other [0]));
-    set_capacity(&ctx->token_info_number, Megabyte(64)  / sizeof(ctx->token_info_number[0]));
-    set_capacity(&ctx->token_info_string, Megabyte(32)  / sizeof(ctx->token_info_string[0]));
-    set_capacity(&ctx->identifiers,       Megabyte(32)  / sizeof(ctx->identifiers      [0]));
-
-    ctx->next_identifier_atom = ATOM_FIRST_IDENTIFIER;
-
-#define AddKeyword(atom, string) { String k = string; Atom v = atom; set(&ctx->atom_table, &k, &v); }
-    AddKeyword(ATOM_ZERO,         "zero"_s);
-    AddKeyword(ATOM_TRUE,         "true"_s);
-    AddKeyword(ATOM_FALSE,        "false"_s);
-    AddKeyword(ATOM_VOID,         "void"_s);
-    AddKeyword(ATOM_U8,           "u8"_s);
-    AddKeyword(ATOM_U16,          "u16"_s);
-    AddKeyword(ATOM_U32,          "u32"_s);
-    AddKeyword(ATOM_U64,          "u64"_s);
-    AddKeyword(ATOM_UMM,          "umm"_s);
-    AddKeyword(ATOM_S8,           "s8"_s);
-    AddKeyword(ATOM_S16,          "s16"_s);
-    AddKeyword(ATOM_S32,          "s32"_s);
-    AddKeyword(ATOM_S64,          "s64"_s);
-    AddKeyword(ATOM_SMM,          "smm"_s);
-    AddKeyword(ATOM_F16,          "f16"_s);
-    AddKeyword(ATOM_F32,          "f32"_s);
-    AddKeyword(ATOM_F64,          "f64"_s);
-    AddKeyword(ATOM_BOOL,         "bool"_s);
-    AddKeyword(ATOM_STRUCT,       "struct"_s);
-    AddKeyword(ATOM_STRING,       "string"_s);
-    AddKeyword(ATOM_IMPORT,       "import"_s);
-    AddKeyword(ATOM_USING,        "using"_s);
-    AddKeyword(ATOM_TYPE,         "type"_s);
-    AddKeyword(ATOM_BLOCK,        "block"_s);
-    AddKeyword(ATOM_CODE_BLOCK,   "code_block"_s);
-    AddKeyword(ATOM_GLOBAL,       "global"_s);
-    AddKeyword(ATOM_THREAD_LOCAL, "thread_local"_s);
-    AddKeyword(ATOM_UNIT,         "unit"_s);
-    AddKeyword(ATOM_UNIT_LOCAL,   "unit_local"_s);
-    AddKeyword(ATOM_UNIT_DATA,    "unit_data"_s);
-    AddKeyword(ATOM_UNIT_CODE,    "unit_code"_s);
-    AddKeyword(ATOM_LABEL,        "label"_s);
-    AddKeyword(ATOM_GOTO,         "goto"_s);
-    AddKeyword(ATOM_DEBUG,        "debug"_s);
-    AddKeyword(ATOM_DEBUG_ALLOC,  "debug_alloc"_s);
-    AddKeyword(ATOM_DEBUG_FREE,   "debug_free"_s);
-    AddKeyword(ATOM_DELETE,       "delete"_s);
-    AddKeyword(ATOM_IF,           "if"_s);
-    AddKeyword(ATOM_ELSE,         "else"_s);
-    AddKeyword(ATOM_ELIF,         "elif"_s);
-    AddKeyword(ATOM_WHILE,        "while"_s);
-    AddKeyword(ATOM_DO,           "do"_s);
-    AddKeyword(ATOM_RUN,          "run"_s);
-    AddKeyword(ATOM_RETURN,       "return"_s);
-    AddKeyword(ATOM_YIELD,        "yield"_s);
-    AddKeyword(ATOM_DEFER,        "defer"_s);
-    AddKeyword(ATOM_CAST,         "cast"_s);
-    AddKeyword(ATOM_SIZEOF,       "sizeof"_s);
-    AddKeyword(ATOM_ALIGNOF,      "alignof"_s);
-    AddKeyword(ATOM_CODEOF,       "codeof"_s);
-    AddKeyword(ATOM_INTRINSIC,    "intrinsic"_s);
-#undef AddKeyword
+    ctx->lexer_memory.page_size = Megabyte(1);
+    make_atom_table(&ctx->atoms);
+}
+
+void grow_token_store(void** address, umm* committed)
+{
+    if (!*address)
+    {
+        *address = reserve_virtual_memory(TOKEN_STORE_RESERVE, TOKEN_STORE_CHUNK);
+        assert(*address);
+    }
+
+    // After the first small chunk, the rest of the first huge page is committed without the hint,
+    // so every later chunk is a whole aligned huge page.
+    umm chunk = TOKEN_STORE_CHUNK - *committed % TOKEN_STORE_CHUNK;
+    if (!*committed) chunk = TOKEN_STORE_FIRST_CHUNK;
+    assert(*committed + chunk <= TOKEN_STORE_RESERVE);
+    bool huge = (chunk == TOKEN_STORE_CHUNK && (umm) *address % TOKEN_STORE_CHUNK == 0);
+    bool ok = commit_virtual_memory((u8*) *address + *committed, chunk, huge);
+    assert(ok);
+    *committed += chunk;
+}
+
+void free_token_store(void** address)
+{
+    if (*address)
+        release_virtual_memory(*address, TOKEN_STORE_RESERVE);
+    *address = NULL;
+}
+
+Fraction const* get_number_value(Compiler* ctx, Token const* token)
+{
+    assert(token->atom == ATOM_NUMBER_LITERAL);
+    Token_Info_Number* info = &ctx->token_info_number[token->info_index];
+    if (!info->value_index)
+    {
+        *reserve_item(&ctx->number_values) = fract_make_scaled(info->mantissa, info->exponent_base, info->exponent);
+        info->value_index = ctx->number_values.count;
+    }
+    return &ctx->number_values[info->value_index - 1];
+}
+
+
+
+// The fast paths below look at 16 bytes per step with SSE2, for as long as a whole
+// chunk fits before 'end'. They stop at the first byte that needs attention, or when
+// fewer than 16 bytes remain - the scalar loops in lex_from_memory take over from there.
+// Needles are splatted once per call, because _mm_set1_epi8 is expensive in debug builds.
+
+static ForceInline __m128i lex_splat(u8 c)
+{
+    return _mm_shuffle_epi32(_mm_cvtsi32_si128(0x01010101u * c), 0);
+}
+
+static ForceInline u32 lex_match(__m128i bytes, __m128i needle)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle));
+}
+
+// Skips spaces, CRs and newlines, and records the start of every line it enters.
+static u8* lex_skip_blank(u8* cursor, u8* end, u8* start, Concatenator<u32>* line_offsets)
+{
+    __m128i space   = lex_splat(' ');
+    __m128i cr      = lex_splat('\r');
+    __m128i newline = lex_splat('\n');
+    while (end - cursor >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i const*) cursor);
+        u32 newlines = lex_match(bytes, newline);
+        u32 blank    = newlines | lex_match(bytes, space) | lex_match(bytes, cr);
+        u32 stop     = ~blank & 0xFFFF;
+        u32 length   = stop ? __builtin_ctz(stop) : 16;
+
+        newlines &= (1u << length) - 1;
+        while (newlines)
+        {
+            *reserve_item(line_offsets) = (cursor - start) + __builtin_ctz(newlines) + 1;
+            newlines &= newlines - 1;
+        }
+
+        cursor += length;
+        if (stop) break;
+    }
+    return cursor;
+}
+
+// Skips identifier continuation characters: [A-Za-z0-9_] and everything >= 0x80.
+// Keeps counting the identifier length with runs of underscores collapsed to one.
+static u8* lex_skip_identifier(u8* cursor, u8* end, umm* identifier_length, bool* previous_was_underscore)
+{
+    __m128i lower      = lex_splat(0x20);
+    __m128i a          = lex_splat('a');
+    __m128i zero       = lex_splat('0');
+    __m128i a_to_z     = lex_splat('z' - 'a');
+    __m128i zero_to_9  = lex_splat('9' - '0');
+    __m128i underscore = lex_splat('_');
+    while (end - cursor >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i const*) cursor);
+
+        // range checks as unsigned (c - low) <= (high - low)
+        __m128i letter = _mm_sub_epi8(_mm_or_si128(bytes, lower), a);
+        __m128i digit  = _mm_sub_epi8(bytes, zero);
+        letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, a_to_z),    letter);
+        digit  = _mm_cmpeq_epi8(_mm_min_epu8(digit,  zero_to_9), digit);
+
+        u32 underscores  = lex_match(bytes, underscore);
+        u32 continuation = _mm_movemask_epi8(_mm_or_si128(letter, digit)) | underscores | _mm_movemask_epi8(bytes);
+        u32 stop         = ~continuation & 0xFFFF;
+        u32 length       = stop ? __builtin_ctz(stop) : 16;
+        if (!length) break;
+
+        underscores &= (1u << length) - 1;
+        u32 repeated = underscores & ((underscores << 1) | (*previous_was_underscore ? 1 : 0));
+        *identifier_length      += length - __builtin_popcount(repeated);
+        *previous_was_underscore = (underscores >> (length - 1)) & 1;
+
+        cursor += length;
+        if (stop) break;
+    }
+    return cursor;
+}
+
+// Skips bytes until one of 'a', 'b', 'c' or 'd' (pass duplicates for fewer).
+static u8* lex_skip_until(u8* cursor, u8* end, u8 a, u8 b, u8 c, u8 d)
+{
+    __m128i needle_a = lex_splat(a);
+    __m128i needle_b = lex_splat(b);
+    __m128i needle_c = lex_splat(c);
+    __m128i needle_d = lex_splat(d);
+    while (end - cursor >= 16)
+    {
+        __m128i bytes = _mm_loadu_si128((__m128i const*) cursor);
+        u32 stop = lex_match(bytes, needle_a) | lex_match(bytes, needle_b) | lex_match(bytes, needle_c) | lex_match(bytes, needle_d);
+        if (stop) return cursor + __builtin_ctz(stop);
+        cursor += 16;
+    }
+    return cursor;
 }
 
 bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_tokens, Array<Token>* out_comments, Source_Info** out_source_info)
@@ -113,18 +190,21 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
 
     if (code.length >= U32_MAX)
     {
-        fprintf(stderr, "File %.*s is too large, limit is 4GB.\n", StringArgs(name));
+        if (!ctx->silence_reports)
+            fprintf(stderr, "File %.*s is too large, limit is 4GB.\n", StringArgs(name));
         return false;
     }
 
     if (ctx->sources.count > U16_MAX)
     {
-        fprintf(stderr, "Too many files, limit is 65536.\n");
+        if (!ctx->silence_reports)
+            fprintf(stderr, "Too many files, limit is 65536.\n");
         return false;
     }
 
     u16 source_index = ctx->sources.count;
     Source_Info* source = reserve_item(&ctx->sources);
+    ZeroStruct(source);
     source->name = allocate_string(&ctx->lexer_memory, name);
     source->code = code;
 
@@ -154,10 +234,11 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
         u32 line        = line_offsets.count;                   \
         u32 line_offset = line_offsets.base[line - 1];          \
         u32 column      = (cursor - start) - line_offset + 1;   \
-        fprintf(stderr, "%.*s\n"                                \
-                        " .. in %.*s @ %u:%u\n",                \
-            StringArgs(error_message), StringArgs(name),        \
-            line, column);                                      \
+        if (!ctx->silence_reports)                              \
+            fprintf(stderr, "%.*s\n"                            \
+                            " .. in %.*s @ %u:%u\n",            \
+                StringArgs(error_message), StringArgs(name),    \
+                line, column);                                  \
         return false;                                           \
     }
 
@@ -173,23 +254,89 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
     Defer(int_free(&integer_digit));
     int_set16(&integer_ten, 10);
 
-    while (cursor < end)
+    // Scans a literal (after its base prefix) which fits a u64 mantissa times a small power of
+    // its base, returns the end of the literal. Anything else, including malformed literals, is
+    // left for the Integer code, and this returns NULL.
+    auto scan_compact_number = [&](u8* cursor, u32 base, u8 digit_class, u64* out_mantissa, s32* out_exponent) -> u8*
     {
-        u8 c  = *cursor;
-        u8 cc = CHARACTER_CLASS[c];
-        if (c == '\n')
+        static constexpr s32 MAX_EXPONENT = 4000;
+
+        u64  mantissa    = 0;
+        s32  exponent    = 0;
+        bool in_fraction = false;
+        while (cursor < end)
         {
+            u8 c = *cursor;
+            if (CHARACTER_CLASS[c] & digit_class)
+            {
+                u64 digit = DIGIT_VALUE[c];
+                if (mantissa > (U64_MAX - digit) / base) return NULL;
+                if (in_fraction && --exponent < -MAX_EXPONENT) return NULL;
+                mantissa = mantissa * base + digit;
+            }
+            else if (c == '.' && !in_fraction)
+                in_fraction = true;
+            else if (c != '_')
+                break;
             cursor++;
-            *reserve_item(&line_offsets) = cursor - start;
-            continue;
         }
+        if (cursor < end && (CHARACTER_CLASS[*cursor] & CHARACTER_DIGIT_BASE16) && *cursor != 'e' && *cursor != 'E')
+            return NULL;
+
+        char exponent_char = (base == 16) ? 'p' : 'e';
+        if (cursor < end && (*cursor == exponent_char || *cursor == (exponent_char - 'a' + 'A')))
+        {
+            cursor++;
 
+            bool positive = true;
+            if (cursor < end)
+            {
+                     if (*cursor == '+') cursor++;
+                else if (*cursor == '-') cursor++, positive = false;
+            }
+
+            s32  power = 0;
+            bool found_at_least_one_digit = false;
+            while (cursor < end)
+            {
+                u8 c = *cursor;
+                if (CHARACTER_CLASS[c] & CHARACTER_DIGIT_BASE10)
+                {
+                    found_at_least_one_digit = true;
+                    power = power * 10 + DIGIT_VALUE[c];
+                    if (power > MAX_EXPONENT) return NULL;
+                }
+                else if (c != '_')
+                    break;
+                cursor++;
+            }
+            if (!found_at_least_one_digit) return NULL;
+            exponent += positive ? power : -power;
+        }
+
+        *out_mantissa = mantissa;
+        *out_exponent = exponent;
+        return cursor;
+    };
+
+    while (cursor < end)
+    {
+        u8 c  = *cursor;
+        u8 cc = CHARACTER_CLASS[c];
         if (c == '\t')
             LexError("Tab characters are not allowed as whitespace.")
 
         if (cc & CHARACTER_WHITE)
         {
-            cursor++;
+            // most runs are a single space, don't bother with the fast path for those
+            if (cursor + 1 < end && (CHARACTER_CLASS[cursor[1]] & CHARACTER_WHITE))
+                cursor = lex_skip_blank(cursor, end, start, &line_offsets);
+            while (cursor < end && (CHARACTER_CLASS[c = *cursor] & CHARACTER_WHITE) && c != '\t')
+            {
+                cursor++;
+                if (c == '\n')
+                    *reserve_item(&line_offsets) = cursor - start;
+            }
             continue;
         }
 
@@ -208,6 +355,29 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
                 else if (c == 'x' || c == 'X') digit_class = CHARACTER_DIGIT_BASE16, base = 16, cursor += 2;
             }
 
+            u64 mantissa;
+            s32 scale;
+            if (u8* compact_end = scan_compact_number(cursor, base, digit_class, &mantissa, &scale))
+            {
+                cursor = compact_end;
+
+                Token* token = reserve_item(&tokens);
+                token->atom       = ATOM_NUMBER_LITERAL;
+                token->info_index = ctx->token_info_number.count;
+
+                // Bases 2, 8 and 16 are all powers of two, so those are scaled by powers of two.
+                Token_Info_Number* info = reserve_item(&ctx->token_info_number);
+                info->source_index  = source_index;
+                info->offset        = start_cursor - start;
+                info->length        = cursor - start_cursor;
+                info->mantissa      = mantissa;
+                info->exponent      = (s16)(base == 10 ? scale : scale * (base == 2 ? 1 : base == 8 ? 3 : 4));
+                info->exponent_base = (base == 10) ? 10 : 2;
+                info->unused        = 0;
+                info->value_index   = 0;
+                continue;
+            }
+
             int_set16(&integer_base, base);
 
             // parse integer part
@@ -304,10 +474,15 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
             token->info_index = ctx->token_info_number.count;
 
             Token_Info_Number* info = reserve_item(&ctx->token_info_number);
-            info->source_index = source_index;
-            info->offset       = start_cursor - start;
-            info->length       = cursor - start_cursor;
-            info->value        = fract_make(&numerator, &denominator);
+            info->source_index  = source_index;
+            info->offset        = start_cursor - start;
+            info->length        = cursor - start_cursor;
+            info->mantissa      = 0;
+            info->exponent      = 0;
+            info->exponent_base = 0;
+            info->unused        = 0;
+            *reserve_item(&ctx->number_values) = fract_make(&numerator, &denominator);
+            info->value_index   = ctx->number_values.count;
 
             continue;
         }
@@ -318,6 +493,7 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
 
             umm  identifier_length       = 0;
             bool previous_was_underscore = false;
+            cursor = lex_skip_identifier(cursor, end, &identifier_length, &previous_was_underscore);
             while (cursor < end && (CHARACTER_CLASS[c = *cursor] & CHARACTER_IDENTIFIER_CONTINUATION))
             {
                 bool underscore = (c == '_');
@@ -344,14 +520,7 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
                 assert(j == identifier_length);
             }
 
-            Atom atom = get(&ctx->atom_table, &identifier);
-            if (!atom)
-            {
-                atom = ctx->next_identifier_atom;
-                ctx->next_identifier_atom = (Atom)(ctx->next_identifier_atom + 1);
-                set(&ctx->atom_table, &identifier, &atom);
-                add_item(&ctx->identifiers, &identifier);
-            }
+            Atom atom = intern_identifier(ctx, identifier);
 
             Token* token = reserve_item(&tokens);
             token->atom       = atom;
@@ -372,6 +541,10 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
             umm literal_length = 0;
             while (true)
             {
+                u8* plain = cursor;
+                cursor = lex_skip_until(cursor, end, '"', '\\', '\n', '\r');
+                literal_length += cursor - plain;
+
                 if (cursor >= end) LexError("Unexpected EOF in string literal.")
                 c = *(cursor++);
                 if (c == '"') break;
@@ -559,9 +732,7 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
             {
                 cursor++;
 
-                Atom atom = ctx->next_identifier_atom;
-                ctx->next_identifier_atom = (Atom)(ctx->next_identifier_atom + 1);
-                add_item(&ctx->identifiers, &literal);
+                Atom atom = make_unique_atom(&ctx->atoms, literal);
 
                 Token* token = reserve_item(&tokens);
                 token->atom       = atom;
@@ -613,7 +784,8 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
             if (cursor < end && *cursor == '/')  // single-line comment
             {
                 cursor++, atom = ATOM_COMMENT;
-                while (cursor < end && *cursor != '\n') cursor++;
+                u8* newline = (u8*) memchr(cursor, '\n', end - cursor);
+                cursor = newline ? newline : end;
             }
             else if (cursor < end && *cursor == '*')  // multi-line comment
             {
@@ -625,6 +797,8 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
                 u32 depth = 1;
                 while (cursor + 1 < end)
                 {
+                    cursor = lex_skip_until(cursor, end - 1, '*', '/', '\n', '\n');
+                    if (cursor + 1 >= end) break;
                     c = *cursor;
                     if (c == '*' && cursor[1] == '/')
                     {
@@ -647,9 +821,10 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
                 if (depth)
                 {
                     u32 column = (start_cursor - start) - line_offset + 1;
-                    fprintf(stderr, "Multi-line not closed at the end of file.\n"
-                                    " .. Started at %.*s @ %u:%u\n",
-                                    StringArgs(name), line, column);
+                    if (!ctx->silence_reports)
+                        fprintf(stderr, "Multi-line not closed at the end of file.\n"
+                                        " .. Started at %.*s @ %u:%u\n",
+                                        StringArgs(name), line, column);
                     return false;
                 }
             }
@@ -715,16 +890,45 @@ bool lex_from_memory(Compiler* ctx, String name, String code, Array<Token>* out_
     return true;
 }
 
-bool lex_file(Compiler* ctx, String path, Array<Token>* out_tokens, Array<Token>* out_comments)
+// :MappedSources
+// With map_source_files, files are mapped and copied into lexer_memory, instead of read into it.
+// The mapping is closed right away, so nothing ever points into it: identifiers, string literals
+// and Source_Info::code all keep pointing into the copy long after lexing. If the file is truncated
+// while we copy it, touching the missing pages faults, same as with any other mapped file, but
+// the window is only as long as the copy. Files which can't be mapped (pipes, empty files) are
+// read as usual.
+
+static bool map_source_file(Compiler* ctx, String path, String* out_code)
 {
-    lex_init(ctx);
+    Memory_Mapped_String file = open_memory_mapped_file_readonly(path);
+    if (!file.data)
+        return false;
 
-    String code;
-    if (!read_entire_file(path, &code, &ctx->lexer_memory))
+    *out_code = allocate_uninitialized_string(&ctx->lexer_memory, file.length);
+    memcpy(out_code->data, file.data, file.length);
+    close_memory_mapped_file(&file);
+    ctx->count_mapped_sources++;
+    return true;
+}
+
+bool read_source_file(Compiler* ctx, String path, String* out_code)
+{
+    bool mapped = ctx->map_source_files && map_source_file(ctx, path, out_code);
+    if (!mapped && !read_entire_file(path, out_code, &ctx->lexer_memory))
     {
         fprintf(stderr, "Failed to read file %.*s\n", StringArgs(path));
         return false;
     }
+    return true;
+}
+
+bool lex_file(Compiler* ctx, String path, Array<Token>* out_tokens, Array<Token>* out_comments)
+{
+    lex_init(ctx);
+
+    String code;
+    if (!read_source_file(ctx, path, &code))
+        return false;
 
     Source_Info* source;
     if (!lex_from_memory(ctx, get_file_name(path), code, out_tokens, out_comments, &source))
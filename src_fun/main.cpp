@@ -24,16 +24,26 @@ extern "C" int main(int argc, char** argv)
         first_arg_if_is_flag = consume_until(&first_arg_if_is_flag, ":"_s);
     }
 
+    // The output path of -compile is either -o:path or -o path.
+    String output_path = get_command_line_string("o"_s);
+
     Dynamic_Array<String> non_flag_args = {};
     Defer(free_heap_array(&non_flag_args));
     for (umm i = 1; i < argc; i++)
-        if (argv[i][0] != '-')
+    {
+        if (wrap_string(argv[i]) == "-o"_s && i + 1 < argc)
+            output_path = wrap_string(argv[++i]);
+        else if (argv[i][0] != '-')
             *reserve_item(&non_flag_args) = wrap_string(argv[i]);
+    }
 
 
     if (first_arg_if_is_flag == "test_process"_s)
         return test_runner_entry();
 
+    if (first_arg_if_is_flag == "benchmark_atoms"_s)
+        return atom_table_benchmark_entry();
+
     if (first_arg_if_is_flag == "test"_s)
     {
         add_log_handler([](String severity, String subsystem, String msg)
@@ -137,19 +147,46 @@ extern "C" int main(int argc, char** argv)
         return 0;
     }
 
-    if (argc < 2)
+    bool watch   = (first_arg_if_is_flag == "watch"_s);
+    bool serve   = (first_arg_if_is_flag == "serve"_s);
+    bool connect = (first_arg_if_is_flag == "connect"_s);
+    bool compile = (first_arg_if_is_flag == "compile"_s);
+    String target = get_command_line_string("compile"_s);  // :NativeBackend
+    if (compile && target && target != "elf"_s)
     {
-        fprintf(stderr, "Usage: %s file.fun [argument_list]\n", argv[0]);
+        fprintf(stderr, "Error: Unknown compilation target '%.*s', the only one is 'elf'\n", StringArgs(target));
+        return 1;
+    }
+    if (!serve && (argc < 2 || ((watch || connect || compile) && !non_flag_args.count)))
+    {
+        fprintf(stderr, "Usage: %s [-watch | -connect[:socket]] file.fun [argument_list]\n", argv[0]);
+        fprintf(stderr, "       %s -compile file.fun [-o file.funb]\n", argv[0]);
+        fprintf(stderr, "       %s -compile:elf file.fun [-o executable]\n", argv[0]);
+        fprintf(stderr, "       %s file.funb\n", argv[0]);
+        fprintf(stderr, "       %s -serve[:socket]\n", argv[0]);
+        fprintf(stderr, "-watch, -connect, -compile, -compile:elf and -serve only work as the first argument.\n");
         return 1;
     }
 
     Compiler compiler = {};
+    compiler.module_cache_directory = get_command_line_string("module_cache"_s);
+    compiler.lazy_imports           = get_command_line_bool("lazy_imports"_s);
+    compiler.keep_comments          = get_command_line_bool("keep_comments"_s);
+    compiler.map_source_files       = get_command_line_bool("mmap_sources"_s);
+    compiler.report_inlining        = get_command_line_bool("report_inlining"_s);
+    compiler.skip_ir_passes         = get_command_line_bool("no_ir_passes"_s);
+    compiler.dump_ir                = get_command_line_bool("dump_ir"_s);
+    compiler.dump_bytecode          = get_command_line_bool("dump_bytecode"_s);
+    compiler.frontend_threads       = get_command_line_integer("frontend_threads"_s);
+    compiler.backend_threads        = get_command_line_integer("backend_threads"_s);
+    compiler.compile_only           = compile;
     add_default_import_path_patterns(&compiler);
-    Environment* env = make_environment(&compiler, NULL);
 
-    assert(pump_pipeline(&compiler));  // force preload to complete
+    if (serve)
+        return serve_compile_requests(&compiler, get_command_line_string("serve"_s));
 
-    String path_to_file = wrap_string(argv[1]);
+    String path_arg = (watch || connect || compile) ? non_flag_args[0] : wrap_string(argv[1]);
+    String path_to_file = path_arg;
     if (is_path_relative(path_to_file))
     {
         String cwd = get_current_working_directory();
@@ -158,17 +195,51 @@ extern "C" int main(int argc, char** argv)
 
     if (!is_path_absolute(path_to_file))
     {
-        fprintf(stderr, "Error: Can't resolve the path of '%s'\n", argv[1]);
+        fprintf(stderr, "Error: Can't resolve the path of '%.*s'\n", StringArgs(path_arg));
         return 1;
     }
 
+    if (connect)
+        return run_on_compile_server(get_command_line_string("connect"_s), path_to_file);
+
+    if (watch)
+    {
+        watch_file(&compiler, path_to_file);
+        return 0;
+    }
+
+    // :BytecodeImage
+    if (!compile && suffix_equals(path_to_file, ".funb"_s))
+        return run_bytecode_image(path_to_file) ? 0 : 1;
+
+    if (compile && !output_path)
+    {
+        String name = path_to_file;
+        if (suffix_equals(name, ".fun"_s))
+            name.length -= 4;
+        if (!target)                  output_path = Format(temp, "%.funb", name);
+        else if (name != path_to_file) output_path = name;
+        else                          output_path = Format(temp, "%.out", name);  // don't overwrite the source
+    }
+
+    Environment* env = make_environment(&compiler, NULL);
+    Defer(finish_preparse(&compiler));
+    Defer(finish_codegen(&compiler));
+
+    assert(pump_pipeline(&compiler));  // force preload to complete
+
     Block* main = parse_top_level_from_file(&compiler, path_to_file);
     if (!main) return 1;
 
     materialize_unit(env, main);
 
-    if (!pump_pipeline(&compiler)) return 1;
-    return 0;
+    bool ok = pump_pipeline(&compiler);
+    if (compiler.dump_bytecode)
+        print_bytecode_summary(&compiler);
+    if (ok && compile)
+        ok = target ? save_elf_executable(&compiler, output_path)
+                    : save_bytecode_image(&compiler, output_path);
+    return ok ? 0 : 1;
 }
 
 
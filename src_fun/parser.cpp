@@ -28,7 +28,96 @@ struct Token_Stream
     Token* comment_end;
 };
 
-static String resolve_import_path(Token_Stream* stream, String path, Dynamic_Array<String>* out_looked_in_before_resolving = NULL, bool* out_is_path = NULL)
+// :ImportCache
+// The same modules are imported from many files, so each compiler resolves a module name only
+// once, and remembers the names which didn't resolve as well. Explicit paths are only checked
+// once too. Candidate paths for modules are first looked up in a listing of their directory,
+// which is read once per directory, so probing a pattern which doesn't have the module doesn't
+// touch the file system at all. Only a file which is listed is checked with a stat.
+
+static bool import_path_exists(Compiler* ctx, String path)
+{
+    bool exists;
+    if (!get(&ctx->checked_import_paths, &path, &exists))
+    {
+        ctx->count_import_probes++;
+        exists = check_if_file_exists(path);
+        path = allocate_string(&ctx->parser_memory, path);
+        set(&ctx->checked_import_paths, &path, &exists);
+    }
+    return exists;
+}
+
+static bool module_candidate_exists(Compiler* ctx, String path)
+{
+    String directory = get_parent_directory_path(path);
+    bool listed;
+    if (!get(&ctx->listed_directories, &directory, &listed))
+    {
+        ctx->count_import_probes++;
+        Array<String> files = list_files(directory);
+
+        // Empty directories are treated as if they couldn't be listed, that doesn't cost much.
+        listed = (files.count != 0);
+        directory = allocate_string(&ctx->parser_memory, directory);
+        set(&ctx->listed_directories, &directory, &listed);
+
+        bool present = true;
+        For (files)
+        {
+            String file = concatenate_path(&ctx->parser_memory, directory, *it);
+            set(&ctx->listed_files, &file, &present);
+        }
+    }
+
+    if (listed)
+    {
+        String file = concatenate_path(temp, directory, get_file_name(path));
+        if (!get(&ctx->listed_files, &file))
+            return false;
+    }
+
+    // Listings include symbolic links, and whatever they point to, so this still has to check.
+    ctx->count_import_probes++;
+    return check_if_file_exists(path);
+}
+
+// Substitutes the module name into the pattern, with a single allocation.
+static String expand_import_pattern(Region* memory, String pattern, String name)
+{
+    String result = {};
+    for (umm pass = 0; pass < 2; pass++)
+    {
+        if (pass)
+        {
+            result = allocate_uninitialized_string(memory, result.length);
+            result.length = 0;
+        }
+
+        auto add = [&](String piece)
+        {
+            if (pass) memcpy(result.data + result.length, piece.data, piece.length);
+            result.length += piece.length;
+        };
+
+        String rest = pattern;
+        while (rest)
+        {
+            umm remaining = rest.length;
+            String copy = consume_until_preserve_whitespace(&rest, '%');
+
+            bool double_percent = (rest && rest[0] == '%');
+            if (double_percent) copy.length++;
+
+            add(copy);
+            if (!double_percent && copy.length < remaining)
+                add(name);
+        }
+    }
+    return result;
+}
+
+String resolve_import(Compiler* ctx, String imports_relative_to_path, String path, Dynamic_Array<String>* out_looked_in_before_resolving, bool* out_is_path)
 {
     if (out_looked_in_before_resolving)
         *out_looked_in_before_resolving = {};
@@ -36,43 +125,44 @@ static String resolve_import_path(Token_Stream* stream, String path, Dynamic_Arr
     if (out_is_path) *out_is_path = true;
 
     if (prefix_equals(path, "/"_s)) // absolute path
-        return check_if_file_exists(path) ? path : ""_s;
+        return import_path_exists(ctx, path) ? path : ""_s;
 
     if (prefix_equals(path, "./"_s)) // relative path
     {
         consume(&path, 2);
-        String abs_path = concatenate_path(temp, stream->imports_relative_to_path, path);
-        return check_if_file_exists(abs_path) ? abs_path : ""_s;
+        String abs_path = concatenate_path(temp, imports_relative_to_path, path);
+        return import_path_exists(ctx, abs_path) ? abs_path : ""_s;
     }
 
     if (out_is_path) *out_is_path = false;
 
     // Module path. Resolved using module import patterns.
-    For (stream->ctx->import_path_patterns)
-    {
-        String pattern = *it;
+    String resolved_path;
+    bool known = get(&ctx->resolved_modules, &path, &resolved_path);
+    if (known && resolved_path)
+        return resolved_path;
 
-        String resolved_path = {};
-        while (pattern)
+    For (ctx->import_path_patterns)
+    {
+        String candidate = expand_import_pattern(temp, *it, path);
+        if (!known && module_candidate_exists(ctx, candidate))
         {
-            umm remaining = pattern.length;
-            String copy = consume_until_preserve_whitespace(&pattern, '%');
-
-            bool double_percent = (pattern && pattern[0] == '%');
-            if (double_percent) copy.length++;
-
-            append(&resolved_path, temp, copy);
-            if (!double_percent && copy.length < remaining)
-                append(&resolved_path, temp, path);
-        }
-
-        if (check_if_file_exists(resolved_path))
+            resolved_path = allocate_string(&ctx->parser_memory, candidate);
+            String name = allocate_string(&ctx->parser_memory, path);
+            set(&ctx->resolved_modules, &name, &resolved_path);
             return resolved_path;
+        }
 
         if (out_looked_in_before_resolving)
-            add_item(out_looked_in_before_resolving, &resolved_path);
+            add_item(out_looked_in_before_resolving, &candidate);
     }
 
+    if (!known)
+    {
+        resolved_path = {};
+        String name = allocate_string(&ctx->parser_memory, path);
+        set(&ctx->resolved_modules, &name, &resolved_path);
+    }
     return {};
 }
 
@@ -156,6 +246,9 @@ struct Block_Builder
     Block* block;
     Dynamic_Array<Parsed_Expression> expressions;
     Dynamic_Array<Expression> imperative_order;
+
+    Dynamic_Array<Block_Comment> comments;
+    Dynamic_Array<umm>           comment_positions;  // imperative_order.count when each comment was found
 };
 
 static bool is_token_before(Compiler* ctx, Token* a, Token* b)
@@ -175,85 +268,104 @@ static void finish_building(Compiler* ctx, Block_Builder* builder)
     // We do this in 2 sweeps. In the first backwards sweep we find all comments
     // which are before expressions. In the second forward sweep we find all
     // coments which are inside or after expressions.
+    // A comment's neighbors are the statements around the position in imperative_order
+    // where it was found.
 
     Expression next = NO_EXPRESSION;
     u32 line_next;
-    for (umm it_index = builder->imperative_order.count; it_index; it_index--)
+    for (umm it_index = builder->comments.count; it_index; it_index--)
     {
-        Expression it = builder->imperative_order[it_index - 1];
-        auto* expr = &builder->expressions[it];
-        if (expr->kind != EXPRESSION_COMMENT)
-        {
-            line_next = get_line(ctx, &expr->from);
-            next = it;
+        auto* comment = &builder->comments[it_index - 1];
+        umm position = builder->comment_positions[it_index - 1];
+        if (position == builder->imperative_order.count)
             continue;
+
+        auto* next_expr = &builder->expressions[builder->imperative_order[position]];
+        if (next != builder->imperative_order[position])
+        {
+            next = builder->imperative_order[position];
+            line_next = get_line(ctx, &next_expr->from);
         }
-        if (next == NO_EXPRESSION)
-            continue;
 
-        auto* next_expr = &builder->expressions[next];
-        assert(is_token_before(ctx, &expr->to, &next_expr->from));
-        u32 line_comment = get_line(ctx, &expr->to);
+        assert(is_token_before(ctx, &comment->token, &next_expr->from));
+        u32 line_comment = get_line(ctx, &comment->token);
         assert(line_comment <= line_next);
         if (line_comment == line_next || line_comment == line_next - 1)
         {
-            expr->comment.relation = COMMENT_IS_BEFORE;
-            expr->comment.relative_to = next;
-            line_next = get_line(ctx, &expr->from);
+            comment->relation = COMMENT_IS_BEFORE;
+            comment->relative_to = next;
+            line_next = line_comment;
         }
     }
 
-    Expression previous = NO_EXPRESSION;
-    for (umm it_index = 0; it_index < builder->imperative_order.count; it_index++)
+    for (umm it_index = 0; it_index < builder->comments.count; it_index++)
     {
-        Expression it = builder->imperative_order[it_index];
-        auto* expr = &builder->expressions[it];
-        if (expr->kind != EXPRESSION_COMMENT)
-        {
-            previous = it;
-            continue;
-        }
-        if (previous == NO_EXPRESSION)
+        auto* comment = &builder->comments[it_index];
+        umm position = builder->comment_positions[it_index];
+        if (position == 0)
             continue;
 
+        Expression previous = builder->imperative_order[position - 1];
         auto* previous_expr = &builder->expressions[previous];
-        assert(is_token_before(ctx, &previous_expr->from, &expr->from));
-        if (is_token_before(ctx, &expr->from, &previous_expr->to))
+        assert(is_token_before(ctx, &previous_expr->from, &comment->token));
+        if (is_token_before(ctx, &comment->token, &previous_expr->to))
         {
-            expr->comment.relation = COMMENT_IS_INSIDE;
-            expr->comment.relative_to = previous;
+            comment->relation = COMMENT_IS_INSIDE;
+            comment->relative_to = previous;
             continue;
         }
 
-        assert(is_token_before(ctx, &previous_expr->to, &expr->from));
+        assert(is_token_before(ctx, &previous_expr->to, &comment->token));
         u32 line_previous = get_line(ctx, &previous_expr->to);
-        u32 line_comment  = get_line(ctx, &expr->from);
+        u32 line_comment  = get_line(ctx, &comment->token);
 
         assert(line_comment >= line_previous);
         if (line_comment == line_previous ||
-            (line_comment == line_previous + 1 && expr->comment.relation != COMMENT_IS_BEFORE))
+            (line_comment == line_previous + 1 && comment->relation != COMMENT_IS_BEFORE))
         {
-            expr->comment.relation = COMMENT_IS_AFTER;
-            expr->comment.relative_to = previous;
+            comment->relation = COMMENT_IS_AFTER;
+            comment->relative_to = previous;
         }
     }
 
 #if 0
-    for (umm it_index = 0; it_index < builder->imperative_order.count; it_index++)
+    For (builder->comments)
     {
-        Expression it = builder->imperative_order[it_index];
-        auto* expr = &builder->expressions[it];
-        if (expr->kind != EXPRESSION_COMMENT)
-            continue;
         const char* name[] = { "Inside", "Alone", "After", "Before" };
-        Report(ctx).message(Format(temp, "Relation % to %", name[expr->comment.relation], expr->comment.relative_to)).snippet(expr).done();
+        Report(ctx).message(Format(temp, "Relation % to %", name[it->relation], it->relative_to)).snippet(&it->token).done();
     }
 #endif
 
     block->parsed_expressions = const_array(allocate_array(memory, &builder->expressions));
     block->imperative_order   = const_array(allocate_array(memory, &builder->imperative_order));
+    block->comments           = const_array(allocate_array(memory, &builder->comments));
     free_heap_array(&builder->expressions);
     free_heap_array(&builder->imperative_order);
+    free_heap_array(&builder->comments);
+    free_heap_array(&builder->comment_positions);
+    ctx->count_parsed_comments += block->comments.count;
+
+    build_parsed_columns(memory, block);
+}
+
+void build_parsed_columns(Region* memory, Block* block)
+{
+    umm count = block->parsed_expressions.count;
+    Array<Expression_Kind> kinds = allocate_array<Expression_Kind>(memory, count);
+    Array<flags16>         flags = allocate_array<flags16>        (memory, count);
+    Array<Atom>            names = allocate_array<Atom>           (memory, count);
+    for (umm i = 0; i < count; i++)
+    {
+        auto* expr = &block->parsed_expressions[i];
+        kinds[i] = expr->kind;
+        flags[i] = expr->flags;
+        names[i] = ATOM_INVALID;
+        if (expr->kind == EXPRESSION_DECLARATION) names[i] = expr->declaration.name.atom;
+        if (expr->kind == EXPRESSION_DELETE)      names[i] = expr->deleted_name.atom;
+    }
+    block->parsed_kinds = const_array(kinds);
+    block->parsed_flags = const_array(flags);
+    block->parsed_names = const_array(names);
 }
 
 // IMPORTANT! Make sure to not use the returned pointer after calling add_expression() again!
@@ -607,7 +719,7 @@ static bool parse_expression_leaf(Token_Stream* stream, Block_Builder* builder,
             Dynamic_Array<String> paths_looked_in = {};
             Defer(free_heap_array(&paths_looked_in));
             bool is_path = false;
-            String path = resolve_import_path(stream, info->value, &paths_looked_in, &is_path);
+            String path = resolve_import(stream->ctx, stream->imports_relative_to_path, info->value, &paths_looked_in, &is_path);
 
             if (!path)
             {
@@ -623,7 +735,7 @@ static bool parse_expression_leaf(Token_Stream* stream, Block_Builder* builder,
                         if (trimmed_paths[i] == info->value) continue;
                         sussy_whitespace = true;
 
-                        String resolved = resolve_import_path(stream, trimmed_paths[i], NULL, &probably_is_path);
+                        String resolved = resolve_import(stream->ctx, stream->imports_relative_to_path, trimmed_paths[i], NULL, &probably_is_path);
                         if (resolved)
                         {
                             reported_ws_error = true;
@@ -1203,26 +1315,25 @@ static bool parse_statement(Token_Stream* stream, Block_Builder* builder)
     return true;
 }
 
-static void add_comment_expressions_to_block(Token_Stream* stream, Block_Builder* builder)
+static void add_comments_to_block(Token_Stream* stream, Block_Builder* builder)
 {
     // The regular token stream cursor points to the next token to be parsed.
-    // We insert all comments in front of the cursor.
+    // We add all comments in front of the cursor.
     while (stream->comment_cursor < stream->comment_end)
     {
         auto* token = stream->comment_cursor;
         if (stream->cursor < stream->end && is_token_before(stream->ctx, stream->cursor, token))
             break;
 
-        Expression comment_expr_id;
-        auto* expr = add_expression(builder, EXPRESSION_COMMENT, token, token, &comment_expr_id);
-        expr->comment.token = *token;
+        Block_Comment* comment = reserve_item(&builder->comments);
+        comment->token = *token;
         // The comment's relation to neighboring expressions is determined when
         // finishing building the block in finish_building.
-        expr->comment.relation = COMMENT_IS_ALONE;
-        expr->comment.relative_to = NO_EXPRESSION;
+        comment->relation = COMMENT_IS_ALONE;
+        comment->relative_to = NO_EXPRESSION;
         stream->comment_cursor++;
 
-        add_item(&builder->imperative_order, &comment_expr_id);
+        *reserve_item(&builder->comment_positions) = builder->imperative_order.count;
     }
 }
 
@@ -1243,10 +1354,10 @@ static Block* parse_block(Token_Stream* stream, flags32 flags)
 
         while (stream->cursor < stream->end && stream->cursor->atom != ATOM_RIGHT_BRACE)
         {
-            add_comment_expressions_to_block(stream, &builder);
+            add_comments_to_block(stream, &builder);
             if (!parse_statement(stream, &builder)) return NULL;
             if (!semicolon_after_statement(stream)) return NULL;
-            add_comment_expressions_to_block(stream, &builder);
+            add_comments_to_block(stream, &builder);
         }
         Token* block_end = stream->cursor;
         if (!take_atom(stream, ATOM_RIGHT_BRACE, "Body was not closed by '}'.\n"
@@ -1305,6 +1416,8 @@ Block* parse_top_level(Compiler* ctx, String canonical_name, String imports_rela
         set_nonempty_token_stream(&stream, ctx, tokens);
         stream.imports_relative_to_path = imports_relative_to_path;
 
+        // Without keep_comments, the parser never sees any comments.
+        if (!ctx->keep_comments) comments = {};
         stream.comment_start  = comments.address;
         stream.comment_cursor = comments.address;
         stream.comment_end    = comments.address + comments.count;
@@ -1312,10 +1425,10 @@ Block* parse_top_level(Compiler* ctx, String canonical_name, String imports_rela
         block->from = *next_token_or_eof(&stream);
         while (stream.cursor < stream.end)
         {
-            add_comment_expressions_to_block(&stream, &builder);
+            add_comments_to_block(&stream, &builder);
             if (!parse_statement(&stream, &builder)) return NULL;
             if (!semicolon_after_statement(&stream)) return NULL;
-            add_comment_expressions_to_block(&stream, &builder);
+            add_comments_to_block(&stream, &builder);
         }
         block->to = *next_token_or_eof(&stream);
     }
@@ -1325,15 +1438,73 @@ Block* parse_top_level(Compiler* ctx, String canonical_name, String imports_rela
 
 Block* parse_top_level_from_file(Compiler* ctx, String path)
 {
+    // Check before lexing, the file might have already been imported.
+    Block* block = get(&ctx->top_level_blocks, &path);
+    if (block) return block;
+
+    // :ParallelFrontEnd
+    if (ctx->is_preparse_worker)
+        return defer_preparsed_import(ctx, path);
+    if (ctx->frontend_threads > 1)
+    {
+        block = take_preparsed_module(ctx, path);
+        if (block) return block;
+
+        // If the module got registered, one of its imports failed, and that was already reported.
+        if (get(&ctx->top_level_blocks, &path)) return NULL;
+    }
+
+    if (!ctx->module_cache_directory)
+    {
+        Array<Token> tokens = {};
+        Array<Token> comments = {};
+        bool ok = lex_file(ctx, path, &tokens, &comments);
+        if (!ok)
+            return NULL;
+
+        String import_path = get_parent_directory_path(path);
+        if (!import_path) import_path = "."_s;
+        return parse_top_level(ctx, path, import_path, tokens, comments);
+    }
+
+    lex_init(ctx);
+    String code;
+    if (!read_source_file(ctx, path, &code))
+        return NULL;
+
+    block = load_cached_module(ctx, path, code);
+    if (block) return block;
+
+    // If the module got registered, one of its imports failed, and that was already reported.
+    if (get(&ctx->top_level_blocks, &path)) return NULL;
+
+    Module_Cache_Token_Range range = {};
+    range.source_index = ctx->sources.count;
+    range.first_other  = ctx->token_info_other .count;
+    range.first_number = ctx->token_info_number.count;
+    range.first_string = ctx->token_info_string.count;
+
     Array<Token> tokens = {};
     Array<Token> comments = {};
-    bool ok = lex_file(ctx, path, &tokens, &comments);
-    if (!ok)
+    Source_Info* source;
+    if (!lex_from_memory(ctx, get_file_name(path), code, &tokens, &comments, &source))
         return NULL;
+    source->path = path;
+
+    range.end_other  = ctx->token_info_other .count;
+    range.end_number = ctx->token_info_number.count;
+    range.end_string = ctx->token_info_string.count;
 
     String import_path = get_parent_directory_path(path);
     if (!import_path) import_path = "."_s;
-    return parse_top_level(ctx, path, import_path, tokens, comments);
+
+    umm reports_before = ctx->count_reports;
+    block = parse_top_level(ctx, path, import_path, tokens, comments);
+
+    // Don't cache modules with warnings, they would be silenced on the next run.
+    if (block && ctx->count_reports == reports_before)
+        save_cached_module(ctx, path, code, block, &range);
+    return block;
 }
 
 Block* parse_top_level_from_memory(Compiler* ctx, String imports_relative_to_directory, String name, String code)
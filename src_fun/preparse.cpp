@@ -0,0 +1,265 @@
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+
+EnterApplicationNamespace
+
+
+// :ParallelFrontEnd
+// With frontend_threads > 1, a file which is about to be lexed and parsed is instead handed to a
+// pool of worker threads. Each worker lexes and parses into its own private Compiler. Imports are
+// not parsed recursively there, each import path is queued as another job, so the whole import
+// graph fans out across the pool while the main thread is still waiting for the first file.
+//
+// A finished job is serialized into a module image (the same format as the module cache, see
+// cache.cpp), and the main thread reads it back when the parser asks for that file. Images are
+// read in the same order the files would have been lexed on the main thread, so token infos
+// and sources come out exactly the same. The image rebases token info indices and atoms
+// into the main compiler, and top_level_blocks keeps deduplicating by path as before.
+//
+// Jobs which fail or report anything (even warnings) are thrown away, and the file is lexed and
+// parsed on the main thread instead, so all diagnostics are printed exactly as before.
+//
+// Taken modules are copied into the main compiler's memory. Their images are freed right away,
+// but the workers' atoms point into the code of every file they lexed, so the code, and everything
+// else including jobs nobody took, is freed by finish_preparse once the workers have exited.
+
+struct Preparsed_Module
+{
+    String    path;
+    Semaphore done;
+    bool      taken;
+
+    String code;
+    String image;  // empty if the job failed
+};
+
+struct Preparse
+{
+    // Workers may still be winding down after the compiler is gone, so they can't refer to it.
+    Array<String> import_path_patterns;
+    bool          keep_comments;
+
+    Lock      lock;
+    Semaphore work;  // posted once per queued job, and to wake up idle workers when everything is done
+    umm       alive_workers;
+    umm       running_jobs;
+    umm       next_job;
+
+    Dynamic_Array<Thread> threads;  // including the ones that have already exited, until joined
+    Dynamic_Array<Preparsed_Module*> jobs;
+    Table(String, Preparsed_Module*, hash_string) jobs_by_path;
+};
+
+// Must be called with the lock held.
+static Preparsed_Module* queue_job(Preparse* pre, String path)
+{
+    Preparsed_Module* module;
+    if (get(&pre->jobs_by_path, &path, &module))
+        return module;
+
+    module = alloc<Preparsed_Module>(NULL);
+    module->path = allocate_string(NULL, path);
+    make_semaphore(&module->done);
+    add_item(&pre->jobs, &module);
+    set(&pre->jobs_by_path, &module->path, &module);
+    post(&pre->work);
+    return module;
+}
+
+static void preparse_module(Compiler* worker, Preparsed_Module* module)
+{
+    // The code is heap allocated, because the worker's atoms point into it even if the job fails.
+    String code;
+    if (!read_entire_file(module->path, &code, NULL))
+        return;
+    module->code = code;
+
+    Module_Cache_Token_Range range = {};
+    range.source_index = worker->sources.count;
+    range.first_other  = worker->token_info_other .count;
+    range.first_number = worker->token_info_number.count;
+    range.first_string = worker->token_info_string.count;
+
+    Array<Token> tokens = {};
+    Array<Token> comments = {};
+    if (!lex_from_memory(worker, get_file_name(module->path), code, &tokens, &comments))
+        return;
+
+    range.end_other  = worker->token_info_other .count;
+    range.end_number = worker->token_info_number.count;
+    range.end_string = worker->token_info_string.count;
+
+    String import_path = get_parent_directory_path(module->path);
+    if (!import_path) import_path = "."_s;
+
+    // Not registered under its path, since an earlier job might have deferred an import of it.
+    umm reports_before = worker->count_reports;
+    Block* block = parse_top_level(worker, {}, import_path, tokens, comments);
+    if (!block || worker->count_reports != reports_before)
+        return;
+
+    module->image = write_module_image(worker, block, &range, NULL);
+}
+
+Block* defer_preparsed_import(Compiler* worker, String path)
+{
+    // The block only stands in for the import, so write_module_image can find its path.
+    Block* block = alloc<Block>(&worker->parser_memory);
+    block->flags |= BLOCK_IS_TOP_LEVEL | BLOCK_IS_UNIT | BLOCK_HAS_STRUCTURE_PLACEMENT;
+    String canonical_name = allocate_string(&worker->parser_memory, path);
+    set(&worker->top_level_blocks, &canonical_name, &block);
+
+    LockedScope(&worker->preparse->lock);
+    queue_job(worker->preparse, path);
+    return block;
+}
+
+static void preparse_worker(void* userdata)
+{
+    Preparse* pre = (Preparse*) userdata;
+
+    Compiler worker = {};
+    worker.import_path_patterns = pre->import_path_patterns;
+    worker.keep_comments        = pre->keep_comments;
+    worker.preparse             = pre;
+    worker.is_preparse_worker   = true;
+    worker.silence_reports      = true;
+
+    while (true)
+    {
+        wait(&pre->work);
+
+        Preparsed_Module* module = NULL;
+        acquire(&pre->lock);
+        if (pre->next_job < pre->jobs.count)
+        {
+            module = pre->jobs[pre->next_job++];
+            pre->running_jobs++;
+        }
+        else if (!pre->running_jobs)
+        {
+            // Nothing is queued, and nothing is running that could queue more.
+            pre->alive_workers--;
+            release(&pre->lock);
+            break;
+        }
+        release(&pre->lock);
+        if (!module) continue;
+
+        preparse_module(&worker, module);
+
+        acquire(&pre->lock);
+        pre->running_jobs--;
+        bool finished = !pre->running_jobs && pre->next_job == pre->jobs.count;
+        umm  idle     = pre->alive_workers;
+        release(&pre->lock);
+
+        post(&module->done);
+        if (finished)
+            for (umm i = 0; i < idle; i++)
+                post(&pre->work);
+    }
+
+    // Images don't point into the worker, so all of it can go.
+    lk_region_free(&worker.lexer_memory);
+    lk_region_free(&worker.parser_memory);
+    free_heap_array(&worker.sources);
+    free_token_store(&worker.token_info_other);
+    free_token_store(&worker.token_info_number);
+    free_token_store(&worker.token_info_string);
+    For (worker.number_values) fract_free(it);
+    free_heap_array(&worker.number_values);
+    free_atom_table(&worker.atoms);
+    free_table(&worker.top_level_blocks);
+    free_table(&worker.resolved_modules);
+    free_table(&worker.checked_import_paths);
+    free_table(&worker.listed_directories);
+    free_table(&worker.listed_files);
+}
+
+Block* take_preparsed_module(Compiler* ctx, String path)
+{
+    Preparse* pre = ctx->preparse;
+    if (!pre)
+    {
+        pre = alloc<Preparse>(NULL);
+        pre->import_path_patterns = allocate_array<String>(NULL, ctx->import_path_patterns.count);
+        for (umm i = 0; i < ctx->import_path_patterns.count; i++)
+            pre->import_path_patterns[i] = allocate_string(NULL, ctx->import_path_patterns[i]);
+        pre->keep_comments = ctx->keep_comments;
+        make_lock(&pre->lock);
+        make_semaphore(&pre->work);
+        ctx->preparse = pre;
+    }
+
+    Preparsed_Module* module;
+    {
+        LockedScope(&pre->lock);
+        module = queue_job(pre, path);
+
+        // The module might have been queued and finished by an earlier pool, then there
+        // is nothing to do, and idle workers would never be woken up to exit.
+        if (!pre->alive_workers && pre->next_job < pre->jobs.count)
+        {
+            pre->alive_workers = ctx->frontend_threads;
+            for (umm i = 0; i < ctx->frontend_threads; i++)
+                spawn_thread("preparse"_s, pre, preparse_worker, reserve_item(&pre->threads));
+        }
+    }
+
+    // Each module is only read once, if that fails the caller parses it.
+    if (module->taken) return NULL;
+    module->taken = true;
+
+    wait(&module->done);
+
+    Block* block = NULL;
+    if (module->image)
+    {
+        // The source and the relocated image stay referenced by the parsed blocks.
+        String code  = allocate_string(&ctx->lexer_memory, module->code);
+        String image = { module->image.length, alloc<byte, false>(&ctx->parser_memory, module->image.length) };
+        memcpy(image.data, module->image.data, image.length);
+
+        block = read_module_image(ctx, path, code, image);
+        if (block) ctx->count_preparsed_modules++;
+    }
+    // The code can't go yet, the worker's atoms still point into it.
+    free_heap_string(&module->image);
+    return block;
+}
+
+void finish_preparse(Compiler* ctx)
+{
+    Preparse* pre = ctx->preparse;
+    if (!pre) return;
+    ctx->preparse = NULL;
+
+    // Workers exit on their own once nothing is queued or running,
+    // so this only waits for jobs that nobody is going to take.
+    For (pre->threads) wait(it);
+    free_heap_array(&pre->threads);
+
+    For (pre->jobs)
+    {
+        Preparsed_Module* module = *it;
+        free_heap_string(&module->path);
+        free_heap_string(&module->code);
+        free_heap_string(&module->image);
+        free_semaphore(&module->done);
+        free(module);
+    }
+    free_heap_array(&pre->jobs);
+    free_table(&pre->jobs_by_path);
+
+    For (pre->import_path_patterns) free_heap_string(it);
+    free_heap_array(&pre->import_path_patterns);
+    free_lock(&pre->lock);
+    free_semaphore(&pre->work);
+    free(pre);
+}
+
+
+ExitApplicationNamespace
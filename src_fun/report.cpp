@@ -314,8 +314,10 @@ Report& Report::internal_suggestion_remove(Token_Info info, bool skinny, umm bef
 
 bool Report::done()
 {
+    ctx->count_reports++;
     String report = resolve_to_string_and_free(&cat, temp);
-    fprintf(stderr, "%.*s", StringArgs(report));
+    if (!ctx->silence_reports)
+        fprintf(stderr, "%.*s", StringArgs(report));
     return false;
 }
 
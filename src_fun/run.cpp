@@ -9,8 +9,9 @@ EnterApplicationNamespace
 
 
 
-static bool run_intrinsic(User* user, Unit* unit, byte* storage, Block* block, String intrinsic,
-                          Bytecode_Continuation continuation)
+// Either block or binding is set, units loaded from an image only have bindings, see :BytecodeImage
+static bool run_intrinsic(User* user, Unit* unit, byte* storage, Block* block, Intrinsic_Binding const* binding,
+                          String intrinsic, Bytecode_Continuation continuation)
 {
     Environment* env = unit->env;
     Compiler*    ctx = env->ctx;
@@ -18,8 +19,34 @@ static bool run_intrinsic(User* user, Unit* unit, byte* storage, Block* block, S
     assert(env->pointer_size      == sizeof (void*));
     assert(env->pointer_alignment == alignof(void*));
 
+    auto get_bound_field = [&](String name, bool is_return, auto** out_address, Type assertion, Type* out_type)
+    {
+        For (binding->fields)
+        {
+            if (it->is_return != is_return || it->name != name) continue;
+            if (out_type) *out_type = it->type;
+            if (assertion != INVALID_TYPE && assertion != it->type)
+            {
+                String type_desc = exact_type_description(unit, assertion);
+                fprintf(stderr, "Runtime %s '%.*s' to intrinsic '%.*s' must be of type '%.*s'\nAborting...\n",
+                    is_return ? "return" : "parameter", StringArgs(name), StringArgs(intrinsic), StringArgs(type_desc));
+                exit(1);
+            }
+
+            *(byte**) out_address = storage + it->offset;
+            return;
+        }
+
+        fprintf(stderr, "Missing runtime %s '%.*s' to intrinsic '%.*s'\nAborting...\n",
+            is_return ? "return" : "parameter", StringArgs(name), StringArgs(intrinsic));
+        exit(1);
+    };
+
     auto get_runtime_parameter = [&](String name, auto** out_address, Type assertion = INVALID_TYPE, Type* out_type = NULL)
     {
+        if (binding)
+            return get_bound_field(name, false, out_address, assertion, out_type);
+
         for (Expression id = {}; id < block->inferred_expressions.count; id = (Expression)(id + 1))
         {
             auto* expr  = &block->parsed_expressions  [id];
@@ -48,6 +75,9 @@ static bool run_intrinsic(User* user, Unit* unit, byte* storage, Block* block, S
 
     auto get_runtime_return = [&](String name, auto** out_address, Type assertion = INVALID_TYPE, Type* out_type = NULL)
     {
+        if (binding)
+            return get_bound_field(name, true, out_address, assertion, out_type);
+
         Block* return_struct = NULL;
         for (Expression id = {}; id < block->inferred_expressions.count; id = (Expression)(id + 1))
         {
@@ -337,9 +367,14 @@ run:
     case OP_DIVIDE_WHOLE:          opname = "OP_DIVIDE_WHOLE"_s;          break;
     case OP_DIVIDE_FRACTIONAL:     opname = "OP_DIVIDE_FRACTIONAL"_s;     break;
     case OP_COMPARE:               opname = "OP_COMPARE"_s;               break;
+    case OP_ADD_IMMEDIATE:         opname = "OP_ADD_IMMEDIATE"_s;         break;
+    case OP_SUBTRACT_IMMEDIATE:    opname = "OP_SUBTRACT_IMMEDIATE"_s;    break;
+    case OP_MULTIPLY_IMMEDIATE:    opname = "OP_MULTIPLY_IMMEDIATE"_s;    break;
+    case OP_COMPARE_IMMEDIATE:     opname = "OP_COMPARE_IMMEDIATE"_s;     break;
     case OP_MOVE_POINTER_CONSTANT: opname = "OP_MOVE_POINTER_CONSTANT"_s; break;
     case OP_MOVE_POINTER_FORWARD:  opname = "OP_MOVE_POINTER_FORWARD"_s;  break;
     case OP_MOVE_POINTER_BACKWARD: opname = "OP_MOVE_POINTER_BACKWARD"_s; break;
+    case OP_MOVE_POINTER_IMMEDIATE: opname = "OP_MOVE_POINTER_IMMEDIATE"_s; break;
     case OP_POINTER_DISTANCE:      opname = "OP_POINTER_DISTANCE"_s;      break;
     case OP_CAST:                  opname = "OP_CAST"_s;                  break;
     case OP_GOTO:                  opname = "OP_GOTO"_s;                  break;
@@ -364,6 +399,14 @@ run:
 #endif
 
 #define M(type, offset) (*(type*)(storage + (offset)))
+#define I(type) (*(type*) &b)  // immediate operand, the low bytes of b
+
+    auto compare = []<typename T>(flags32 flags, T lhs, T rhs) -> bool
+    {
+        if (lhs == rhs) return flags & OP_COMPARE_EQUAL;
+        if (lhs <  rhs) return flags & OP_COMPARE_LESS;
+                        return flags & OP_COMPARE_GREATER;
+    };
 
     switch (bc->op)
     {
@@ -461,13 +504,6 @@ run:
     } break;
     case OP_COMPARE:
     {
-        auto compare = []<typename T>(flags32 flags, T lhs, T rhs) -> bool
-        {
-            if (lhs == rhs) return flags & OP_COMPARE_EQUAL;
-            if (lhs <  rhs) return flags & OP_COMPARE_LESS;
-                            return flags & OP_COMPARE_GREATER;
-        };
-
         CompileTimeAssert(sizeof(bool) == 1);
         switch ((Type) s)
         {
@@ -486,9 +522,71 @@ run:
         case TYPE_BOOL: M(bool, r) = compare(flags, M(bool, a), M(bool, b)); break;
         }
     } break;
+    case OP_ADD_IMMEDIATE:
+    {
+        switch (s)
+        {
+        IllegalDefaultCase;
+        case TYPE_F16:  NotImplemented;
+        case TYPE_U8:   M(u8,  r) = M(u8,  a) + I(u8);  break;
+        case TYPE_U16:  M(u16, r) = M(u16, a) + I(u16); break;
+        case TYPE_U32:  M(u32, r) = M(u32, a) + I(u32); break;
+        case TYPE_U64:  M(u64, r) = M(u64, a) + I(u64); break;
+        case TYPE_F32:  M(f32, r) = M(f32, a) + I(f32); break;
+        case TYPE_F64:  M(f64, r) = M(f64, a) + I(f64); break;
+        }
+    } break;
+    case OP_SUBTRACT_IMMEDIATE:
+    {
+        switch (s)
+        {
+        IllegalDefaultCase;
+        case TYPE_F16:  NotImplemented;
+        case TYPE_U8:   M(u8,  r) = M(u8,  a) - I(u8);  break;
+        case TYPE_U16:  M(u16, r) = M(u16, a) - I(u16); break;
+        case TYPE_U32:  M(u32, r) = M(u32, a) - I(u32); break;
+        case TYPE_U64:  M(u64, r) = M(u64, a) - I(u64); break;
+        case TYPE_F32:  M(f32, r) = M(f32, a) - I(f32); break;
+        case TYPE_F64:  M(f64, r) = M(f64, a) - I(f64); break;
+        }
+    } break;
+    case OP_MULTIPLY_IMMEDIATE:
+    {
+        switch (s)
+        {
+        IllegalDefaultCase;
+        case TYPE_F16:  NotImplemented;
+        case TYPE_U8:   M(u8,  r) = M(u8,  a) * I(u8);  break;
+        case TYPE_U16:  M(u16, r) = M(u16, a) * I(u16); break;
+        case TYPE_U32:  M(u32, r) = M(u32, a) * I(u32); break;
+        case TYPE_U64:  M(u64, r) = M(u64, a) * I(u64); break;
+        case TYPE_F32:  M(f32, r) = M(f32, a) * I(f32); break;
+        case TYPE_F64:  M(f64, r) = M(f64, a) * I(f64); break;
+        }
+    } break;
+    case OP_COMPARE_IMMEDIATE:
+    {
+        switch ((Type) s)
+        {
+        IllegalDefaultCase;
+        case TYPE_F16:  NotImplemented;
+        case TYPE_U8:   M(bool, r) = compare(flags, M(u8,   a), I(u8));   break;
+        case TYPE_U16:  M(bool, r) = compare(flags, M(u16,  a), I(u16));  break;
+        case TYPE_U32:  M(bool, r) = compare(flags, M(u32,  a), I(u32));  break;
+        case TYPE_U64:  M(bool, r) = compare(flags, M(u64,  a), I(u64));  break;
+        case TYPE_S8:   M(bool, r) = compare(flags, M(s8,   a), I(s8));   break;
+        case TYPE_S16:  M(bool, r) = compare(flags, M(s16,  a), I(s16));  break;
+        case TYPE_S32:  M(bool, r) = compare(flags, M(s32,  a), I(s32));  break;
+        case TYPE_S64:  M(bool, r) = compare(flags, M(s64,  a), I(s64));  break;
+        case TYPE_F32:  M(bool, r) = compare(flags, M(f32,  a), I(f32));  break;
+        case TYPE_F64:  M(bool, r) = compare(flags, M(f64,  a), I(f64));  break;
+        case TYPE_BOOL: M(bool, r) = compare(flags, M(bool, a), I(bool)); break;
+        }
+    } break;
     case OP_MOVE_POINTER_CONSTANT:  M(byte*, r) = M(byte*, a) + s;                 break;
     case OP_MOVE_POINTER_FORWARD:   M(byte*, r) = M(byte*, a) + M(umm, b) * s;     break;
     case OP_MOVE_POINTER_BACKWARD:  M(byte*, r) = M(byte*, a) - M(umm, b) * s;     break;
+    case OP_MOVE_POINTER_IMMEDIATE: M(byte*, r) = M(byte*, a) + I(umm) * s;        break;
     case OP_POINTER_DISTANCE:       M(umm,   r) = (M(byte*, b) - M(byte*, a)) / s; break;
     case OP_CAST:
     {
@@ -536,12 +634,19 @@ run:
     case OP_INTRINSIC:
     {
         exit_lockdown(user);
-        Block* block     = (Block*) a;
-        String intrinsic = { (umm) s, (u8*) b };
-        assert(block->flags & BLOCK_IS_PARAMETER_BLOCK);
+        Block*                   block     = NULL;
+        Intrinsic_Binding const* binding   = NULL;
+        String                   intrinsic = { (umm) s, (u8*) b };
+        if (flags & OP_A_IS_BINDING)
+            binding = (Intrinsic_Binding const*) a;
+        else
+        {
+            block = (Block*) a;
+            assert(block->flags & BLOCK_IS_PARAMETER_BLOCK);
+        }
 
         Bytecode_Continuation continuation = { unit, instruction + 1, storage };
-        bool exit_here = run_intrinsic(user, unit, storage, block, intrinsic, continuation);
+        bool exit_here = run_intrinsic(user, unit, storage, block, binding, intrinsic, continuation);
 
         enter_lockdown(user);
         if (exit_here)
@@ -610,6 +715,7 @@ run:
 
     instruction++;
     goto run;
+#undef I
 #undef M
 }
 
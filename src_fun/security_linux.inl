@@ -73,6 +73,26 @@ byte* user_alloc(User* user, umm size, umm alignment)
     return result;
 }
 
+byte* user_alloc_zeroed(User* user, umm size, umm alignment)
+{
+    assert(!current_user || current_user == user);  // can't work with other users as a user
+
+    // Nothing is ever handed out twice, so what hasn't been handed out yet is still untouched.
+    while (user->next_allocation_offset % alignment)
+        user->next_allocation_offset++;
+    byte* result = user->user_memory + user->next_allocation_offset;
+    user->next_allocation_offset += size;
+
+    if (user->next_allocation_offset > user->user_memory_size)
+    {
+        exit_lockdown(user);
+        fprintf(stderr, "user code is out of memory\n");
+        exit(1);
+    }
+
+    return result;
+}
+
 void user_free(User* user, void* base)
 {
     assert(!current_user || current_user == user);  // can't work with other users as a user
@@ -256,6 +276,28 @@ void delete_user(User* user) {};
 byte* user_alloc(User* user, umm size, umm alignment) { return (byte*) malloc(size); }
 void  user_free (User* user, void* base)              { return free(base);           }
 
+byte* user_alloc_zeroed(User* user, umm size, umm alignment)
+{
+    // Anonymous pages are zeroed by the kernel when they are first touched.
+    static constexpr umm LAZILY_ZEROED_SIZE = Kilobyte(64);
+    byte* result = NULL;
+    if (size < LAZILY_ZEROED_SIZE)
+        result = (byte*) calloc(1, size);
+    else
+    {
+        void* pages = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pages != MAP_FAILED)
+            result = (byte*) pages;
+    }
+
+    if (!result && size)
+    {
+        fprintf(stderr, "user code is out of memory\n");
+        exit(1);
+    }
+    return result;
+}
+
 void enter_lockdown(User* user) {}
 void exit_lockdown(User* user) {}
 
@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+EnterApplicationNamespace
+
+
+// :CompileServer
+// With -serve, the compiler makes an environment, parses and infers the standard modules into
+// it, and then waits for requests on a Unix socket. Each request forks the warm process, so
+// the child starts with the preload and the standard modules already inferred, and the server
+// itself never changes, no matter what the program does (or how it crashes).
+//
+// A client (-connect) sends the absolute path of the file and its working directory, together
+// with its own stdin, stdout and stderr, which the child puts in place of its own. So the
+// output goes straight to the client, and all the client waits for is the exit status.
+//
+// Compiler options are the server's, the client's options don't apply.
+//
+// Whoever can connect can run code as the server's user, and the server gets the client's stdio.
+// So by default the socket lives in $XDG_RUNTIME_DIR, or else in /tmp/fun-<uid>, which has to be
+// a directory only we can access. Both sides also check that the other end is the same user.
+
+// Imported by almost every program, and they don't run anything when they are inferred.
+static String const warm_modules_code = R"XXX(
+    System   :: import "system";
+    Compiler :: import "compiler";
+)XXX"_s;
+
+static constexpr umm MAX_REQUEST_SIZE = Kilobyte(16);
+
+struct Compile_Request_Header
+{
+    u32 cwd_length;
+    u32 path_length;
+};
+
+
+static bool is_private_directory(String path)
+{
+    struct stat st;
+    if (lstat(make_c_style_string(path), &st) != 0) return false;
+    return S_ISDIR(st.st_mode) && st.st_uid == getuid() && !(st.st_mode & 077);
+}
+
+// Returns an empty string if the default directory isn't safe to use.
+static String get_socket_path(String socket_path, bool create_directory)
+{
+    if (socket_path) return socket_path;
+
+    char const* runtime_directory = getenv("XDG_RUNTIME_DIR");
+    String directory = runtime_directory ? wrap_string(runtime_directory) : String {};
+    if (!directory)
+    {
+        directory = Format(temp, "/tmp/fun-%", (u64) getuid());
+        if (create_directory)
+            mkdir(make_c_style_string(directory), 0700);
+    }
+
+    if (!is_private_directory(directory))
+    {
+        fprintf(stderr, "%.*s must be a directory which only you can access, for the compile server socket.\n",
+                StringArgs(directory));
+        return {};
+    }
+    return Format(temp, "%/fun.socket", directory);
+}
+
+static bool peer_is_same_user(int connection)
+{
+    ucred peer;
+    socklen_t length = sizeof(peer);
+    if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || length != sizeof(peer))
+        return false;
+    return peer.uid == getuid();
+}
+
+static bool make_socket_address(String socket_path, sockaddr_un* address)
+{
+    ZeroStruct(address);
+    address->sun_family = AF_UNIX;
+    if (socket_path.length >= sizeof(address->sun_path))
+    {
+        fprintf(stderr, "The socket path %.*s is too long.\n", StringArgs(socket_path));
+        return false;
+    }
+    memcpy(address->sun_path, socket_path.data, socket_path.length);
+    return true;
+}
+
+static int serve_request(Compiler* ctx, Environment* env, int connection)
+{
+    byte message[MAX_REQUEST_SIZE];
+    iovec io = { message, sizeof(message) };
+
+    alignas(cmsghdr) byte control[CMSG_SPACE(3 * sizeof(int))];
+    msghdr header = {};
+    header.msg_iov        = &io;
+    header.msg_iovlen     = 1;
+    header.msg_control    = control;
+    header.msg_controllen = sizeof(control);
+
+    smm received = recvmsg(connection, &header, MSG_CMSG_CLOEXEC);
+    cmsghdr* fds = CMSG_FIRSTHDR(&header);
+    if (received < (smm) sizeof(Compile_Request_Header) || !fds ||
+        fds->cmsg_level != SOL_SOCKET || fds->cmsg_type != SCM_RIGHTS ||
+        fds->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        return 1;
+
+    Compile_Request_Header request;
+    memcpy(&request, message, sizeof(request));
+    if (request.cwd_length + request.path_length > received - sizeof(request))
+        return 1;
+    String cwd  = { request.cwd_length,  message + sizeof(request) };
+    String path = { request.path_length, message + sizeof(request) + request.cwd_length };
+
+    int client_fds[3];
+    memcpy(client_fds, CMSG_DATA(fds), sizeof(client_fds));
+    for (int i = 0; i < 3; i++)
+    {
+        dup2(client_fds[i], i);
+        close_file_descriptor(client_fds[i]);
+    }
+
+    // Buffering was chosen for the server's stdout, the client's might be a terminal.
+    setvbuf(stdout, NULL, isatty(1) ? _IOLBF : _IOFBF, BUFSIZ);
+
+    if (chdir(make_c_style_string(cwd)) != 0)
+        fprintf(stderr, "Can't change the working directory to %.*s\n", StringArgs(cwd));
+
+    // The worker threads aren't forked along, the child starts its own pools if it needs them.
+    ctx->preparse = NULL;
+    ctx->codegen  = NULL;
+
+    s32 status = 1;
+    if (Block* main = parse_top_level_from_file(ctx, allocate_string(&ctx->parser_memory, path)))
+    {
+        materialize_unit(env, main);
+        if (pump_pipeline(ctx))
+            status = 0;
+    }
+    finish_preparse(ctx);
+    finish_codegen(ctx);
+
+    fflush(stdout);
+    fflush(stderr);
+    send(connection, &status, sizeof(status), MSG_NOSIGNAL);
+    return status;
+}
+
+int serve_compile_requests(Compiler* ctx, String socket_path)
+{
+    socket_path = get_socket_path(socket_path, /* create_directory */ true);
+    sockaddr_un address;
+    if (!socket_path || !make_socket_address(socket_path, &address))
+        return 1;
+
+    Environment* env = make_environment(ctx, NULL);
+    assert(pump_pipeline(ctx));  // force preload to complete
+
+    Block* warm = parse_top_level_from_memory(ctx, get_current_working_directory(), "<serve>"_s, warm_modules_code);
+    if (warm) materialize_unit(env, warm);
+    if (!warm || !pump_pipeline(ctx))
+    {
+        fprintf(stderr, "Failed to prepare the standard modules.\n");
+        return 1;
+    }
+    finish_preparse(ctx);
+    finish_codegen(ctx);  // the children start their own, see serve_request
+
+    int server = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (server < 0)
+    {
+        fprintf(stderr, "Failed to create a socket.\n");
+        return 1;
+    }
+    Defer(close_file_descriptor(server));
+
+    // A socket left behind by a server which is gone would make bind fail.
+    // Anything else at that path, or someone else's socket, is left alone.
+    struct stat st;
+    if (lstat(address.sun_path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode) || st.st_uid != getuid())
+        {
+            fprintf(stderr, "%.*s already exists, and isn't a socket of yours.\n", StringArgs(socket_path));
+            return 1;
+        }
+        ::unlink(address.sun_path);
+    }
+    if (bind(server, (sockaddr*) &address, sizeof(address)) != 0 || listen(server, 64) != 0)
+    {
+        fprintf(stderr, "Failed to listen on %.*s\n", StringArgs(socket_path));
+        return 1;
+    }
+
+    // Children are never waited for, the clients get their exit status.
+    ::signal(SIGCHLD, SIG_IGN);
+
+    fprintf(stderr, "Serving compile requests on %.*s\n", StringArgs(socket_path));
+    while (true)
+    {
+        int connection = accept4(server, NULL, NULL, SOCK_CLOEXEC);
+        if (connection < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            fprintf(stderr, "Failed to accept a connection.\n");
+            return 1;
+        }
+
+        if (!peer_is_same_user(connection))
+        {
+            fprintf(stderr, "Refused a connection from another user.\n");
+            close_file_descriptor(connection);
+            continue;
+        }
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            close_file_descriptor(server);
+            _exit(serve_request(ctx, env, connection));
+        }
+        if (child < 0)
+            fprintf(stderr, "Failed to fork for a compile request.\n");
+        close_file_descriptor(connection);
+    }
+}
+
+int run_on_compile_server(String socket_path, String path)
+{
+    socket_path = get_socket_path(socket_path, /* create_directory */ false);
+    sockaddr_un address;
+    if (!socket_path || !make_socket_address(socket_path, &address))
+        return 1;
+
+    int connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (connection < 0)
+    {
+        fprintf(stderr, "Failed to create a socket.\n");
+        return 1;
+    }
+    Defer(close_file_descriptor(connection));
+
+    if (connect(connection, (sockaddr*) &address, sizeof(address)) != 0)
+    {
+        fprintf(stderr, "Can't connect to the compile server at %.*s\n", StringArgs(socket_path));
+        return 1;
+    }
+
+    // Our stdio is only handed to a server that runs as us.
+    if (!peer_is_same_user(connection))
+    {
+        fprintf(stderr, "The compile server at %.*s is run by another user.\n", StringArgs(socket_path));
+        return 1;
+    }
+
+    String cwd = get_current_working_directory();
+    Compile_Request_Header request = { (u32) cwd.length, (u32) path.length };
+    if (sizeof(request) + cwd.length + path.length > MAX_REQUEST_SIZE)
+    {
+        fprintf(stderr, "The path is too long to send to the compile server.\n");
+        return 1;
+    }
+
+    byte message[MAX_REQUEST_SIZE];
+    memcpy(message, &request, sizeof(request));
+    memcpy(message + sizeof(request), cwd.data, cwd.length);
+    memcpy(message + sizeof(request) + cwd.length, path.data, path.length);
+    iovec io = { message, sizeof(request) + cwd.length + path.length };
+
+    int our_fds[3] = { 0, 1, 2 };
+    alignas(cmsghdr) byte control[CMSG_SPACE(sizeof(our_fds))] = {};
+    msghdr header = {};
+    header.msg_iov        = &io;
+    header.msg_iovlen     = 1;
+    header.msg_control    = control;
+    header.msg_controllen = sizeof(control);
+
+    cmsghdr* fds = CMSG_FIRSTHDR(&header);
+    fds->cmsg_level = SOL_SOCKET;
+    fds->cmsg_type  = SCM_RIGHTS;
+    fds->cmsg_len   = CMSG_LEN(sizeof(our_fds));
+    memcpy(CMSG_DATA(fds), our_fds, sizeof(our_fds));
+
+    fflush(stdout);
+    fflush(stderr);
+    if (sendmsg(connection, &header, MSG_NOSIGNAL) < 0)
+    {
+        fprintf(stderr, "Failed to send the request to the compile server.\n");
+        return 1;
+    }
+
+    s32 status;
+    smm received;
+    do received = recv(connection, &status, sizeof(status), 0);
+    while (received < 0 && errno == EINTR);
+    if (received != sizeof(status))
+    {
+        fprintf(stderr, "The compile server didn't report how the program finished.\n");
+        return 1;
+    }
+    return status;
+}
+
+
+ExitApplicationNamespace
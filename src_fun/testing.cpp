@@ -63,6 +63,8 @@ static String serialize_test(Region* memory, Test_Case* test)
     add_u64   (&cat, test->must_error_to_succeed != 0);
     add_string(&cat, test->error_wildcard);
     add_u64   (&cat, test->rng_seed);
+    add_string(&cat, test->flags);
+    add_string(&cat, test->output_wildcard);
     add_string(&cat, print_guid(test->serialized_file_guid));
     return resolve_to_string_and_free(&cat, memory);
 }
@@ -78,6 +80,8 @@ static Test_Case deserialize_test(String contents)
     t.must_error_to_succeed = read_u64   (&contents) != 0;
     t.error_wildcard        = read_string(&contents);
     t.rng_seed              = read_u64   (&contents);
+    t.flags                 = read_string(&contents);
+    t.output_wildcard       = read_string(&contents);
     t.serialized_file_guid  = parse_guid(read_string(&contents));
     return t;
 }
@@ -145,6 +149,8 @@ bool parse_test_file(Testing_Context* context, String relative_path, Array<Strin
 
         bool condition_defined           = false;
         bool seed_defined                = false;
+        bool flags_defined               = false;
+        bool output_defined              = false;
         bool started_parsing_description = false;
 
         String_Concatenator desc_cat = {}; // meow
@@ -202,6 +208,32 @@ bool parse_test_file(Testing_Context* context, String relative_path, Array<Strin
                     }
                     else test.rng_seed = U64_MAX;
                 }
+
+                if (!flags_defined)
+                {
+                    Defer(flags_defined = true);
+
+                    if (prefix_equals(line, "FLAGS"_s))
+                    {
+                        consume_until(&line, "FLAGS"_s);
+                        test.flags = allocate_string(&context->memory, trim(line));
+                        if (!test.flags) Error("Expected command line flags after 'FLAGS'.");
+                        continue;
+                    }
+                }
+
+                if (!output_defined)
+                {
+                    Defer(output_defined = true);
+
+                    if (prefix_equals(line, "OUTPUT WITH"_s))
+                    {
+                        consume_until(&line, "OUTPUT WITH"_s);
+                        test.output_wildcard = allocate_string(&context->memory, trim(line));
+                        if (!test.output_wildcard) Error("Expected a wildcard pattern after 'OUTPUT WITH'.");
+                        continue;
+                    }
+                }
             }
 
             started_parsing_description = true;
@@ -313,8 +345,22 @@ bool run_code_of_test(Test_Case* test)
     String code = resolve_to_string_and_free(&code_cat, temp);
 
     Compiler compiler = {};
+    compiler.module_cache_directory = get_command_line_string("module_cache"_s);
+    compiler.lazy_imports           = get_command_line_bool("lazy_imports"_s);
+    compiler.keep_comments          = get_command_line_bool("keep_comments"_s);
+    compiler.map_source_files       = get_command_line_bool("mmap_sources"_s);
+    compiler.skip_ir_passes         = get_command_line_bool("no_ir_passes"_s);
+    compiler.frontend_threads       = get_command_line_integer("frontend_threads"_s);
+    compiler.backend_threads        = get_command_line_integer("backend_threads"_s);
+    compiler.dump_bytecode          = get_command_line_bool("dump_bytecode"_s);
     add_default_import_path_patterns(&compiler);
+
+    // Compiled instead of run, the test runner runs the result, see :CompareCompiledTests
+    String compare_output = get_command_line_string("compare_output"_s);
+    compiler.compile_only = compare_output;
     Environment* env = make_environment(&compiler, NULL);
+    Defer(finish_preparse(&compiler));
+    Defer(finish_codegen(&compiler));
     assert(pump_pipeline(&compiler));  // force preload to complete
 
     // @Incomplete - add location information
@@ -365,6 +411,11 @@ bool run_code_of_test(Test_Case* test)
     materialize_unit(env, main, assert_having_unit->entry_block);
 
     bool ok = pump_pipeline(&compiler);
+    if (compiler.dump_bytecode)
+        print_bytecode_summary(&compiler);
+    if (ok && compare_output)
+        ok = (get_command_line_string("compare"_s) == "elf"_s) ? save_elf_executable(&compiler, compare_output)
+                                                                : save_bytecode_image(&compiler, compare_output);
 
     if (get_command_line_bool("stat"_s) ||
         get_command_line_bool("stats"_s) ||
@@ -385,27 +436,42 @@ bool run_code_of_test(Test_Case* test)
 
         col.title("Statistics"_s);
         col.add("files"_s,         compiler.top_level_blocks.count);
+        col.add("cached files"_s,  compiler.count_cached_modules);
+        col.add("preparsed files"_s, compiler.count_preparsed_modules);
         col.add("lexer"_s,         to_string(size_format(compiler.lexer_memory.total_size)));
+        col.add("mapped files"_s,  compiler.count_mapped_sources);
+        col.add("import probes"_s, compiler.count_import_probes);
         col.add("parser"_s,        to_string(size_format(compiler.parser_memory.total_size)));
         col.add("pipeline"_s,      to_string(size_format(compiler.pipeline_memory.total_size)));
         col.add("environments"_s,  compiler.environments.count);
 
         col.title("Parsing counters"_s);
-        col.add("identifier"_s,   compiler.identifiers.count);
+        col.add("identifier"_s,   load(&compiler.atoms.count_identifiers));
         col.add("number token"_s, compiler.token_info_number.count);
+        col.add("number value"_s, compiler.number_values.count);
         col.add("string token"_s, compiler.token_info_string.count);
-        col.add("atom"_s,         compiler.atom_table.count);
+        col.add("atom"_s,         count_atoms(&compiler.atoms));
         col.add("block"_s,        compiler.count_parsed_blocks);
         col.add("expressions"_s,  compiler.count_parsed_blocks);
+        col.add("comments"_s,     compiler.count_parsed_comments);
         expression_stats(&col,    compiler.count_parsed_expressions_by_kind);
 
         col.title("Inference counters"_s);
         col.add("unit"_s,         compiler.count_inferred_units);
         col.add("block"_s,        compiler.count_inferred_blocks);
         col.add("constant"_s,     compiler.count_inferred_constants);
+        col.add("lazy decl"_s,    compiler.count_lazy_declarations);
+        col.add("demanded decl"_s, compiler.count_demanded_declarations);
+        col.add("pooled constant"_s, compiler.constant_pool.count);
         col.add("expressions"_s,  compiler.count_inferred_expressions);
         expression_stats(&col,    compiler.count_inferred_expressions_by_kind);
 
+        col.title("Bytecode counters"_s);
+        col.add("inlined call"_s, compiler.count_inlined_calls);
+        col.add("hoisted expr"_s, compiler.count_hoisted_expressions);
+        col.add("ir removed"_s,   compiler.count_ir_removed_instructions);
+        col.add("parallel batch"_s, compiler.count_parallel_codegen_batches);
+
         col.done();
     }
 
@@ -430,6 +496,99 @@ int test_runner_entry()
 }
 
 
+// Interns the same random identifiers from 1 up to 'threads' threads, to see how the
+// atom table scales. Every identifier is interned many times, like in real code.
+struct Atom_Benchmark_Worker
+{
+    Atom_Table*   table;
+    Array<String> identifiers;
+    Array<Atom>   atoms;
+    bool          bulk;
+};
+
+static void atom_benchmark_worker(void* userdata)
+{
+    Atom_Benchmark_Worker* worker = (Atom_Benchmark_Worker*) userdata;
+    if (worker->bulk)
+        intern_identifiers(worker->table, worker->identifiers, worker->atoms.address);
+    else
+        for (umm i = 0; i < worker->identifiers.count; i++)
+            worker->atoms[i] = intern_identifier(worker->table, worker->identifiers[i]);
+}
+
+int atom_table_benchmark_entry()
+{
+    umm max_threads = get_command_line_integer("threads"_s);
+    if (!max_threads) max_threads = get_hardware_parallelism();
+    umm distinct = 100000;
+    umm count    = 2000000;
+
+    Random random;
+    seed(&random, 1234, 5678);
+
+    Array<String> names = allocate_array<String>(temp, distinct);
+    For (names)
+    {
+        *it = allocate_uninitialized_string(temp, next_u32(&random, 3, 16));
+        for (umm i = 0; i < it->length; i++)
+            it->data[i] = "abcdefghijklmnopqrstuvwxyz_0123456789"[next_u32(&random, 0, i ? 37 : 26)];
+    }
+
+    Array<String> identifiers = allocate_array<String>(temp, count);
+    For (identifiers) *it = names[next_u32(&random, 0, distinct)];
+    Array<Atom> atoms = allocate_array<Atom>(temp, count);
+
+    printf("%8s %8s %12s %12s\n", "threads", "mode", "ms", "Mintern/s");
+    for (umm threads = 1; threads <= max_threads; threads *= 2)
+    {
+        for (umm bulk = 0; bulk < 2; bulk++)
+        {
+            Atom_Table* table = alloc<Atom_Table>(NULL);
+            make_atom_table(table);
+
+            Array<Atom_Benchmark_Worker> workers = allocate_array<Atom_Benchmark_Worker>(temp, threads);
+            Array<Thread> handles = allocate_array<Thread>(temp, threads);
+            umm per_thread = count / threads;
+            for (umm i = 0; i < threads; i++)
+            {
+                umm first = i * per_thread;
+                umm last  = (i == threads - 1) ? count : first + per_thread;
+                workers[i].table       = table;
+                workers[i].identifiers = { last - first, identifiers.address + first };
+                workers[i].atoms       = { last - first, atoms.address + first };
+                workers[i].bulk        = bulk;
+            }
+
+            QPC start = current_qpc();
+            for (umm i = 0; i < threads; i++)
+                spawn_thread("atoms"_s, &workers[i], atom_benchmark_worker, &handles[i]);
+            for (umm i = 0; i < threads; i++)
+                wait(&handles[i]);
+            double seconds = seconds_from_qpc(current_qpc() - start);
+
+            // Every thread must have agreed on the atoms.
+            for (umm i = 0; i < count; i++)
+            {
+                if (get_identifier(table, atoms[i]) != identifiers[i] ||
+                    intern_identifier(table, identifiers[i]) != atoms[i])
+                {
+                    printf("Atom table returned a wrong atom for '%.*s'.\n", StringArgs(identifiers[i]));
+                    return 1;
+                }
+            }
+
+            printf("%8lu %8s %12.1f %12.2f\n", threads, bulk ? "bulk" : "single",
+                   seconds * 1000.0, count / seconds / 1000000.0);
+
+            free_atom_table(table);
+            free(table);
+        }
+    }
+
+    return 0;
+}
+
+
 static String get_testing_temp_dir()
 {
     return concatenate_path(temp, get_executable_directory(), "test_env_temp"_s);
@@ -456,6 +615,20 @@ static String get_test_stderr_path(Test_Case* test)
         Format(temp, "%.stderr", print_guid(test->serialized_file_guid)));
 }
 
+static String get_test_compiled_path(Test_Case* test, String suffix)
+{
+    return concatenate_path(temp,
+        get_testing_temp_dir(),
+        Format(temp, "%.compiled%", print_guid(test->serialized_file_guid), suffix));
+}
+
+// Images have to end in .funb to be run, see :BytecodeImage
+static String get_test_program_path(Test_Case* test)
+{
+    bool is_elf = (get_command_line_string("compare"_s) == "elf"_s);
+    return get_test_compiled_path(test, is_elf ? ""_s : ".funb"_s);
+}
+
 
 bool initialize_test_suite(Testing_Context* context, String directory, Array<String>* tests_to_run_wildcards)
 {
@@ -512,6 +685,174 @@ static void batch_for(Array<T> array, umm batch_size, L&& it)
     }
 }
 
+static Array<String> get_test_process_arguments(Test_Case* test, String compare_output = {})
+{
+    Dynamic_Array<String> args = {};
+    Defer(free_heap_array(&args));
+    *reserve_item(&args) = Format(temp, "-test_process:%", get_test_bin_file_path(test));
+    *reserve_item(&args) = Format(temp, "-seed:%",         test->rng_seed);
+    if (String module_cache = get_command_line_string("module_cache"_s))
+        *reserve_item(&args) = Format(temp, "-module_cache:%", module_cache);
+    if (get_command_line_bool("lazy_imports"_s))
+        *reserve_item(&args) = "-lazy_imports"_s;
+    if (get_command_line_bool("mmap_sources"_s))
+        *reserve_item(&args) = "-mmap_sources"_s;
+    if (get_command_line_bool("keep_comments"_s))
+        *reserve_item(&args) = "-keep_comments"_s;
+    if (get_command_line_bool("no_ir_passes"_s))
+        *reserve_item(&args) = "-no_ir_passes"_s;
+    if (s64 frontend_threads = get_command_line_integer("frontend_threads"_s))
+        *reserve_item(&args) = Format(temp, "-frontend_threads:%", frontend_threads);
+    if (s64 backend_threads = get_command_line_integer("backend_threads"_s))
+        *reserve_item(&args) = Format(temp, "-backend_threads:%", backend_threads);
+    if (compare_output)
+    {
+        *reserve_item(&args) = Format(temp, "-compare:%", get_command_line_string("compare"_s));
+        *reserve_item(&args) = Format(temp, "-compare_output:%", compare_output);
+    }
+    for (String flags = test->flags; flags;)
+        if (String flag = consume_until_whitespace(&flags))
+            *reserve_item(&args) = flag;
+    return allocate_array(temp, &args);
+}
+
+// :CompareCompiledTests
+// With -compare:image or -compare:elf, every test which passes and doesn't have to error is also
+// compiled to a bytecode image or to an executable, which is then run on its own. It has to exit
+// cleanly and print the same as the test did in the interpreter. Tests which can't be compiled,
+// because they use compiler intrinsics or something the native backend doesn't translate, are
+// skipped. Printed pointers differ between runs, so those lines aren't compared. With -compare:image,
+// broken copies of every compared image also have to be rejected.
+enum Compare_Result
+{
+    COMPARED_SAME,
+    COMPARED_DIFFERENT,
+    COMPARE_SKIPPED,
+};
+
+// Addresses are different in every run, so lines which are just a printed pointer match any other.
+static bool is_same_output(String output, String expected)
+{
+    auto is_pointer = [](String line)
+    {
+        if (line.length != 2 * sizeof(void*)) return false;
+        For (line)
+            if (!((*it >= '0' && *it <= '9') || (*it >= 'a' && *it <= 'f')))
+                return false;
+        return true;
+    };
+
+    while (output || expected)
+    {
+        String output_line   = consume_line_preserve_whitespace(&output);
+        String expected_line = consume_line_preserve_whitespace(&expected);
+        if (output_line != expected_line && !(is_pointer(output_line) && is_pointer(expected_line)))
+            return false;
+    }
+    return true;
+}
+
+static Compare_Result compare_compiled_test(Test_Case* test, String* out_explanation)
+{
+    String compiled = get_test_program_path(test);
+
+    Process compile = test->process;
+    compile.file_stdout = get_test_compiled_path(test, ".compile.stdout"_s);
+    compile.file_stderr = get_test_compiled_path(test, ".compile.stderr"_s);
+    compile.arguments   = get_test_process_arguments(test, compiled);
+    assert(run_process(&compile));
+
+    u32 exit_code = 12345;
+    if (!wait_for_process(&compile, 10.0, &exit_code))
+    {
+        terminate_process_without_waiting(&compile);
+        *out_explanation = "    Compiling the test timed out after 10s."_s;
+        return COMPARED_DIFFERENT;
+    }
+    if (exit_code != 0)
+        return COMPARE_SKIPPED;
+
+    Process run = test->process;
+    run.file_stdout = get_test_compiled_path(test, ".stdout"_s);
+    run.file_stderr = get_test_compiled_path(test, ".stderr"_s);
+    if (get_command_line_string("compare"_s) == "elf"_s)
+    {
+        run.path      = compiled;
+        run.arguments = {};
+    }
+    else
+    {
+        run.arguments = allocate_array<String>(temp, 1);
+        run.arguments[0] = compiled;
+    }
+    assert(run_process(&run));
+
+    if (!wait_for_process(&run, 10.0, &exit_code))
+    {
+        terminate_process_without_waiting(&run);
+        *out_explanation = "    The compiled test timed out after 10s."_s;
+        return COMPARED_DIFFERENT;
+    }
+
+    String expected = {}, output = {}, errors = {};
+    assert(read_entire_file(test->process.file_stdout, &expected, temp));
+    assert(read_entire_file(run.file_stdout, &output, temp));
+    assert(read_entire_file(run.file_stderr, &errors, temp));
+    if (exit_code != 0)
+    {
+        *out_explanation = Format(temp, "    The compiled test exited with %:\n\n%", exit_code, errors);
+        return COMPARED_DIFFERENT;
+    }
+    if (!is_same_output(output, expected))
+    {
+        *out_explanation = Format(temp, "    The compiled test printed:\n\n%\n    but the interpreter printed:\n\n%", output, expected);
+        return COMPARED_DIFFERENT;
+    }
+    return COMPARED_SAME;
+}
+
+// Returns the number of broken images which weren't rejected.
+static umm check_broken_images(Array<String> image_paths)
+{
+    umm total    = 0;
+    umm accepted = 0;
+    For (image_paths)
+    {
+        String image = {};
+        assert(read_entire_file(*it, &image, temp));
+
+        Dynamic_Array<String> broken = make_broken_bytecode_images(image);
+        Defer(free_heap_array(&broken));
+        for (umm i = 0; i < broken.count; i++, total++)
+        {
+            Process run = {};
+            run.path                    = get_executable_path();
+            run.file_stdout             = concatenate_path(temp, get_testing_temp_dir(), "broken.stdout"_s);
+            run.file_stderr             = concatenate_path(temp, get_testing_temp_dir(), "broken.stderr"_s);
+            run.current_directory       = get_testing_temp_dir();
+            run.prohibit_console_window = true;
+            run.arguments    = allocate_array<String>(temp, 1);
+            run.arguments[0] = concatenate_path(temp, get_testing_temp_dir(), "broken.funb"_s);
+            assert(write_entire_file(run.arguments[0], broken[i]));
+            assert(run_process(&run));
+
+            u32 exit_code = 12345;
+            if (!wait_for_process(&run, 10.0, &exit_code))
+                terminate_process_without_waiting(&run);
+
+            String errors = {};
+            assert(read_entire_file(run.file_stderr, &errors, temp));
+            if (exit_code != 1 || !match_wildcard_string("*is not a valid bytecode image*"_s, errors))
+            {
+                Print("Broken copy % of % wasn't rejected: %\n", i, *it, errors);
+                accepted++;
+            }
+        }
+    }
+    Print("Rejected % / % broken images.\n", total - accepted, total);
+    return accepted;
+}
+
 bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails, bool show_explanations)
 {
 #define PassedLiteral "\x1b[32;1mPASSED\x1b[m"
@@ -529,9 +870,20 @@ bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails, bool
     if (!only_log_fails)
         Print("Running tests...\n");
 
+    String compare = get_command_line_string("compare"_s);  // see :CompareCompiledTests
+    if (compare && compare != "image"_s && compare != "elf"_s)
+    {
+        Print("Unknown -compare:%, it's either 'image' or 'elf'.\n", compare);
+        return false;
+    }
+
     umm digits = digits_base10_u64(context->tests.count);
     umm passed_count = 0;
     umm test_index = 0;
+    umm compared_count     = 0;
+    umm not_compiled_count = 0;
+    Dynamic_Array<String> compared_images = {};
+    Defer(free_heap_array(&compared_images));
 
     batch_for(context->tests, get_hardware_parallelism(), [&](Array<Test_Case> batch)
     {
@@ -547,11 +899,7 @@ bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails, bool
             if (it->rng_seed == U64_MAX)
                 it->rng_seed = next_u64(&the_rng, 1, U64_MAX);
 
-            Dynamic_Array<String> args = {};
-            Defer(free_heap_array(&args));
-            *reserve_item(&args) = Format(temp, "-test_process:%", get_test_bin_file_path(it));
-            *reserve_item(&args) = Format(temp, "-seed:%",         it->rng_seed);
-            it->process.arguments = allocate_array(temp, &args);
+            it->process.arguments = get_test_process_arguments(it);
 
             assert(run_process(&it->process));
         }
@@ -615,6 +963,31 @@ bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails, bool
                             );
                     }
                 }
+
+                if (it->passed && it->output_wildcard)
+                {
+                    String stdout = {};
+                    assert(read_entire_file(it->process.file_stdout, &stdout, temp));
+
+                    it->passed = match_wildcard_string(Format(temp, "*%*", it->output_wildcard), stdout);
+                    if (!it->passed)
+                        fail_explanation = Format(temp,
+                            "    The output does not match the wildcard '%':\n\n%",
+                            it->output_wildcard, stdout
+                        );
+                }
+
+                // Tests with extra flags are about what the compiler prints, not the program.
+                if (it->passed && compare && !it->must_error_to_succeed && !it->flags)
+                {
+                    Compare_Result result = compare_compiled_test(it, &fail_explanation);
+                    if (result == COMPARE_SKIPPED) not_compiled_count++;
+                    else                           compared_count++;
+                    if (result == COMPARED_DIFFERENT)
+                        it->passed = false;
+                    if (result == COMPARED_SAME && compare == "image"_s)
+                        *reserve_item(&compared_images) = allocate_string(&context->memory, get_test_program_path(it));
+                }
             }
 
             if (it->passed)
@@ -636,6 +1009,15 @@ bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails, bool
         Print("\nDone! % / % tests passed.\n",
               u64_format(passed_count, digits), u64_format(context->tests.count, digits));
 
+    umm accepted_broken_images = 0;
+    if (compare)
+    {
+        Print("Compared % compiled tests with the interpreter, % couldn't be compiled to %.\n",
+              compared_count, not_compiled_count, compare == "elf"_s ? "an executable"_s : "an image"_s);
+        if (compared_images.count)
+            accepted_broken_images = check_broken_images(compared_images);
+    }
+
     bool first_rerun = true;
     For (context->tests)
     {
@@ -655,7 +1037,7 @@ bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails, bool
 #undef PassedLiteral
 #undef FailedLiteral
 
-    return (passed_count == context->tests.count);
+    return (passed_count == context->tests.count) && !accepted_broken_images;
 }
 
 ExitApplicationNamespace
@@ -14,6 +14,9 @@ struct Test_Case
 
     u64     rng_seed; // U64_MAX means random seed
 
+    String  flags;           // extra command line flags for the test process
+    String  output_wildcard; // if set, stdout must match this too
+
     GUID    serialized_file_guid;
     Process process;
     u32     pid;
@@ -39,6 +42,7 @@ void free_test_suite      (Testing_Context* context);
 bool run_tests(Testing_Context* context, char* argv0, bool only_log_fails = false, bool show_explanations = true);
 
 int test_runner_entry();
+int atom_table_benchmark_entry();
 
 
 ExitApplicationNamespace
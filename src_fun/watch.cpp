@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <unistd.h>
+#include "../src_common/common.h"
+#include "../src_common/hash.h"
+#include "../src_common/integer.h"
+#include "api.h"
+
+EnterApplicationNamespace
+
+
+// :WatchMode
+// With -watch, the compiler stays alive and the file is run again whenever it, or anything it
+// imports, changes. Files are polled by their write time.
+//
+// Parsed blocks are immutable and top_level_blocks is keyed by path, so a changed file is
+// invalidated by dropping it from top_level_blocks. Every file which imports it, directly or
+// not, is dropped as well, because its import expressions point at the old block. All other
+// files stay parsed.
+//
+// Every run gets a fresh environment. Run units execute when they're materialized, so in a kept
+// environment, the units of imports which weren't dropped would never run again.
+//
+// Parsing only ever appends to sources, the token stores and the compiler's regions, and
+// Token_Info::source_index is a u16. So after WATCH_RUNS_PER_PROCESS runs, or once half of the
+// source indices are used, the process executes itself again and starts over from scratch.
+
+static constexpr umm WATCH_RUNS_PER_PROCESS = 64;
+static constexpr umm WATCH_MAX_SOURCES      = U16_MAX / 2;
+
+struct Watch
+{
+    Compiler* ctx;
+    String    path;
+    umm       runs;
+
+    Table(String, File_Time, hash_string) write_times;  // of every file which was parsed
+};
+
+static File_Time get_write_time(String path)
+{
+    // Files which can't be read anymore count as changed, parsing them again reports why.
+    File_Time write_time = 0;
+    get_file_time(path, NULL, &write_time);
+    return write_time;
+}
+
+static void collect_imports(Block* block, Dynamic_Array<Block*>* imports)
+{
+    For (block->parsed_expressions)
+    {
+        if (it->kind != EXPRESSION_BLOCK && it->kind != EXPRESSION_UNIT) continue;
+        Block* child = it->parsed_block;
+        if (it->flags & EXPRESSION_UNIT_IS_IMPORT)
+            add_item(imports, &child);
+        else
+            collect_imports(child, imports);
+    }
+}
+
+static bool invalidate_changed_files(Watch* watch)
+{
+    Compiler* ctx = watch->ctx;
+
+    Dynamic_Array<String> changed = {};
+    Defer(free_heap_array(&changed));
+    For (watch->write_times)
+        if (get_write_time(it->key) != it->value)
+            add_item(&changed, &it->key);
+    if (!changed.count) return false;
+
+    struct Parsed_File
+    {
+        String        path;
+        Block*        block;
+        Array<Block*> imports;
+        bool          dropped;
+    };
+
+    Table(u64, bool, hash_u64) dropped_blocks = {};
+    Defer(free_table(&dropped_blocks));
+    auto drop = [&](Parsed_File* file)
+    {
+        u64 key = (u64) file->block;
+        bool yes = true;
+        set(&dropped_blocks, &key, &yes);
+        file->dropped = true;
+    };
+
+    Array<Parsed_File> files = allocate_array<Parsed_File>(temp, ctx->top_level_blocks.count);
+    umm file_index = 0;
+    For (ctx->top_level_blocks)
+    {
+        Parsed_File* file = &files[file_index++];
+        file->path  = it->key;
+        file->block = it->value;
+
+        Dynamic_Array<Block*> imports = {};
+        collect_imports(file->block, &imports);
+        file->imports = allocate_array(temp, &imports);
+        free_heap_array(&imports);
+    }
+
+    For (files)
+    {
+        // The file being watched always runs again, even if only a file it doesn't import changed.
+        if (it->path == watch->path)
+            drop(it);
+        for (umm i = 0; i < changed.count && !it->dropped; i++)
+            if (it->path == changed[i])
+                drop(it);
+    }
+
+    bool dropped_more = true;
+    while (dropped_more)
+    {
+        dropped_more = false;
+        For (files)
+        {
+            if (it->dropped) continue;
+            for (umm i = 0; i < it->imports.count; i++)
+            {
+                u64 key = (u64) it->imports[i];
+                if (!get(&dropped_blocks, &key)) continue;
+                drop(it);
+                dropped_more = true;
+                break;
+            }
+        }
+    }
+
+    For (files)
+        if (it->dropped)
+            remove(&ctx->top_level_blocks, &it->path);
+    For (changed)
+        remove(&watch->write_times, it);
+
+    // Files might have appeared or disappeared, so imports have to be resolved again.
+    free_table(&ctx->resolved_modules);
+    free_table(&ctx->checked_import_paths);
+    free_table(&ctx->listed_directories);
+    free_table(&ctx->listed_files);
+    return true;
+}
+
+static bool run_watched_file(Watch* watch)
+{
+    Compiler* ctx = watch->ctx;
+    watch->runs++;
+
+    Environment* env = make_environment(ctx, NULL);
+    assert(pump_pipeline(ctx));  // force preload to complete
+
+    Table(String, bool, hash_string) parsed_before = {};
+    Defer(free_table(&parsed_before));
+    For (ctx->top_level_blocks)
+    {
+        bool yes = true;
+        set(&parsed_before, &it->key, &yes);
+    }
+
+    Block* main = parse_top_level_from_file(ctx, watch->path);
+
+    Dynamic_Array<String> incomplete = {};
+    Defer(free_heap_array(&incomplete));
+    For (ctx->top_level_blocks)
+    {
+        if (!get(&watch->write_times, &it->key))
+        {
+            File_Time write_time = get_write_time(it->key);
+            set(&watch->write_times, &it->key, &write_time);
+        }
+
+        // If parsing failed, the files which were being parsed might be incomplete.
+        if (!main && !get(&parsed_before, &it->key))
+            add_item(&incomplete, &it->key);
+    }
+    For (incomplete)
+        remove(&ctx->top_level_blocks, it);
+
+    if (!get(&watch->write_times, &watch->path))
+    {
+        File_Time write_time = get_write_time(watch->path);
+        set(&watch->write_times, &watch->path, &write_time);
+    }
+
+    bool ok = false;
+    if (main)
+    {
+        materialize_unit(env, main);
+        ok = pump_pipeline(ctx);
+    }
+    finish_preparse(ctx);
+
+    // All environments are done once the program finishes, the next run makes its own.
+    ctx->environments.count = 0;
+    return ok;
+}
+
+static void restart_watch_process()
+{
+    Array<String> args = command_line_arguments();
+    Array<char*> argv = allocate_array<char*>(temp, args.count + 1);
+    for (umm i = 0; i < args.count; i++)
+        argv[i] = make_c_style_string(args[i]);
+    argv[args.count] = NULL;
+
+    fflush(stdout);
+    fflush(stderr);
+    execv("/proc/self/exe", argv.address);
+    fprintf(stderr, "[watch] Failed to restart the compiler.\n");
+    exit(1);
+}
+
+void watch_file(Compiler* ctx, String path)
+{
+    // Files might be written in place, which would change mapped sources under their tokens.
+    ctx->map_source_files = false;
+
+    Watch watch = {};
+    watch.ctx  = ctx;
+    watch.path = path;
+
+    while (true)
+    {
+        if (watch.runs >= WATCH_RUNS_PER_PROCESS || ctx->sources.count >= WATCH_MAX_SOURCES)
+            restart_watch_process();
+
+        QPC start = current_qpc();
+        umm sources_before = ctx->sources.count;
+        bool ok = run_watched_file(&watch);
+        fflush(stdout);
+
+        // Only files count, like in write_times, not the preload or other code parsed from memory.
+        umm parsed = 0;
+        for (umm i = sources_before; i < ctx->sources.count; i++)
+            if (ctx->sources[i].path) parsed++;
+
+        fprintf(stderr, "[watch] %s in %.3f s, parsed %llu of %llu files. Waiting for changes...\n",
+                ok ? "Finished" : "Failed", seconds_from_qpc(current_qpc() - start),
+                (unsigned long long) parsed, (unsigned long long) watch.write_times.count);
+
+        while (!invalidate_changed_files(&watch))
+            rough_sleep(0.1);
+    }
+}
+
+
+ExitApplicationNamespace